@@ -0,0 +1,210 @@
+/**
+ * @file mcp_actuator.c
+ * @brief 执行器命令总线 - 每个执行器实例一个最新值槽位，由执行器任务写入驱动
+ */
+
+#include "mcp_actuator.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "mcp_actuator";
+
+// 每个执行器实例的待执行命令槽位
+typedef struct {
+    mcp_actuator_cmd_t cmd;
+    mcp_actuator_done_cb_t done_cb;
+    void *cookie;
+    bool pending;
+    mcp_actuator_stats_t stats;
+} actuator_slot_t;
+
+#define SLOT_COUNT (MCP_ACTUATOR_COUNT * MCP_ACTUATOR_MAX_INSTANCES)
+
+_Static_assert(SLOT_COUNT <= 32, "one notify bit per slot");
+
+// 槽位 (actuator, index) 的编号，同时也是它的通知位
+#define SLOT_ID(actuator, index) ((actuator) * MCP_ACTUATOR_MAX_INSTANCES + (index))
+
+static struct {
+    actuator_slot_t slots[SLOT_COUNT];
+    mcp_actuator_driver_t drivers[MCP_ACTUATOR_COUNT];
+    TaskHandle_t task;
+    portMUX_TYPE lock;
+} g_actuator = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static const char *actuator_name(mcp_actuator_id_t actuator) {
+    switch (actuator) {
+        case MCP_ACTUATOR_LIGHT: return "light";
+        case MCP_ACTUATOR_FAN:   return "fan";
+        default:                 return "?";
+    }
+}
+
+static void apply_command(int slot_id) {
+    actuator_slot_t *slot = &g_actuator.slots[slot_id];
+    mcp_actuator_id_t actuator = (mcp_actuator_id_t)(slot_id / MCP_ACTUATOR_MAX_INSTANCES);
+    mcp_actuator_cmd_t cmd;
+    mcp_actuator_done_cb_t done_cb;
+    void *cookie;
+    mcp_actuator_driver_t driver;
+
+    portENTER_CRITICAL(&g_actuator.lock);
+    if (!slot->pending) {
+        portEXIT_CRITICAL(&g_actuator.lock);
+        return;
+    }
+    cmd = slot->cmd;
+    done_cb = slot->done_cb;
+    cookie = slot->cookie;
+    driver = g_actuator.drivers[actuator];
+    slot->pending = false;
+    portEXIT_CRITICAL(&g_actuator.lock);
+
+    // 驱动在锁外执行，执行期间提交的新命令会在下一轮处理
+    esp_err_t result = ESP_OK;
+    if (driver.apply) {
+        result = driver.apply(&cmd, driver.ctx);
+    } else {
+        ESP_LOGD(TAG, "No driver for %s%d, command recorded only", actuator_name(actuator), cmd.index);
+    }
+
+    portENTER_CRITICAL(&g_actuator.lock);
+    if (result == ESP_OK) {
+        slot->stats.applied++;
+    } else {
+        slot->stats.failed++;
+    }
+    portEXIT_CRITICAL(&g_actuator.lock);
+
+    if (result != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to apply %s%d command: %s", actuator_name(actuator), cmd.index, esp_err_to_name(result));
+    }
+    if (done_cb) {
+        done_cb(&cmd, result, cookie);
+    }
+}
+
+/**
+ * @brief 执行器任务：每个通知位对应一个有待执行命令的执行器实例
+ */
+static void actuator_task(void *pvParameters) {
+    uint32_t bits;
+
+    while (1) {
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        for (int i = 0; i < SLOT_COUNT; i++) {
+            if (bits & (1UL << i)) {
+                apply_command(i);
+            }
+        }
+    }
+}
+
+int mcp_actuator_init(void) {
+    if (g_actuator.task) {
+        return 0;
+    }
+
+    if (xTaskCreate(actuator_task, "mcp_actuator", MCP_ACTUATOR_TASK_STACK, NULL,
+                    MCP_ACTUATOR_TASK_PRIORITY, &g_actuator.task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create actuator task");
+        g_actuator.task = NULL;
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Actuator bus initialized");
+    return 0;
+}
+
+int mcp_actuator_register_driver(mcp_actuator_id_t actuator, const mcp_actuator_driver_t *driver) {
+    if ((unsigned)actuator >= MCP_ACTUATOR_COUNT) {
+        return -1;
+    }
+
+    portENTER_CRITICAL(&g_actuator.lock);
+    if (driver) {
+        g_actuator.drivers[actuator] = *driver;
+    } else {
+        memset(&g_actuator.drivers[actuator], 0, sizeof(mcp_actuator_driver_t));
+    }
+    portEXIT_CRITICAL(&g_actuator.lock);
+
+    ESP_LOGI(TAG, "%s driver %s", actuator_name(actuator), driver ? "registered" : "removed");
+    return 0;
+}
+
+int mcp_actuator_post(const mcp_actuator_cmd_t *cmd, mcp_actuator_done_cb_t done_cb, void *cookie) {
+    return mcp_actuator_post_batch(cmd, 1, done_cb, cookie);
+}
+
+int mcp_actuator_post_batch(const mcp_actuator_cmd_t *cmds, int count, mcp_actuator_done_cb_t done_cb, void *cookie) {
+    if (!cmds || count <= 0 || count > SLOT_COUNT || !g_actuator.task) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if ((unsigned)cmds[i].actuator >= MCP_ACTUATOR_COUNT || cmds[i].index >= MCP_ACTUATOR_MAX_INSTANCES) {
+            return -1;
+        }
+    }
+
+    struct {
+        mcp_actuator_cmd_t cmd;
+        mcp_actuator_done_cb_t done_cb;
+        void *cookie;
+    } replaced[SLOT_COUNT];
+    int replaced_count = 0;
+    uint32_t bits = 0;
+
+    portENTER_CRITICAL(&g_actuator.lock);
+    for (int i = 0; i < count; i++) {
+        int slot_id = SLOT_ID(cmds[i].actuator, cmds[i].index);
+        actuator_slot_t *slot = &g_actuator.slots[slot_id];
+        if (slot->pending) {
+            // 最新值优先：替换尚未执行的命令
+            if (slot->done_cb) {
+                replaced[replaced_count].cmd = slot->cmd;
+                replaced[replaced_count].done_cb = slot->done_cb;
+                replaced[replaced_count].cookie = slot->cookie;
+                replaced_count++;
+            }
+            slot->stats.coalesced++;
+        }
+        slot->cmd = cmds[i];
+        slot->done_cb = done_cb;
+        slot->cookie = cookie;
+        slot->pending = true;
+        slot->stats.posted++;
+        bits |= 1UL << slot_id;
+    }
+    portEXIT_CRITICAL(&g_actuator.lock);
+
+    for (int i = 0; i < replaced_count; i++) {
+        replaced[i].done_cb(&replaced[i].cmd, ESP_ERR_NOT_FINISHED, replaced[i].cookie);
+    }
+
+    xTaskNotify(g_actuator.task, bits, eSetBits);
+    return 0;
+}
+
+int mcp_actuator_get_stats(mcp_actuator_id_t actuator, mcp_actuator_stats_t *stats) {
+    if ((unsigned)actuator >= MCP_ACTUATOR_COUNT || !stats) {
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(mcp_actuator_stats_t));
+    portENTER_CRITICAL(&g_actuator.lock);
+    for (int i = 0; i < MCP_ACTUATOR_MAX_INSTANCES; i++) {
+        const mcp_actuator_stats_t *slot_stats = &g_actuator.slots[SLOT_ID(actuator, i)].stats;
+        stats->posted += slot_stats->posted;
+        stats->coalesced += slot_stats->coalesced;
+        stats->applied += slot_stats->applied;
+        stats->failed += slot_stats->failed;
+    }
+    portEXIT_CRITICAL(&g_actuator.lock);
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#ifndef _MCP_ACTUATOR_H_
+#define _MCP_ACTUATOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 执行器任务配置
+#define MCP_ACTUATOR_TASK_STACK     3072
+#define MCP_ACTUATOR_TASK_PRIORITY  4       // 低于请求处理任务，硬件写入不阻塞请求
+#define MCP_ACTUATOR_MAX_INSTANCES  4       // 每种执行器的最大实例数
+
+/**
+ * @brief 执行器
+ */
+typedef enum {
+    MCP_ACTUATOR_LIGHT = 0,
+    MCP_ACTUATOR_FAN,
+    MCP_ACTUATOR_COUNT
+} mcp_actuator_id_t;
+
+/**
+ * @brief 执行器命令，携带执行器的完整目标状态，因此后一条命令可以直接替换前一条
+ */
+typedef struct {
+    mcp_actuator_id_t actuator;
+    uint8_t index;                  ///< 实例编号 0..MCP_ACTUATOR_MAX_INSTANCES-1
+    union {
+        struct {
+            bool enabled;
+            uint8_t brightness;     ///< 0-100%
+            uint8_t red;
+            uint8_t green;
+            uint8_t blue;
+            uint16_t fade_ms;       ///< 渐变时间，0 表示驱动的默认值
+        } light;
+        struct {
+            bool enabled;
+            uint8_t speed;          ///< 1-5
+        } fan;
+    };
+} mcp_actuator_cmd_t;
+
+/**
+ * @brief 命令完成回调，在执行器任务中调用
+ * @param cmd 命令
+ * @param result 驱动返回值；被后一条命令替换（未写入硬件）时为 ESP_ERR_NOT_FINISHED
+ * @param cookie 提交命令时传入的参数
+ */
+typedef void (*mcp_actuator_done_cb_t)(const mcp_actuator_cmd_t *cmd, esp_err_t result, void *cookie);
+
+/**
+ * @brief 执行器驱动
+ */
+typedef struct {
+    esp_err_t (*apply)(const mcp_actuator_cmd_t *cmd, void *ctx);  ///< 写入硬件，可以阻塞
+    void *ctx;
+} mcp_actuator_driver_t;
+
+/**
+ * @brief 执行器统计
+ */
+typedef struct {
+    uint32_t posted;        ///< 提交的命令数
+    uint32_t coalesced;     ///< 被后一条命令替换的命令数
+    uint32_t applied;       ///< 驱动成功执行的命令数
+    uint32_t failed;        ///< 驱动执行失败的命令数
+} mcp_actuator_stats_t;
+
+/**
+ * @brief 初始化执行器并启动执行器任务
+ * @return 0 on success, -1 on failure
+ */
+int mcp_actuator_init(void);
+
+/**
+ * @brief 注册执行器驱动（未注册的执行器只记录命令），同一种执行器的所有实例共用驱动，由 cmd->index 区分
+ * @param actuator 执行器
+ * @param driver 驱动，NULL 表示注销
+ * @return 0 on success, -1 on failure
+ */
+int mcp_actuator_register_driver(mcp_actuator_id_t actuator, const mcp_actuator_driver_t *driver);
+
+/**
+ * @brief 提交命令，不阻塞
+ *
+ * 每个执行器实例只保留最新的一条待执行命令，连续提交时只有最后一条写入硬件。
+ *
+ * @param cmd 命令
+ * @param done_cb 完成回调 (可为 NULL)
+ * @param cookie 回调参数
+ * @return 0 on success, -1 on failure
+ */
+int mcp_actuator_post(const mcp_actuator_cmd_t *cmd, mcp_actuator_done_cb_t done_cb, void *cookie);
+
+/**
+ * @brief 一次提交多个执行器的命令（例如场景），只唤醒执行器任务一次
+ * @param cmds 命令数组，每个执行器实例最多一条
+ * @param count 命令数
+ * @param done_cb 完成回调，每条命令各调用一次 (可为 NULL)
+ * @param cookie 回调参数
+ * @return 0 on success, -1 on failure
+ */
+int mcp_actuator_post_batch(const mcp_actuator_cmd_t *cmds, int count, mcp_actuator_done_cb_t done_cb, void *cookie);
+
+/**
+ * @brief 获取执行器统计（所有实例之和）
+ * @param actuator 执行器
+ * @param stats 输出
+ * @return 0 on success, -1 on failure
+ */
+int mcp_actuator_get_stats(mcp_actuator_id_t actuator, mcp_actuator_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_ACTUATOR_H_ */
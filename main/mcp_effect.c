@@ -0,0 +1,305 @@
+/**
+ * @file mcp_effect.c
+ * @brief 灯光效果引擎 - 渐变、呼吸和色轮循环，由单个 esp_timer 每帧一次计算所有实例
+ *
+ * 启动效果时预先算好每帧的增量（渐变）或相位步长（呼吸、色轮），每帧只做查表和整数运算。
+ * 每帧以帧间隔作为硬件渐变时间提交给执行器，LEDC 在两帧之间平滑过渡。
+ * 帧直接提交到执行器，不经过设备状态，效果期间状态版本不变，也不触发持久化。
+ */
+
+#include "mcp_effect.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "mcp_effect";
+
+#define WAVE_SIZE       64          // 波形表长度，必须是 2 的幂
+#define WAVE_MASK       (WAVE_SIZE - 1)
+#define PHASE_SHIFT     16          // 相位为 Q16 定点，整数部分是波形表下标
+
+_Static_assert((WAVE_SIZE & WAVE_MASK) == 0, "WAVE_SIZE must be a power of two");
+
+// 升余弦波形 (1 - cos(2πi/64)) / 2 * 255，呼吸的亮度曲线和色轮的三个相位共用
+static const uint8_t g_wave[WAVE_SIZE] = {
+      0,   1,   2,   5,  10,  15,  21,  29,  37,  47,  57,  67,  79,  90, 103, 115,
+    127, 140, 152, 165, 176, 188, 198, 208, 218, 226, 234, 240, 245, 250, 253, 254,
+    255, 254, 253, 250, 245, 240, 234, 226, 218, 208, 198, 188, 176, 165, 152, 140,
+    128, 115, 103,  90,  79,  67,  57,  47,  37,  29,  21,  15,  10,   5,   2,   1,
+};
+
+static const char *const g_effect_names[MCP_EFFECT_TYPE_COUNT] = {
+    [MCP_EFFECT_NONE] = "stop",
+    [MCP_EFFECT_FADE] = "fade",
+    [MCP_EFFECT_BREATHE] = "breathe",
+    [MCP_EFFECT_CYCLE] = "cycle",
+};
+
+// 每个实例的效果状态，按字段分数组存放，每帧顺序遍历
+static struct {
+    uint32_t active;                                // 运行中的实例位掩码
+    mcp_effect_type_t type[MCP_EFFECT_MAX_LIGHTS];
+    uint32_t step[MCP_EFFECT_MAX_LIGHTS];           // 已输出的帧数
+    uint32_t total_steps[MCP_EFFECT_MAX_LIGHTS];    // 0 表示直到取消
+    uint32_t phase[MCP_EFFECT_MAX_LIGHTS];          // Q16 相位
+    uint32_t phase_step[MCP_EFFECT_MAX_LIGHTS];     // 每帧的相位增量
+    int32_t value[MCP_EFFECT_MAX_LIGHTS][4];        // FADE: Q16 当前值（亮度、R、G、B）
+    int32_t delta[MCP_EFFECT_MAX_LIGHTS][4];        // FADE: Q16 每帧增量
+    mcp_effect_frame_t target[MCP_EFFECT_MAX_LIGHTS];
+    uint32_t generation[MCP_EFFECT_MAX_LIGHTS];     // 启动或取消时加一，识别过时的完成回调
+    mcp_effect_done_cb_t done_cb;
+    esp_timer_handle_t tick_timer;
+    bool running;
+    SemaphoreHandle_t lock;         // 帧在锁内提交，取消返回后不会再有旧帧
+} g_effect;
+
+static uint8_t frame_channel(const mcp_effect_frame_t *frame, int channel) {
+    switch (channel) {
+        case 0:  return frame->brightness;
+        case 1:  return frame->red;
+        case 2:  return frame->green;
+        default: return frame->blue;
+    }
+}
+
+// 计算实例 i 的下一帧
+static void effect_frame(int i, mcp_effect_frame_t *frame) {
+    uint32_t idx = (g_effect.phase[i] >> PHASE_SHIFT) & WAVE_MASK;
+
+    switch (g_effect.type[i]) {
+        case MCP_EFFECT_FADE:
+            for (int c = 0; c < 4; c++) {
+                g_effect.value[i][c] += g_effect.delta[i][c];
+            }
+            frame->brightness = g_effect.value[i][0] >> PHASE_SHIFT;
+            frame->red = g_effect.value[i][1] >> PHASE_SHIFT;
+            frame->green = g_effect.value[i][2] >> PHASE_SHIFT;
+            frame->blue = g_effect.value[i][3] >> PHASE_SHIFT;
+            break;
+        case MCP_EFFECT_BREATHE:
+            *frame = g_effect.target[i];
+            frame->brightness = (g_effect.target[i].brightness * g_wave[idx] + 127) / 255;
+            break;
+        case MCP_EFFECT_CYCLE:
+            // 三个通道相差 1/3 周期
+            frame->brightness = g_effect.target[i].brightness;
+            frame->red = g_wave[idx];
+            frame->green = g_wave[(idx + WAVE_SIZE / 3) & WAVE_MASK];
+            frame->blue = g_wave[(idx + 2 * WAVE_SIZE / 3) & WAVE_MASK];
+            break;
+        default:
+            break;
+    }
+    g_effect.phase[i] += g_effect.phase_step[i];
+}
+
+static void tick_timer_callback(void *arg) {
+    mcp_actuator_cmd_t cmds[MCP_EFFECT_MAX_LIGHTS];
+    mcp_effect_frame_t finals[MCP_EFFECT_MAX_LIGHTS];
+    mcp_effect_type_t finished_type[MCP_EFFECT_MAX_LIGHTS];
+    uint32_t finished_generation[MCP_EFFECT_MAX_LIGHTS];
+    uint32_t finished = 0;
+    int count = 0;
+
+    xSemaphoreTake(g_effect.lock, portMAX_DELAY);
+    for (int i = 0; i < MCP_EFFECT_MAX_LIGHTS; i++) {
+        if (!(g_effect.active & (1UL << i))) {
+            continue;
+        }
+
+        mcp_effect_frame_t frame;
+        effect_frame(i, &frame);
+        g_effect.step[i]++;
+        if (g_effect.total_steps[i] && g_effect.step[i] >= g_effect.total_steps[i]) {
+            // 渐变最后一帧精确落在终点
+            if (g_effect.type[i] == MCP_EFFECT_FADE) {
+                frame = g_effect.target[i];
+            }
+            finals[i] = frame;
+            finished_type[i] = g_effect.type[i];
+            finished_generation[i] = g_effect.generation[i];
+            finished |= 1UL << i;
+            g_effect.active &= ~(1UL << i);
+            g_effect.type[i] = MCP_EFFECT_NONE;
+        }
+
+        cmds[count++] = (mcp_actuator_cmd_t) {
+            .actuator = MCP_ACTUATOR_LIGHT,
+            .index = i,
+            .light = {
+                .enabled = true,
+                .brightness = frame.brightness,
+                .red = frame.red,
+                .green = frame.green,
+                .blue = frame.blue,
+                .fade_ms = MCP_EFFECT_TICK_MS,
+            },
+        };
+    }
+    if (count > 0) {
+        mcp_actuator_post_batch(cmds, count, NULL, NULL);
+    }
+    if (!g_effect.active && g_effect.running) {
+        esp_timer_stop(g_effect.tick_timer);
+        g_effect.running = false;
+    }
+    xSemaphoreGive(g_effect.lock);
+
+    for (int i = 0; finished && i < MCP_EFFECT_MAX_LIGHTS; i++) {
+        if (!(finished & (1UL << i))) {
+            continue;
+        }
+        ESP_LOGI(TAG, "light%d %s finished", i, g_effect_names[finished_type[i]]);
+        if (g_effect.done_cb) {
+            g_effect.done_cb(i, finished_type[i] == MCP_EFFECT_FADE ? &finals[i] : NULL, finished_generation[i]);
+        }
+    }
+}
+
+int mcp_effect_init(mcp_effect_done_cb_t done_cb) {
+    if (g_effect.lock) {
+        return 0;
+    }
+
+    g_effect.lock = xSemaphoreCreateMutex();
+    if (!g_effect.lock) {
+        ESP_LOGE(TAG, "Failed to create effect lock");
+        return -1;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = tick_timer_callback,
+        .name = "mcp_effect"
+    };
+    if (esp_timer_create(&timer_args, &g_effect.tick_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create effect timer");
+        vSemaphoreDelete(g_effect.lock);
+        g_effect.lock = NULL;
+        return -1;
+    }
+    g_effect.done_cb = done_cb;
+
+    ESP_LOGI(TAG, "Effect engine initialized, frame: %d ms", MCP_EFFECT_TICK_MS);
+    return 0;
+}
+
+int mcp_effect_start(uint8_t index, const mcp_effect_params_t *params, const mcp_effect_frame_t *from) {
+    if (!g_effect.lock || !params || !from || index >= MCP_EFFECT_MAX_LIGHTS ||
+        params->type == MCP_EFFECT_NONE || params->type >= MCP_EFFECT_TYPE_COUNT ||
+        params->duration_ms < MCP_EFFECT_MIN_DURATION_MS || params->duration_ms > MCP_EFFECT_MAX_DURATION_MS ||
+        params->repeat > MCP_EFFECT_MAX_REPEAT) {
+        return -1;
+    }
+
+    // 每个周期（渐变为整个过程）的帧数，至少一帧
+    uint32_t period_steps = (params->duration_ms + MCP_EFFECT_TICK_MS / 2) / MCP_EFFECT_TICK_MS;
+    if (period_steps == 0) {
+        period_steps = 1;
+    }
+
+    xSemaphoreTake(g_effect.lock, portMAX_DELAY);
+    g_effect.generation[index]++;
+    g_effect.type[index] = params->type;
+    g_effect.target[index] = params->target;
+    g_effect.step[index] = 0;
+    g_effect.phase[index] = 0;
+    g_effect.phase_step[index] = ((uint32_t)WAVE_SIZE << PHASE_SHIFT) / period_steps;
+    if (params->type == MCP_EFFECT_FADE) {
+        g_effect.total_steps[index] = period_steps;
+        for (int c = 0; c < 4; c++) {
+            int32_t start = frame_channel(from, c);
+            int32_t end = frame_channel(&params->target, c);
+            g_effect.value[index][c] = start << PHASE_SHIFT;
+            g_effect.delta[index][c] = ((end - start) << PHASE_SHIFT) / (int32_t)period_steps;
+        }
+    } else {
+        g_effect.total_steps[index] = params->repeat * period_steps;
+    }
+    g_effect.active |= 1UL << index;
+
+    int ret = 0;
+    if (!g_effect.running) {
+        if (esp_timer_start_periodic(g_effect.tick_timer, MCP_EFFECT_TICK_MS * 1000) == ESP_OK) {
+            g_effect.running = true;
+        } else {
+            ESP_LOGE(TAG, "Failed to start effect timer");
+            g_effect.active &= ~(1UL << index);
+            g_effect.type[index] = MCP_EFFECT_NONE;
+            ret = -1;
+        }
+    }
+    xSemaphoreGive(g_effect.lock);
+
+    if (ret == 0) {
+        ESP_LOGI(TAG, "light%d %s started: %lu ms, repeat %u", index, g_effect_names[params->type],
+                 (unsigned long)params->duration_ms, params->repeat);
+    }
+    return ret;
+}
+
+void mcp_effect_cancel(uint32_t mask) {
+    if (!g_effect.lock) {
+        return;
+    }
+
+    xSemaphoreTake(g_effect.lock, portMAX_DELAY);
+    uint32_t cancelled = g_effect.active & mask;
+    g_effect.active &= ~mask;
+    for (int i = 0; i < MCP_EFFECT_MAX_LIGHTS; i++) {
+        if (mask & (1UL << i)) {
+            g_effect.generation[i]++;
+            g_effect.type[i] = MCP_EFFECT_NONE;
+        }
+    }
+    if (!g_effect.active && g_effect.running) {
+        esp_timer_stop(g_effect.tick_timer);
+        g_effect.running = false;
+    }
+    xSemaphoreGive(g_effect.lock);
+
+    if (cancelled) {
+        ESP_LOGD(TAG, "Effects cancelled: 0x%02lx", (unsigned long)cancelled);
+    }
+}
+
+mcp_effect_type_t mcp_effect_get(uint8_t index) {
+    if (!g_effect.lock || index >= MCP_EFFECT_MAX_LIGHTS) {
+        return MCP_EFFECT_NONE;
+    }
+
+    xSemaphoreTake(g_effect.lock, portMAX_DELAY);
+    mcp_effect_type_t type = g_effect.type[index];
+    xSemaphoreGive(g_effect.lock);
+    return type;
+}
+
+uint32_t mcp_effect_generation(uint8_t index) {
+    if (!g_effect.lock || index >= MCP_EFFECT_MAX_LIGHTS) {
+        return 0;
+    }
+
+    xSemaphoreTake(g_effect.lock, portMAX_DELAY);
+    uint32_t generation = g_effect.generation[index];
+    xSemaphoreGive(g_effect.lock);
+    return generation;
+}
+
+const char *mcp_effect_name_at(int index) {
+    return index >= 0 && index < MCP_EFFECT_TYPE_COUNT ? g_effect_names[index] : NULL;
+}
+
+int mcp_effect_type_from_name(const char *name, mcp_effect_type_t *type) {
+    if (!name || !type) {
+        return -1;
+    }
+
+    for (int i = 0; i < MCP_EFFECT_TYPE_COUNT; i++) {
+        if (strcmp(name, g_effect_names[i]) == 0) {
+            *type = (mcp_effect_type_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,118 @@
+#ifndef _MCP_EFFECT_H_
+#define _MCP_EFFECT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mcp_actuator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 灯光效果配置
+#define MCP_EFFECT_TICK_MS          40      // 帧间隔，所有效果共用一个 esp_timer
+#define MCP_EFFECT_MIN_DURATION_MS  200
+#define MCP_EFFECT_MAX_DURATION_MS  600000  // 10 分钟
+#define MCP_EFFECT_DEFAULT_DURATION_MS 2000
+#define MCP_EFFECT_MAX_REPEAT       1000
+#define MCP_EFFECT_MAX_LIGHTS       MCP_ACTUATOR_MAX_INSTANCES
+
+/**
+ * @brief 效果类型
+ */
+typedef enum {
+    MCP_EFFECT_NONE = 0,            ///< 无效果 / 停止
+    MCP_EFFECT_FADE,                ///< 在 duration_ms 内线性渐变到目标亮度和颜色
+    MCP_EFFECT_BREATHE,             ///< 亮度按周期 duration_ms 在 0 和目标亮度之间起伏
+    MCP_EFFECT_CYCLE,               ///< 颜色按周期 duration_ms 循环色轮
+    MCP_EFFECT_TYPE_COUNT
+} mcp_effect_type_t;
+
+/**
+ * @brief 一帧灯光输出
+ */
+typedef struct {
+    uint8_t brightness;             ///< 0-100%
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} mcp_effect_frame_t;
+
+/**
+ * @brief 效果参数
+ */
+typedef struct {
+    mcp_effect_type_t type;
+    uint32_t duration_ms;           ///< FADE: 渐变时间；BREATHE/CYCLE: 周期
+    uint16_t repeat;                ///< BREATHE/CYCLE: 周期数，0 表示直到停止；FADE 忽略
+    mcp_effect_frame_t target;      ///< FADE: 终点；BREATHE: 峰值亮度和颜色；CYCLE: 亮度
+} mcp_effect_params_t;
+
+/**
+ * @brief 效果结束回调，在 esp_timer 任务中调用（锁外），不能阻塞
+ *
+ * 回调执行前该实例可能已经启动了新的效果或被取消，用 generation 与 mcp_effect_generation()
+ * 比较，不相等时这次完成已过时。
+ *
+ * @param index 灯光实例
+ * @param final FADE 结束时为终点帧；BREATHE/CYCLE 结束时为 NULL，表示恢复效果开始前的状态
+ * @param generation 效果结束时实例的代号
+ */
+typedef void (*mcp_effect_done_cb_t)(uint8_t index, const mcp_effect_frame_t *final, uint32_t generation);
+
+/**
+ * @brief 初始化效果引擎（没有运行中的效果时 esp_timer 不运行）
+ * @param done_cb 效果自然结束时的回调（被取消的效果不回调）
+ * @return 0 on success, -1 on failure
+ */
+int mcp_effect_init(mcp_effect_done_cb_t done_cb);
+
+/**
+ * @brief 在一个灯光实例上启动效果，替换该实例正在运行的效果
+ * @param index 灯光实例
+ * @param params 效果参数
+ * @param from 当前输出（FADE 的起点）
+ * @return 0 on success, -1 on failure
+ */
+int mcp_effect_start(uint8_t index, const mcp_effect_params_t *params, const mcp_effect_frame_t *from);
+
+/**
+ * @brief 取消效果，返回后不会再为这些实例提交帧
+ * @param mask 灯光实例位掩码
+ */
+void mcp_effect_cancel(uint32_t mask);
+
+/**
+ * @brief 获取实例当前的效果
+ * @param index 灯光实例
+ * @return 效果类型，没有效果时为 MCP_EFFECT_NONE
+ */
+mcp_effect_type_t mcp_effect_get(uint8_t index);
+
+/**
+ * @brief 获取实例的代号，每次 mcp_effect_start() 或 mcp_effect_cancel() 选中该实例时加一
+ * @param index 灯光实例
+ * @return 代号
+ */
+uint32_t mcp_effect_generation(uint8_t index);
+
+/**
+ * @brief 效果名称，可作为工具参数的 enum_source（包含 "stop"）
+ * @param index 0..MCP_EFFECT_TYPE_COUNT-1
+ * @return 名称，超出范围时为 NULL
+ */
+const char *mcp_effect_name_at(int index);
+
+/**
+ * @brief 按名称查找效果类型（"stop" 对应 MCP_EFFECT_NONE）
+ * @param name 名称
+ * @param type 输出
+ * @return 0 on success, -1 if unknown
+ */
+int mcp_effect_type_from_name(const char *name, mcp_effect_type_t *type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_EFFECT_H_ */
@@ -0,0 +1,406 @@
+/**
+ * @file mcp_fan.c
+ * @brief 风扇驱动 - 继电器或 PWM（可选测速输入），软启动爬升和开关去抖；Linux 目标上为模拟后端
+ */
+
+#include "mcp_fan.h"
+#include "mcp_actuator.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "driver/gpio.h"
+#if CONFIG_MCP_FAN_MODE_PWM
+#include "driver/ledc.h"
+#endif
+#endif
+
+static const char *TAG = "mcp_fan";
+
+#if CONFIG_MCP_FAN_MODE_PWM
+#define FAN_MODE_NAME       "pwm"
+#define FAN_SOFT_START_MS   CONFIG_MCP_FAN_SOFT_START_MS
+#else
+#define FAN_MODE_NAME       "relay"
+#define FAN_SOFT_START_MS   0
+#endif
+
+// 档位 1-5 对应的占空比 (%)，低于约 30% 多数风扇无法可靠启动
+static const uint8_t g_fan_speed_duty_pct[MCP_FAN_SPEED_LEVELS + 1] = { 0, 40, 55, 70, 85, 100 };
+
+// 风扇驱动状态
+static struct {
+    SemaphoreHandle_t lock;             // 执行器任务与去抖定时器之间互斥
+    bool enabled;                       // 已写入硬件的开关状态
+    uint32_t duty;                      // 已写入硬件的目标占空比
+    int64_t last_toggle_us;
+    mcp_actuator_cmd_t deferred;        // 去抖期间推迟的最新命令
+    bool has_deferred;
+    esp_timer_handle_t debounce_timer;
+    uint32_t last_tach_count;
+    int64_t last_tach_us;
+} g_fan;
+
+uint32_t mcp_fan_duty_for(bool enabled, int speed) {
+    if (!enabled) {
+        return 0;
+    }
+    if (speed < 1) speed = 1;
+    if (speed > MCP_FAN_SPEED_LEVELS) speed = MCP_FAN_SPEED_LEVELS;
+    return MCP_FAN_DUTY_MAX * g_fan_speed_duty_pct[speed] / 100;
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#if CONFIG_MCP_FAN_MODE_PWM
+#define FAN_SPEED_MODE      LEDC_LOW_SPEED_MODE
+#define FAN_TIMER           LEDC_TIMER_1        // 与灯光 (LEDC_TIMER_0) 频率不同
+#define FAN_CHANNEL         LEDC_CHANNEL_3      // 灯光占用 0-2
+
+static volatile uint32_t g_tach_count;
+
+static void IRAM_ATTR tach_isr(void *arg) {
+    g_tach_count++;
+}
+
+static esp_err_t tach_init(void) {
+    if (CONFIG_MCP_FAN_TACH_GPIO < 0) {
+        return ESP_OK;
+    }
+
+    gpio_config_t io_config = {
+        .pin_bit_mask = 1ULL << CONFIG_MCP_FAN_TACH_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,   // 测速输出为开漏
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_NEGEDGE
+    };
+    esp_err_t ret = gpio_config(&io_config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {    // 已安装时返回 INVALID_STATE
+        return ret;
+    }
+    return gpio_isr_handler_add(CONFIG_MCP_FAN_TACH_GPIO, tach_isr, NULL);
+}
+
+#if CONFIG_MCP_FAN_TACH_GPIO >= 0
+static uint32_t backend_tach_count(void) {
+    return g_tach_count;
+}
+#endif
+#endif /* CONFIG_MCP_FAN_MODE_PWM */
+
+static esp_err_t backend_init(void) {
+#if CONFIG_MCP_FAN_MODE_PWM
+    ledc_timer_config_t timer_config = {
+        .speed_mode = FAN_SPEED_MODE,
+        .duty_resolution = MCP_FAN_DUTY_BITS,
+        .timer_num = FAN_TIMER,
+        .freq_hz = CONFIG_MCP_FAN_PWM_FREQ_HZ,
+        .clk_cfg = LEDC_AUTO_CLK
+    };
+    esp_err_t ret = ledc_timer_config(&timer_config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ledc_channel_config_t channel_config = {
+        .gpio_num = CONFIG_MCP_FAN_GPIO,
+        .speed_mode = FAN_SPEED_MODE,
+        .channel = FAN_CHANNEL,
+        .timer_sel = FAN_TIMER,
+        .duty = 0,
+        .hpoint = 0
+    };
+    ret = ledc_channel_config(&channel_config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // 灯光驱动可能已经安装了渐变服务
+    ret = ledc_fade_func_install(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        return ret;
+    }
+
+    return tach_init();
+#else
+    gpio_config_t io_config = {
+        .pin_bit_mask = 1ULL << CONFIG_MCP_FAN_GPIO,
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE
+    };
+    esp_err_t ret = gpio_config(&io_config);
+    return ret == ESP_OK ? gpio_set_level(CONFIG_MCP_FAN_GPIO, 0) : ret;
+#endif
+}
+
+static esp_err_t backend_set(uint32_t duty, uint32_t ramp_ms) {
+#if CONFIG_MCP_FAN_MODE_PWM
+    ledc_fade_stop(FAN_SPEED_MODE, FAN_CHANNEL);
+    if (ramp_ms == 0) {
+        esp_err_t ret = ledc_set_duty(FAN_SPEED_MODE, FAN_CHANNEL, duty);
+        return ret == ESP_OK ? ledc_update_duty(FAN_SPEED_MODE, FAN_CHANNEL) : ret;
+    }
+    esp_err_t ret = ledc_set_fade_with_time(FAN_SPEED_MODE, FAN_CHANNEL, duty, ramp_ms);
+    return ret == ESP_OK ? ledc_fade_start(FAN_SPEED_MODE, FAN_CHANNEL, LEDC_FADE_NO_WAIT) : ret;
+#else
+    return gpio_set_level(CONFIG_MCP_FAN_GPIO, duty > 0);
+#endif
+}
+
+uint32_t mcp_fan_get_duty(void) {
+#if CONFIG_MCP_FAN_MODE_PWM
+    return ledc_get_duty(FAN_SPEED_MODE, FAN_CHANNEL);
+#else
+    return g_fan.duty;
+#endif
+}
+
+#else /* CONFIG_IDF_TARGET_LINUX */
+
+// 模拟后端：记录每次占空比变化，按线性插值计算任意时刻的占空比
+static struct {
+    mcp_fan_sim_ramp_t history[MCP_FAN_SIM_HISTORY_SIZE];
+    uint32_t count;
+    uint64_t tach_pulses_x1e6;          // 积分得到的测速脉冲数 (×1e6)
+    int64_t tach_last_us;
+    portMUX_TYPE lock;
+} g_fan_sim = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static uint32_t sim_duty_at_locked(int64_t at_us) {
+    uint32_t oldest = g_fan_sim.count > MCP_FAN_SIM_HISTORY_SIZE ? g_fan_sim.count - MCP_FAN_SIM_HISTORY_SIZE : 0;
+    for (uint32_t i = g_fan_sim.count; i > oldest; i--) {
+        const mcp_fan_sim_ramp_t *ramp = &g_fan_sim.history[(i - 1) % MCP_FAN_SIM_HISTORY_SIZE];
+        if (ramp->start_us > at_us) {
+            continue;
+        }
+        int64_t elapsed_us = at_us - ramp->start_us;
+        int64_t ramp_us = (int64_t)ramp->ramp_ms * 1000;
+        if (elapsed_us >= ramp_us) {
+            return ramp->to_duty;
+        }
+        return (uint32_t)(ramp->from_duty + ((int64_t)ramp->to_duty - ramp->from_duty) * elapsed_us / ramp_us);
+    }
+    return 0;
+}
+
+// 按当前占空比累计模拟的测速脉冲，调用时必须持有锁
+static void sim_tach_advance_locked(int64_t now) {
+    if (g_fan_sim.tach_last_us) {
+        uint64_t rpm = (uint64_t)MCP_FAN_SIM_MAX_RPM * sim_duty_at_locked(now) / MCP_FAN_DUTY_MAX;
+        g_fan_sim.tach_pulses_x1e6 += rpm * MCP_FAN_TACH_PULSES_PER_REV * (uint64_t)(now - g_fan_sim.tach_last_us) / 60;
+    }
+    g_fan_sim.tach_last_us = now;
+}
+
+static esp_err_t backend_init(void) {
+    ESP_LOGI(TAG, "Using simulated fan backend");
+    return ESP_OK;
+}
+
+static esp_err_t backend_set(uint32_t duty, uint32_t ramp_ms) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&g_fan_sim.lock);
+    sim_tach_advance_locked(now);
+    mcp_fan_sim_ramp_t *ramp = &g_fan_sim.history[g_fan_sim.count % MCP_FAN_SIM_HISTORY_SIZE];
+    uint16_t from_duty = (uint16_t)sim_duty_at_locked(now);
+    ramp->start_us = now;
+    ramp->ramp_ms = ramp_ms;
+    ramp->from_duty = from_duty;
+    ramp->to_duty = (uint16_t)duty;
+    g_fan_sim.count++;
+    portEXIT_CRITICAL(&g_fan_sim.lock);
+
+    return ESP_OK;
+}
+
+static uint32_t backend_tach_count(void) {
+    portENTER_CRITICAL(&g_fan_sim.lock);
+    sim_tach_advance_locked(esp_timer_get_time());
+    uint32_t count = (uint32_t)(g_fan_sim.tach_pulses_x1e6 / 1000000);
+    portEXIT_CRITICAL(&g_fan_sim.lock);
+    return count;
+}
+
+uint32_t mcp_fan_sim_duty_at(int64_t at_us) {
+    portENTER_CRITICAL(&g_fan_sim.lock);
+    uint32_t duty = sim_duty_at_locked(at_us);
+    portEXIT_CRITICAL(&g_fan_sim.lock);
+    return duty;
+}
+
+size_t mcp_fan_sim_get_history(mcp_fan_sim_ramp_t *out, size_t max) {
+    if (!out) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&g_fan_sim.lock);
+    uint32_t count = g_fan_sim.count < MCP_FAN_SIM_HISTORY_SIZE ? g_fan_sim.count : MCP_FAN_SIM_HISTORY_SIZE;
+    if (count > max) {
+        count = max;
+    }
+    uint32_t start = g_fan_sim.count - count;
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = g_fan_sim.history[(start + i) % MCP_FAN_SIM_HISTORY_SIZE];
+    }
+    portEXIT_CRITICAL(&g_fan_sim.lock);
+
+    return count;
+}
+
+uint32_t mcp_fan_get_duty(void) {
+    return mcp_fan_sim_duty_at(esp_timer_get_time());
+}
+
+#endif /* CONFIG_IDF_TARGET_LINUX */
+
+uint32_t mcp_fan_get_rpm(void) {
+#if CONFIG_IDF_TARGET_LINUX || (CONFIG_MCP_FAN_MODE_PWM && CONFIG_MCP_FAN_TACH_GPIO >= 0)
+    int64_t now = esp_timer_get_time();
+    uint32_t count = backend_tach_count();
+
+    xSemaphoreTake(g_fan.lock, portMAX_DELAY);
+    uint32_t rpm = 0;
+    int64_t elapsed_us = now - g_fan.last_tach_us;
+    if (g_fan.last_tach_us && elapsed_us > 0) {
+        rpm = (uint32_t)((uint64_t)(count - g_fan.last_tach_count) * 60 * 1000000 /
+                         ((uint64_t)elapsed_us * MCP_FAN_TACH_PULSES_PER_REV));
+    }
+    g_fan.last_tach_count = count;
+    g_fan.last_tach_us = now;
+    xSemaphoreGive(g_fan.lock);
+
+    return rpm;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief 写入风扇状态，调用时必须持有 g_fan.lock
+ * 占空比上升时按软启动时间爬升（时间与升幅成正比），下降时立即生效
+ */
+static esp_err_t fan_set_locked(bool enabled, int speed) {
+    uint32_t duty = mcp_fan_duty_for(enabled, speed);
+    uint32_t current = mcp_fan_get_duty();
+    uint32_t ramp_ms = 0;
+    if (duty > current) {
+        ramp_ms = (uint32_t)((uint64_t)FAN_SOFT_START_MS * (duty - current) / MCP_FAN_DUTY_MAX);
+    }
+
+    esp_err_t ret = backend_set(duty, ramp_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (enabled != g_fan.enabled) {
+        g_fan.last_toggle_us = esp_timer_get_time();
+    }
+    g_fan.enabled = enabled;
+    g_fan.duty = duty;
+
+    ESP_LOGD(TAG, "Fan %s, speed %d, duty %lu, ramp %lu ms", enabled ? "on" : "off", speed,
+             (unsigned long)duty, (unsigned long)ramp_ms);
+    return ESP_OK;
+}
+
+static void debounce_timer_callback(void *arg) {
+    xSemaphoreTake(g_fan.lock, portMAX_DELAY);
+    if (g_fan.has_deferred) {
+        g_fan.has_deferred = false;
+        esp_err_t ret = fan_set_locked(g_fan.deferred.fan.enabled, g_fan.deferred.fan.speed);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to apply deferred fan state: %s", esp_err_to_name(ret));
+        }
+    }
+    xSemaphoreGive(g_fan.lock);
+}
+
+/**
+ * @brief 执行器驱动：距上次开关不足去抖时间的开关命令推迟到窗口结束，只执行窗口内最后的状态
+ */
+static esp_err_t fan_apply(const mcp_actuator_cmd_t *cmd, void *ctx) {
+    if (cmd->index != 0) {
+        // 只有 fan0 接在风扇输出上
+        ESP_LOGD(TAG, "fan%d has no output", cmd->index);
+        return ESP_OK;
+    }
+
+    esp_err_t ret = ESP_OK;
+    int64_t now = esp_timer_get_time();
+    int64_t debounce_us = (int64_t)CONFIG_MCP_FAN_TOGGLE_DEBOUNCE_MS * 1000;
+
+    xSemaphoreTake(g_fan.lock, portMAX_DELAY);
+    int64_t since_toggle_us = now - g_fan.last_toggle_us;
+    if (g_fan.has_deferred || (cmd->fan.enabled != g_fan.enabled && since_toggle_us < debounce_us)) {
+        // 窗口内：更新推迟的命令，窗口结束时由定时器执行
+        bool timer_pending = g_fan.has_deferred;
+        g_fan.deferred = *cmd;
+        g_fan.has_deferred = true;
+        if (!timer_pending) {
+            esp_timer_start_once(g_fan.debounce_timer, debounce_us - since_toggle_us);
+        }
+    } else {
+        ret = fan_set_locked(cmd->fan.enabled, cmd->fan.speed);
+    }
+    xSemaphoreGive(g_fan.lock);
+
+    return ret;
+}
+
+int mcp_fan_init(void) {
+    if (g_fan.lock) {
+        return 0;
+    }
+
+    g_fan.lock = xSemaphoreCreateMutex();
+    if (!g_fan.lock) {
+        ESP_LOGE(TAG, "Failed to create fan lock");
+        return -1;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = debounce_timer_callback,
+        .name = "fan_debounce"
+    };
+    if (esp_timer_create(&timer_args, &g_fan.debounce_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create debounce timer");
+        vSemaphoreDelete(g_fan.lock);
+        g_fan.lock = NULL;
+        return -1;
+    }
+
+    esp_err_t ret = backend_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize fan backend: %s", esp_err_to_name(ret));
+        esp_timer_delete(g_fan.debounce_timer);
+        vSemaphoreDelete(g_fan.lock);
+        memset(&g_fan, 0, sizeof(g_fan));
+        return -1;
+    }
+
+    mcp_actuator_driver_t driver = {
+        .apply = fan_apply,
+        .ctx = NULL
+    };
+    if (mcp_actuator_register_driver(MCP_ACTUATOR_FAN, &driver) != 0) {
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Fan driver initialized (%s), soft start: %d ms, debounce: %d ms",
+             FAN_MODE_NAME, FAN_SOFT_START_MS, CONFIG_MCP_FAN_TOGGLE_DEBOUNCE_MS);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef _MCP_FAN_H_
+#define _MCP_FAN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 风扇 PWM 配置
+#define MCP_FAN_DUTY_BITS           10
+#define MCP_FAN_DUTY_MAX            ((1U << MCP_FAN_DUTY_BITS) - 1)
+#define MCP_FAN_SPEED_LEVELS        5
+#define MCP_FAN_TACH_PULSES_PER_REV 2       // 常见 PC 风扇每转 2 个脉冲
+#define MCP_FAN_SIM_MAX_RPM         3000    // 模拟后端满占空比时的转速
+#define MCP_FAN_SIM_HISTORY_SIZE    16      // 模拟后端记录的占空比变化条数
+
+/**
+ * @brief 初始化风扇驱动并注册为 MCP_ACTUATOR_FAN 的驱动
+ *
+ * 继电器模式只有开关；PWM 模式按档位映射占空比，启动和加速时按软启动时间爬升。
+ * 短时间内的反复开关会被合并，只执行最后的状态。
+ * Linux 目标上使用模拟后端，记录占空比变化。
+ *
+ * @return 0 on success, -1 on failure
+ */
+int mcp_fan_init(void);
+
+/**
+ * @brief 档位对应的占空比
+ * @param enabled 开关
+ * @param speed 档位 1-5
+ * @return 占空比 0-MCP_FAN_DUTY_MAX（继电器模式下非 0 即开）
+ */
+uint32_t mcp_fan_duty_for(bool enabled, int speed);
+
+/**
+ * @brief 获取当前占空比（爬升过程中返回中间值）
+ * @return 占空比
+ */
+uint32_t mcp_fan_get_duty(void);
+
+/**
+ * @brief 获取风扇转速（根据两次调用之间的测速脉冲计算）
+ * @return 转速 (RPM)，没有测速输入时返回 0
+ */
+uint32_t mcp_fan_get_rpm(void);
+
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief 模拟后端记录的一次占空比变化
+ */
+typedef struct {
+    int64_t start_us;           ///< 开始时间
+    uint32_t ramp_ms;           ///< 爬升时长，0 表示立即生效
+    uint16_t from_duty;
+    uint16_t to_duty;
+} mcp_fan_sim_ramp_t;
+
+/**
+ * @brief 读取模拟后端记录的占空比变化（从旧到新）
+ * @param out 输出数组
+ * @param max 数组长度
+ * @return 写入的条数
+ */
+size_t mcp_fan_sim_get_history(mcp_fan_sim_ramp_t *out, size_t max);
+
+/**
+ * @brief 计算模拟风扇在指定时刻的占空比
+ * @param at_us 时间 (esp_timer_get_time() 时间基准)
+ * @return 占空比
+ */
+uint32_t mcp_fan_sim_duty_at(int64_t at_us);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_FAN_H_ */
@@ -0,0 +1,191 @@
+/**
+ * @file mcp_fan_auto.c
+ * @brief 风扇自动调速 - 定点 PI 控制器，根据温度误差选择 fan0 的档位
+ *
+ * 温度以 0.01 °C 为单位，增益、积分和输出都是 Q16 定点档位。
+ * 输出饱和且误差会加深饱和时停止积分（抗积分饱和），积分项也限制在输出范围内。
+ * 每次换挡后至少停留 dwell_s，且每次只移动一档，避免风扇频繁变速。
+ * 开启期间 fan0 由控制器独占：手动控制、规则或定时关闭改变了 fan0 时，下一次采样恢复当前档位。
+ */
+
+#include "mcp_fan_auto.h"
+#include "mcp_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <math.h>
+
+static const char *TAG = "mcp_fan_auto";
+
+#define Q16_ONE         (1 << 16)
+#define LEVEL_MAX_Q16   ((int64_t)MCP_FAN_AUTO_MAX_LEVEL << 16)
+
+static struct {
+    mcp_fan_auto_config_t config;
+    int32_t setpoint_c;         // 0.01 °C
+    int32_t kp_q16;             // 档位/°C
+    int32_t ki_q16;             // 档位/(°C·s)
+    int64_t integral_q16;       // 档位
+    int level;                  // 当前档位，0 为关闭
+    int64_t last_sample_us;
+    int64_t last_step_us;
+    SemaphoreHandle_t lock;
+} g_fan_auto = {
+    .config = {
+        .enabled = false,
+        .setpoint = MCP_FAN_AUTO_DEFAULT_SETPOINT,
+        .kp = MCP_FAN_AUTO_DEFAULT_KP,
+        .ki = MCP_FAN_AUTO_DEFAULT_KI,
+        .dwell_s = MCP_FAN_AUTO_DEFAULT_DWELL_S,
+    },
+};
+
+static void apply_level(int level) {
+    mcp_fan_update_t update = MCP_FAN_UPDATE_INIT;
+    update.enabled = level > 0;
+    if (level > 0) {
+        update.speed = level;
+    }
+    int ret = mcp_server_control_fans(NULL, &update, NULL);
+    ESP_LOGI(TAG, "Fan auto level -> %d (ret=%d)", level, ret);
+}
+
+// fan0 是否处于该档位（0 档为关闭，不比较速度）
+static bool fan0_at_level(int level) {
+    mcp_fan_table_t fans;
+    if (mcp_server_get_devices(NULL, &fans) != 0 || fans.count == 0) {
+        return true;
+    }
+    return level > 0 ? fans.enabled[0] && fans.speed[0] == level : !fans.enabled[0];
+}
+
+int mcp_fan_auto_init(void) {
+    if (g_fan_auto.lock) {
+        return 0;
+    }
+
+    g_fan_auto.lock = xSemaphoreCreateMutex();
+    if (!g_fan_auto.lock) {
+        ESP_LOGE(TAG, "Failed to create fan auto lock");
+        return -1;
+    }
+    return 0;
+}
+
+int mcp_fan_auto_configure(const mcp_fan_auto_config_t *config) {
+    if (!config || !g_fan_auto.lock || !(config->setpoint >= 5.0f && config->setpoint <= 40.0f) ||
+        !(config->kp >= 0.0f && config->kp <= 10.0f) || !(config->ki >= 0.0f && config->ki <= 1.0f) ||
+        config->dwell_s > MCP_FAN_AUTO_MAX_DWELL_S) {
+        return -1;
+    }
+
+    // 无扰切换：从 fan0 当前档位开始积分
+    int start_level = 0;
+    mcp_fan_table_t fans;
+    if (config->enabled && mcp_server_get_devices(NULL, &fans) == 0 && fans.count > 0 && fans.enabled[0]) {
+        start_level = fans.speed[0];
+    }
+
+    xSemaphoreTake(g_fan_auto.lock, portMAX_DELAY);
+    bool was_enabled = g_fan_auto.config.enabled;
+    g_fan_auto.config = *config;
+    g_fan_auto.setpoint_c = lroundf(config->setpoint * 100.0f);
+    g_fan_auto.kp_q16 = lroundf(config->kp * Q16_ONE);
+    g_fan_auto.ki_q16 = lroundf(config->ki * Q16_ONE);
+    if (config->enabled && !was_enabled) {
+        g_fan_auto.level = start_level;
+        g_fan_auto.integral_q16 = (int64_t)start_level << 16;
+        g_fan_auto.last_sample_us = 0;
+        g_fan_auto.last_step_us = 0;
+    }
+    xSemaphoreGive(g_fan_auto.lock);
+
+    ESP_LOGI(TAG, "Fan auto mode %s: setpoint %.1f°C, kp %.2f, ki %.3f, dwell %lu s",
+             config->enabled ? "on" : "off", config->setpoint, config->kp, config->ki,
+             (unsigned long)config->dwell_s);
+    return 0;
+}
+
+void mcp_fan_auto_get(mcp_fan_auto_config_t *config, int *level) {
+    if (!g_fan_auto.lock) {
+        if (config) {
+            *config = g_fan_auto.config;
+        }
+        if (level) {
+            *level = 0;
+        }
+        return;
+    }
+
+    xSemaphoreTake(g_fan_auto.lock, portMAX_DELAY);
+    if (config) {
+        *config = g_fan_auto.config;
+    }
+    if (level) {
+        *level = g_fan_auto.level;
+    }
+    xSemaphoreGive(g_fan_auto.lock);
+}
+
+void mcp_fan_auto_sample(float temperature) {
+    if (!g_fan_auto.lock || !isfinite(temperature)) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int new_level = -1;
+
+    xSemaphoreTake(g_fan_auto.lock, portMAX_DELAY);
+    if (!g_fan_auto.config.enabled) {
+        xSemaphoreGive(g_fan_auto.lock);
+        return;
+    }
+
+    // 误差为正表示偏热，需要更高档位
+    int32_t error_c = lroundf(temperature * 100.0f) - g_fan_auto.setpoint_c;
+    int64_t dt_ms = g_fan_auto.last_sample_us ? (now - g_fan_auto.last_sample_us) / 1000 : 0;
+    if (dt_ms > MCP_FAN_AUTO_MAX_DT_MS) {
+        dt_ms = MCP_FAN_AUTO_MAX_DT_MS;
+    }
+    g_fan_auto.last_sample_us = now;
+
+    int64_t p_q16 = (int64_t)g_fan_auto.kp_q16 * error_c / 100;
+    int64_t output_q16 = p_q16 + g_fan_auto.integral_q16;
+    bool saturated = (output_q16 >= LEVEL_MAX_Q16 && error_c > 0) || (output_q16 <= 0 && error_c < 0);
+    if (!saturated) {
+        g_fan_auto.integral_q16 += (int64_t)g_fan_auto.ki_q16 * error_c * dt_ms / (100 * 1000);
+        if (g_fan_auto.integral_q16 < 0) {
+            g_fan_auto.integral_q16 = 0;
+        } else if (g_fan_auto.integral_q16 > LEVEL_MAX_Q16) {
+            g_fan_auto.integral_q16 = LEVEL_MAX_Q16;
+        }
+        output_q16 = p_q16 + g_fan_auto.integral_q16;
+    }
+
+    int desired = output_q16 <= 0 ? 0 : (int)((output_q16 + Q16_ONE / 2) >> 16);
+    if (desired > MCP_FAN_AUTO_MAX_LEVEL) {
+        desired = MCP_FAN_AUTO_MAX_LEVEL;
+    }
+
+    // 每个停留时间最多移动一档
+    int64_t dwell_us = (int64_t)g_fan_auto.config.dwell_s * 1000000;
+    if (desired != g_fan_auto.level && (!g_fan_auto.last_step_us || now - g_fan_auto.last_step_us >= dwell_us)) {
+        g_fan_auto.level += desired > g_fan_auto.level ? 1 : -1;
+        g_fan_auto.last_step_us = now;
+        new_level = g_fan_auto.level;
+    }
+    int level = g_fan_auto.level;
+    xSemaphoreGive(g_fan_auto.lock);
+
+    // fan0 被外部改变时重新写入当前档位
+    if (new_level < 0 && !fan0_at_level(level)) {
+        ESP_LOGI(TAG, "fan0 changed externally, restoring level %d", level);
+        new_level = level;
+    }
+
+    // 控制调用在锁外，期间的采样不会被阻塞太久
+    if (new_level >= 0) {
+        apply_level(new_level);
+    }
+}
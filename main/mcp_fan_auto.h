@@ -0,0 +1,61 @@
+#ifndef _MCP_FAN_AUTO_H_
+#define _MCP_FAN_AUTO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 风扇自动调速配置
+#define MCP_FAN_AUTO_MAX_LEVEL          5       // 最高速度档，0 档表示关闭风扇
+#define MCP_FAN_AUTO_DEFAULT_SETPOINT   25.0f   // °C
+#define MCP_FAN_AUTO_DEFAULT_KP         1.0f    // 每 °C 误差的档位
+#define MCP_FAN_AUTO_DEFAULT_KI         0.01f   // 每 °C·s 累积误差的档位
+#define MCP_FAN_AUTO_DEFAULT_DWELL_S    30      // 每次换挡后的最短停留时间
+#define MCP_FAN_AUTO_MAX_DWELL_S        600
+#define MCP_FAN_AUTO_MAX_DT_MS          10000   // 采样间隔上限，避免长时间无采样后积分突变
+
+/**
+ * @brief 自动调速参数
+ */
+typedef struct {
+    bool enabled;
+    float setpoint;             ///< 目标温度 5-40 °C
+    float kp;                   ///< 比例增益 0-10 档/°C
+    float ki;                   ///< 积分增益 0-1 档/(°C·s)
+    uint32_t dwell_s;           ///< 换挡后的最短停留时间 0-MCP_FAN_AUTO_MAX_DWELL_S
+} mcp_fan_auto_config_t;
+
+/**
+ * @brief 初始化风扇自动调速（默认关闭）
+ * @return 0 on success, -1 on failure
+ */
+int mcp_fan_auto_init(void);
+
+/**
+ * @brief 配置自动调速，从关闭切换到开启时以 fan0 的当前档位为起点（无扰切换）
+ * @param config 参数
+ * @return 0 on success, -1 on invalid parameters or not initialized
+ */
+int mcp_fan_auto_configure(const mcp_fan_auto_config_t *config);
+
+/**
+ * @brief 获取当前参数和档位
+ * @param config 输出参数 (可为 NULL)
+ * @param level 输出当前档位 0-MCP_FAN_AUTO_MAX_LEVEL (可为 NULL)
+ */
+void mcp_fan_auto_get(mcp_fan_auto_config_t *config, int *level);
+
+/**
+ * @brief 输入一个温度采样，在传感器任务中每次采样调用；档位变化或 fan0 被外部改变时控制 fan0
+ * @param temperature 温度 °C
+ */
+void mcp_fan_auto_sample(float temperature);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_FAN_AUTO_H_ */
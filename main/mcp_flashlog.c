@@ -0,0 +1,401 @@
+/**
+ * @file mcp_flashlog.c
+ * @brief Flash 时间序列日志 - history 分区上的只追加段日志
+ *
+ * 分区按擦除扇区分段，段的第一个记录槽是段头（序号、擦除次数），其余槽依次写入记录，
+ * 每条记录是一页压缩的历史数据，一次写入。段写满后写入下一个段，日志写满后擦除最早的段，
+ * 所有段按顺序轮换，擦除次数均匀，并保存在段头中用于监测磨损。
+ *
+ * 启动时读取段头和页头重建内存中的段索引（每段的时间范围），查询先在索引中二分查找，
+ * 只读取与范围重叠的段。页头带 CRC，写入中断的记录在启动时被识别，所在段不再写入。
+ */
+
+#include "mcp_flashlog.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stddef.h>
+
+static const char *TAG = "mcp_flashlog";
+
+#define SEGMENT_MAGIC   0x474C484D      // "MHLG"
+#define SEGMENT_VERSION 1
+#define SEGMENT_SLOTS   (MCP_FLASHLOG_SEGMENT_SIZE / MCP_FLASHLOG_RECORD_SIZE - 1)  // 去掉段头
+
+_Static_assert(sizeof(mcp_flashlog_page_t) == MCP_FLASHLOG_HEADER_SIZE, "page header layout");
+_Static_assert(SEGMENT_SLOTS <= UINT8_MAX, "slot count must fit in uint8_t");
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t seq;           // 日志中的段从 1 开始递增，0 为空闲段
+    uint32_t erase_count;
+    uint32_t crc;           // 前面字段的 CRC32
+} segment_header_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t erase_count;
+    int64_t first_ms;       // 空段为 INT64_MAX
+    int64_t last_ms;
+    uint8_t pages;          // 有效记录数
+    bool full;              // 写满或有损坏的记录，不再写入
+} segment_index_t;
+
+static struct {
+    const esp_partition_t *partition;
+    segment_index_t segments[MCP_FLASHLOG_MAX_SEGMENTS];
+    int count;              // 分区中的段数
+    int head;               // 最新段的位置，-1 表示日志为空
+    int used;               // 日志中的段数，位置为 head-used+1 .. head
+    uint8_t record[MCP_FLASHLOG_RECORD_SIZE];
+    mcp_flashlog_stats_t stats;
+    SemaphoreHandle_t lock;
+} g_flashlog = {
+    .head = -1,
+};
+
+static inline int segment_at(int k) {
+    return (g_flashlog.head - g_flashlog.used + 1 + k + g_flashlog.count) % g_flashlog.count;
+}
+
+static inline size_t slot_offset(int segment, int slot) {
+    return (size_t)segment * MCP_FLASHLOG_SEGMENT_SIZE + (size_t)slot * MCP_FLASHLOG_RECORD_SIZE;
+}
+
+static uint32_t page_crc(const mcp_flashlog_page_t *page, const uint8_t *payload) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)page, offsetof(mcp_flashlog_page_t, crc));
+    return esp_rom_crc32_le(crc, payload, (page->bits + 7) / 8);
+}
+
+static uint32_t header_crc(const segment_header_t *header) {
+    return esp_rom_crc32_le(0, (const uint8_t *)header, offsetof(segment_header_t, crc));
+}
+
+static esp_err_t write_header(int segment, uint32_t seq, uint32_t erase_count) {
+    segment_header_t header = {
+        .magic = SEGMENT_MAGIC,
+        .version = SEGMENT_VERSION,
+        .record_size = MCP_FLASHLOG_RECORD_SIZE,
+        .seq = seq,
+        .erase_count = erase_count,
+    };
+    header.crc = header_crc(&header);
+    esp_err_t ret = esp_partition_write(g_flashlog.partition, slot_offset(segment, 0), &header, sizeof(header));
+    if (ret == ESP_OK) {
+        g_flashlog.stats.flash_bytes_written += sizeof(header);
+    }
+    return ret;
+}
+
+static esp_err_t erase_segment(int segment, uint32_t seq) {
+    segment_index_t *index = &g_flashlog.segments[segment];
+    esp_err_t ret = esp_partition_erase_range(g_flashlog.partition, slot_offset(segment, 0), MCP_FLASHLOG_SEGMENT_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    g_flashlog.stats.flash_bytes_erased += MCP_FLASHLOG_SEGMENT_SIZE;
+
+    index->erase_count++;
+    index->seq = 0;
+    index->first_ms = INT64_MAX;
+    index->last_ms = INT64_MIN;
+    index->pages = 0;
+    index->full = false;
+    ret = write_header(segment, seq, index->erase_count);
+    if (ret == ESP_OK) {
+        index->seq = seq;
+    }
+    return ret;
+}
+
+// 扫描段内的记录，得到有效记录数和时间范围
+static void scan_segment(int segment) {
+    segment_index_t *index = &g_flashlog.segments[segment];
+    index->first_ms = INT64_MAX;
+    index->last_ms = INT64_MIN;
+    index->pages = 0;
+    index->full = true;
+
+    for (int slot = 1; slot <= SEGMENT_SLOTS; slot++) {
+        mcp_flashlog_page_t *page = (mcp_flashlog_page_t *)g_flashlog.record;
+        if (esp_partition_read(g_flashlog.partition, slot_offset(segment, slot), g_flashlog.record,
+                               MCP_FLASHLOG_RECORD_SIZE) != ESP_OK) {
+            return;
+        }
+
+        bool erased = true;
+        for (int i = 0; i < MCP_FLASHLOG_HEADER_SIZE && erased; i++) {
+            erased = g_flashlog.record[i] == 0xFF;
+        }
+        if (erased) {
+            index->full = false;
+            return;
+        }
+
+        // 写入中断的记录：该段后面的槽不再使用
+        if (!page->count || page->bits > MCP_FLASHLOG_PAYLOAD_SIZE * 8 || page->first_ms > page->last_ms ||
+            page->crc != page_crc(page, g_flashlog.record + MCP_FLASHLOG_HEADER_SIZE)) {
+            ESP_LOGW(TAG, "Segment %d: damaged record in slot %d", segment, slot);
+            return;
+        }
+
+        if (!index->pages) {
+            index->first_ms = page->first_ms;
+        }
+        index->last_ms = page->last_ms;
+        index->pages++;
+    }
+}
+
+int mcp_flashlog_init(void) {
+    if (g_flashlog.lock) {
+        return 0;
+    }
+
+    g_flashlog.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                    MCP_FLASHLOG_PARTITION_LABEL);
+    if (!g_flashlog.partition) {
+        ESP_LOGW(TAG, "No '%s' partition, history is not persisted", MCP_FLASHLOG_PARTITION_LABEL);
+        return -1;
+    }
+
+    int count = g_flashlog.partition->size / MCP_FLASHLOG_SEGMENT_SIZE;
+    g_flashlog.count = count < MCP_FLASHLOG_MAX_SEGMENTS ? count : MCP_FLASHLOG_MAX_SEGMENTS;
+    if (g_flashlog.count < 2) {
+        ESP_LOGE(TAG, "History partition too small");
+        g_flashlog.partition = NULL;
+        return -1;
+    }
+
+    g_flashlog.lock = xSemaphoreCreateMutex();
+    if (!g_flashlog.lock) {
+        ESP_LOGE(TAG, "Failed to create flash log lock");
+        g_flashlog.partition = NULL;
+        return -1;
+    }
+
+    // 读取段头，最新的段是序号最大的段
+    for (int i = 0; i < g_flashlog.count; i++) {
+        segment_index_t *index = &g_flashlog.segments[i];
+        segment_header_t header;
+        memset(index, 0, sizeof(*index));
+        index->first_ms = INT64_MAX;
+        index->last_ms = INT64_MIN;
+        if (esp_partition_read(g_flashlog.partition, slot_offset(i, 0), &header, sizeof(header)) != ESP_OK ||
+            header.magic != SEGMENT_MAGIC || header.version != SEGMENT_VERSION ||
+            header.record_size != MCP_FLASHLOG_RECORD_SIZE || header.crc != header_crc(&header)) {
+            index->full = true;
+            continue;
+        }
+
+        index->erase_count = header.erase_count;
+        index->seq = header.seq;
+        if (index->seq) {
+            scan_segment(i);
+            if (g_flashlog.head < 0 || index->seq > g_flashlog.segments[g_flashlog.head].seq) {
+                g_flashlog.head = i;
+            }
+        }
+    }
+
+    // 日志是从最新段向前序号连续的段
+    if (g_flashlog.head >= 0) {
+        uint32_t head_seq = g_flashlog.segments[g_flashlog.head].seq;
+        g_flashlog.used = 1;
+        while (g_flashlog.used < g_flashlog.count && g_flashlog.used < head_seq &&
+               g_flashlog.segments[segment_at(-1)].seq == head_seq - g_flashlog.used) {
+            g_flashlog.used++;
+        }
+    }
+
+    mcp_flashlog_stats_t stats;
+    mcp_flashlog_get_stats(&stats);
+    ESP_LOGI(TAG, "Flash log: %d segments, %lu in use, %lu pages, erase count %lu-%lu",
+             g_flashlog.count, (unsigned long)stats.segments_used, (unsigned long)stats.pages,
+             (unsigned long)stats.erase_count_min, (unsigned long)stats.erase_count_max);
+    return 0;
+}
+
+int mcp_flashlog_append(const mcp_flashlog_page_t *page, const uint8_t *payload) {
+    if (!g_flashlog.lock || !page || !payload || !page->count || page->bits > MCP_FLASHLOG_PAYLOAD_SIZE * 8) {
+        return -1;
+    }
+
+    xSemaphoreTake(g_flashlog.lock, portMAX_DELAY);
+    segment_index_t *head = g_flashlog.head >= 0 ? &g_flashlog.segments[g_flashlog.head] : NULL;
+    if (!head || head->full) {
+        // 轮换到下一个段，日志已满时它就是最早的段
+        int next = head ? (g_flashlog.head + 1) % g_flashlog.count : 0;
+        uint32_t seq = head ? head->seq + 1 : 1;
+        esp_err_t ret = erase_segment(next, seq);
+        if (ret != ESP_OK) {
+            xSemaphoreGive(g_flashlog.lock);
+            ESP_LOGE(TAG, "Failed to open segment %d: %s", next, esp_err_to_name(ret));
+            return -1;
+        }
+        if (g_flashlog.used < g_flashlog.count) {
+            g_flashlog.used++;
+        }
+        g_flashlog.head = next;
+        head = &g_flashlog.segments[next];
+    }
+
+    size_t payload_len = (page->bits + 7) / 8;
+    mcp_flashlog_page_t *record = (mcp_flashlog_page_t *)g_flashlog.record;
+    *record = *page;
+    record->crc = page_crc(page, payload);
+    memcpy(g_flashlog.record + MCP_FLASHLOG_HEADER_SIZE, payload, payload_len);
+
+    int slot = head->pages + 1;
+    esp_err_t ret = esp_partition_write(g_flashlog.partition, slot_offset(g_flashlog.head, slot), g_flashlog.record,
+                                        MCP_FLASHLOG_HEADER_SIZE + payload_len);
+    if (ret != ESP_OK) {
+        // 该槽的内容不确定，段内不再写入
+        head->full = true;
+        xSemaphoreGive(g_flashlog.lock);
+        ESP_LOGE(TAG, "Failed to write record: %s", esp_err_to_name(ret));
+        return -1;
+    }
+
+    if (!head->pages) {
+        head->first_ms = page->first_ms;
+    }
+    head->last_ms = page->last_ms;
+    head->pages++;
+    head->full = head->pages == SEGMENT_SLOTS;
+    g_flashlog.stats.pages_written++;
+    g_flashlog.stats.payload_bytes += payload_len;
+    g_flashlog.stats.flash_bytes_written += MCP_FLASHLOG_HEADER_SIZE + payload_len;
+    xSemaphoreGive(g_flashlog.lock);
+    return 0;
+}
+
+int mcp_flashlog_read(int64_t from_ms, int64_t to_ms, bool headers_only, mcp_flashlog_visit_t visit, void *ctx) {
+    if (!g_flashlog.lock || !visit) {
+        return -1;
+    }
+
+    xSemaphoreTake(g_flashlog.lock, portMAX_DELAY);
+    // 最后一个起始时间早于 from_ms 的段，空段（只可能是最新段）的起始时间为 INT64_MAX
+    int lo = 0;
+    int hi = g_flashlog.used - 1;
+    int start = 0;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (g_flashlog.segments[segment_at(mid)].first_ms < from_ms) {
+            start = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    int visited = 0;
+    for (int k = start; k < g_flashlog.used; k++) {
+        int segment = segment_at(k);
+        const segment_index_t *index = &g_flashlog.segments[segment];
+        if (!index->pages || index->last_ms < from_ms) {
+            continue;
+        }
+        if (index->first_ms > to_ms) {
+            break;
+        }
+
+        for (int slot = 1; slot <= index->pages; slot++) {
+            mcp_flashlog_page_t page;
+            size_t offset = slot_offset(segment, slot);
+            if (esp_partition_read(g_flashlog.partition, offset, &page, sizeof(page)) != ESP_OK) {
+                goto done;
+            }
+            g_flashlog.stats.flash_bytes_read += sizeof(page);
+            if (page.last_ms < from_ms) {
+                continue;
+            }
+            if (page.first_ms > to_ms) {
+                goto done;
+            }
+
+            const uint8_t *payload = NULL;
+            if (!headers_only) {
+                size_t payload_len = (page.bits + 7) / 8;
+                if (esp_partition_read(g_flashlog.partition, offset + sizeof(page), g_flashlog.record,
+                                       payload_len) != ESP_OK) {
+                    goto done;
+                }
+                g_flashlog.stats.flash_bytes_read += payload_len;
+                payload = g_flashlog.record;
+            }
+            visited++;
+            if (!visit(&page, payload, ctx)) {
+                goto done;
+            }
+        }
+    }
+
+done:
+    xSemaphoreGive(g_flashlog.lock);
+    return visited;
+}
+
+int mcp_flashlog_erase_all(void) {
+    if (!g_flashlog.lock) {
+        return -1;
+    }
+
+    int ret = 0;
+    xSemaphoreTake(g_flashlog.lock, portMAX_DELAY);
+    for (int k = 0; k < g_flashlog.used; k++) {
+        int segment = segment_at(k);
+        if (erase_segment(segment, 0) != ESP_OK) {
+            g_flashlog.segments[segment].full = true;
+            ret = -1;
+        }
+    }
+    g_flashlog.head = -1;
+    g_flashlog.used = 0;
+    xSemaphoreGive(g_flashlog.lock);
+
+    ESP_LOGI(TAG, "Flash log erased");
+    return ret;
+}
+
+void mcp_flashlog_get_stats(mcp_flashlog_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    if (!g_flashlog.lock) {
+        return;
+    }
+
+    xSemaphoreTake(g_flashlog.lock, portMAX_DELAY);
+    *stats = g_flashlog.stats;
+    stats->segments = g_flashlog.count;
+    stats->segments_used = g_flashlog.used;
+    stats->pages = 0;
+    stats->oldest_ms = 0;
+    stats->newest_ms = 0;
+    for (int k = 0; k < g_flashlog.used; k++) {
+        const segment_index_t *index = &g_flashlog.segments[segment_at(k)];
+        if (index->pages) {
+            if (!stats->pages) {
+                stats->oldest_ms = index->first_ms;
+            }
+            stats->newest_ms = index->last_ms;
+            stats->pages += index->pages;
+        }
+    }
+    stats->erase_count_min = UINT32_MAX;
+    for (int i = 0; i < g_flashlog.count; i++) {
+        uint32_t erase_count = g_flashlog.segments[i].erase_count;
+        stats->erase_count_min = erase_count < stats->erase_count_min ? erase_count : stats->erase_count_min;
+        stats->erase_count_max = erase_count > stats->erase_count_max ? erase_count : stats->erase_count_max;
+    }
+    xSemaphoreGive(g_flashlog.lock);
+}
@@ -0,0 +1,98 @@
+#ifndef _MCP_FLASHLOG_H_
+#define _MCP_FLASHLOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Flash 时间序列日志配置
+#define MCP_FLASHLOG_PARTITION_LABEL    "history"
+#define MCP_FLASHLOG_SEGMENT_SIZE       4096    // 段 = 一个擦除扇区
+#define MCP_FLASHLOG_RECORD_SIZE        256     // 每次写入一条记录（页头 + 数据）
+#define MCP_FLASHLOG_HEADER_SIZE        24      // sizeof(mcp_flashlog_page_t)
+#define MCP_FLASHLOG_PAYLOAD_SIZE       (MCP_FLASHLOG_RECORD_SIZE - MCP_FLASHLOG_HEADER_SIZE)
+#define MCP_FLASHLOG_MAX_SEGMENTS       128     // 索引容量，分区更大时只使用前面的段
+
+/**
+ * @brief 页头，每条记录的开头
+ */
+typedef struct {
+    int64_t first_ms;       ///< 页内第一个样本时间
+    int64_t last_ms;        ///< 页内最后一个样本时间
+    uint16_t count;         ///< 样本数
+    uint16_t bits;          ///< 数据的有效位数
+    uint32_t crc;           ///< 页头前 20 字节和数据的 CRC32
+} mcp_flashlog_page_t;
+
+/**
+ * @brief 日志统计
+ */
+typedef struct {
+    uint32_t segments;              ///< 分区中的段数
+    uint32_t segments_used;
+    uint32_t pages;                 ///< 当前保存的页数
+    uint32_t pages_written;         ///< 本次启动写入的页数
+    uint32_t payload_bytes;         ///< 本次启动写入的压缩数据字节数
+    uint32_t flash_bytes_written;   ///< 本次启动实际写入 flash 的字节数（含页头和段头）
+    uint32_t flash_bytes_erased;    ///< 本次启动擦除的字节数
+    uint32_t flash_bytes_read;      ///< 本次启动查询读取的字节数
+    uint32_t erase_count_min;       ///< 各段擦除次数的最小值
+    uint32_t erase_count_max;
+    int64_t oldest_ms;              ///< 最早样本时间，没有数据时为 0
+    int64_t newest_ms;              ///< 最新样本时间，没有数据时为 0
+} mcp_flashlog_stats_t;
+
+/**
+ * @brief 遍历回调
+ * @param page 页头
+ * @param payload 压缩数据，只遍历页头时为 NULL
+ * @param ctx 用户参数
+ * @return true 继续，false 停止遍历
+ */
+typedef bool (*mcp_flashlog_visit_t)(const mcp_flashlog_page_t *page, const uint8_t *payload, void *ctx);
+
+/**
+ * @brief 打开 history 分区并从段头和页头重建时间索引
+ * @return 0 on success, -1 if the partition is missing
+ */
+int mcp_flashlog_init(void);
+
+/**
+ * @brief 追加一页，当前段写满时轮换到下一个段（擦除最早的段）
+ * @param page 页头，crc 由日志计算
+ * @param payload 数据，长度为 (page->bits + 7) / 8，不超过 MCP_FLASHLOG_PAYLOAD_SIZE
+ * @return 0 on success, -1 on failure
+ */
+int mcp_flashlog_append(const mcp_flashlog_page_t *page, const uint8_t *payload);
+
+/**
+ * @brief 按时间顺序遍历与 [from_ms, to_ms] 重叠的页，通过段索引只读取相关的段
+ * @param from_ms 起始时间
+ * @param to_ms 结束时间
+ * @param headers_only true 时只读取页头
+ * @param visit 回调，在日志锁内调用
+ * @param ctx 用户参数
+ * @return 遍历的页数，日志不可用时为 -1
+ */
+int mcp_flashlog_read(int64_t from_ms, int64_t to_ms, bool headers_only, mcp_flashlog_visit_t visit, void *ctx);
+
+/**
+ * @brief 擦除全部日志（保留各段的擦除计数）
+ * @return 0 on success, -1 on failure
+ */
+int mcp_flashlog_erase_all(void);
+
+/**
+ * @brief 获取日志统计
+ * @param stats 输出
+ */
+void mcp_flashlog_get_stats(mcp_flashlog_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_FLASHLOG_H_ */
@@ -0,0 +1,995 @@
+/**
+ * @file mcp_history.c
+ * @brief 传感器历史 - 压缩的原始样本环形缓冲区和分钟/小时汇总层
+ *
+ * 原始样本以位流压缩存放在固定大小的块中（Gorilla 风格）：
+ *   - 时间：块首样本的时间记录在块索引中，之后每个样本编码时间差的差 (delta-of-delta)；
+ *     固定间隔采样时每个样本只占 1 位
+ *   - 数值：0.01 定点值与前一个样本的差，zigzag 后用变长前缀码编码，不变时占 1 位
+ * 块写满后换块，缓冲区满时整块淘汰最早的样本。查询先对块的起始时间二分查找，
+ * 再在块内顺序流式解码，不需要解压整块。
+ *
+ * 汇总层是按桶编号 (时间/周期) 寻址的环，每个样本只更新当前桶的最小/最大/平均值，
+ * 跳过的桶在前进时清空。
+ *
+ * 写满的块整页追加到 flash 日志 (mcp_flashlog)。启动时用日志中的页恢复汇总层，
+ * 内存中的原始层不覆盖查询起点时改为从日志流式解码，还没写入日志的样本从内存补齐。
+ * 内部时间是累计运行时间，等于启动后的时间加上 offset_ms（上次运行最后一个样本之后）。
+ */
+
+#include "mcp_history.h"
+#include "mcp_flashlog.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "mcp_history";
+
+#define SENSOR_COUNT 2      // 温度、湿度
+#define PAGE_BITS (MCP_HISTORY_PAGE_SIZE * 8)
+#define MAX_SAMPLE_BITS (4 + 32 + SENSOR_COUNT * (4 + 17))  // 单个样本的最大编码长度
+
+_Static_assert(PAGE_BITS <= UINT16_MAX, "page bit offset must fit in uint16_t");
+_Static_assert(MCP_HISTORY_PAGE_SIZE <= MCP_FLASHLOG_PAYLOAD_SIZE, "a page must fit in one flash log record");
+
+typedef struct {
+    int64_t base_ms;        // 块首样本时间
+    uint16_t count;
+    uint16_t bits;          // 已写入的位数
+} history_block_t;
+
+// 编解码的运行状态：最近一个样本
+typedef struct {
+    int64_t time_ms;
+    int32_t delta_ms;
+    int16_t value[SENSOR_COUNT];
+} history_codec_t;
+
+// 流式解码位置：k 为从最早块开始的逻辑块号，state 为最近解码的样本
+typedef struct {
+    int k;
+    uint16_t index;         // 块内下一个要解码的样本
+    uint32_t bit;
+    history_codec_t state;
+} history_iter_t;
+
+typedef struct {
+    uint16_t count;         // 0 为空桶
+    int16_t min[SENSOR_COUNT];
+    int16_t max[SENSOR_COUNT];
+    int16_t avg[SENSOR_COUNT];
+} history_bucket_t;
+
+typedef struct {
+    history_bucket_t *buckets;
+    uint32_t capacity;
+    uint32_t period_ms;
+    uint32_t head_id;               // 最新桶编号
+    uint32_t filled;                // 有效桶数（含空桶），编号为 (head_id - filled, head_id]
+    int32_t sum[SENSOR_COUNT];      // 最新桶的累加值
+} history_tier_t;
+
+// 查询输出的合并累加器
+typedef struct {
+    int64_t time_ms;
+    uint32_t count;
+    int16_t min[SENSOR_COUNT];
+    int16_t max[SENSOR_COUNT];
+    int64_t sum[SENSOR_COUNT];
+} history_acc_t;
+
+// flash 层查询：两遍遍历日志，第一遍只读页头估计样本数
+typedef struct {
+    int64_t from_ms;
+    int64_t to_ms;
+    int64_t last_ms;        // 第一遍为最后访问的页的结束时间，第二遍为最后解码的样本时间
+    uint32_t in_range;      // 范围内的样本数，第一遍为估计值
+    uint32_t stride;
+    history_acc_t acc;
+    mcp_history_sample_t *out;
+    int max;
+    int written;
+} history_flash_query_t;
+
+static const char *const g_tier_names[MCP_HISTORY_TIER_COUNT] = {
+    [MCP_HISTORY_TIER_RAW] = "raw",
+    [MCP_HISTORY_TIER_FLASH] = "flash",
+    [MCP_HISTORY_TIER_MINUTE] = "1m",
+    [MCP_HISTORY_TIER_HOUR] = "1h",
+};
+
+static history_bucket_t g_minute_buckets[MCP_HISTORY_MINUTE_BUCKETS];
+static history_bucket_t g_hour_buckets[MCP_HISTORY_HOUR_BUCKETS];
+
+// 时间差的差和数值差的前缀码宽度：0 表示 0，10/110/1110/1111 依次选择下面的宽度
+static const uint8_t g_time_widths[4] = {7, 12, 17, 32};
+static const uint8_t g_value_widths[4] = {4, 7, 10, 17};
+
+static struct {
+    uint8_t pages[MCP_HISTORY_PAGES][MCP_HISTORY_PAGE_SIZE];
+    history_block_t blocks[MCP_HISTORY_PAGES];
+    history_codec_t encoder;                        // 正在写入的块的编码状态
+    history_tier_t tiers[MCP_HISTORY_TIER_COUNT];   // 原始层不使用
+    int head;               // 正在写入的物理块
+    int used;               // 有数据的块数
+    uint32_t count;
+    uint32_t encoded_bits;
+    uint32_t appended;
+    int64_t first_ms;       // 第一个样本的时间（含 flash 日志）
+    int64_t last_ms;
+    int64_t offset_ms;      // 启动后的时间到内部时间的偏移
+    bool has_data;
+    mcp_flashlog_page_t flush;                      // 待写入 flash 的块，只在追加样本的任务中使用
+    uint8_t flush_page[MCP_HISTORY_PAGE_SIZE];
+    SemaphoreHandle_t lock;
+} g_history = {
+    .tiers = {
+        [MCP_HISTORY_TIER_MINUTE] = {g_minute_buckets, MCP_HISTORY_MINUTE_BUCKETS, 60000},
+        [MCP_HISTORY_TIER_HOUR] = {g_hour_buckets, MCP_HISTORY_HOUR_BUCKETS, 3600000},
+    },
+};
+
+// 导出：合并 downsample 个样本为一个条目，分批解码后在锁外回调
+typedef struct {
+    uint32_t downsample;
+    history_acc_t acc;
+    mcp_history_visit_t visit;
+    void *ctx;
+    int visited;
+    bool stopped;
+} history_export_t;
+
+static struct {
+    mcp_flashlog_page_t page;
+    uint8_t payload[MCP_HISTORY_PAGE_SIZE];
+    bool found;
+    history_codec_t samples[MCP_HISTORY_EXPORT_BATCH];
+} g_export;
+
+static int16_t encode_value(float value) {
+    float scaled = roundf(value * MCP_HISTORY_VALUE_SCALE);
+    if (!(scaled > INT16_MIN)) {
+        return INT16_MIN;
+    }
+    return scaled < INT16_MAX ? (int16_t)scaled : INT16_MAX;
+}
+
+static inline float decode_value(int16_t value) {
+    return (float)value / MCP_HISTORY_VALUE_SCALE;
+}
+
+static inline int physical_block(int k) {
+    return (g_history.head - g_history.used + 1 + k + MCP_HISTORY_PAGES) % MCP_HISTORY_PAGES;
+}
+
+static inline uint32_t zigzag(int64_t value) {
+    return (uint32_t)((value << 1) ^ (value >> 63));
+}
+
+static inline int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// 高位在前写入 n 位，页在开始写入前已清零
+static void put_bits(uint8_t *page, uint16_t *bit, uint32_t value, int n) {
+    for (int i = n - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            page[*bit >> 3] |= 0x80 >> (*bit & 7);
+        }
+        (*bit)++;
+    }
+}
+
+static uint32_t get_bits(const uint8_t *page, uint32_t *bit, int n) {
+    uint32_t value = 0;
+    for (int i = 0; i < n; i++) {
+        value = (value << 1) | ((page[*bit >> 3] >> (7 - (*bit & 7))) & 1);
+        (*bit)++;
+    }
+    return value;
+}
+
+static void put_code(uint8_t *page, uint16_t *bit, uint32_t value, const uint8_t widths[4]) {
+    if (value == 0) {
+        put_bits(page, bit, 0, 1);
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (i == 3 || value < (1u << widths[i])) {
+            // i+1 个 1 加一个 0，最后一档是四个 1
+            if (i < 3) {
+                put_bits(page, bit, (1u << (i + 2)) - 2, i + 2);
+            } else {
+                put_bits(page, bit, 0xF, 4);
+            }
+            put_bits(page, bit, value, widths[i]);
+            return;
+        }
+    }
+}
+
+static uint32_t get_code(const uint8_t *page, uint32_t *bit, const uint8_t widths[4]) {
+    int ones = 0;
+    while (ones < 4 && get_bits(page, bit, 1)) {
+        ones++;
+    }
+    return ones ? get_bits(page, bit, widths[ones - 1]) : 0;
+}
+
+// 开始一个新块，编码状态从 0 开始
+static void block_start(history_block_t *block, uint8_t *page, history_codec_t *enc, int64_t time_ms) {
+    memset(page, 0, MCP_HISTORY_PAGE_SIZE);
+    block->base_ms = time_ms;
+    block->count = 0;
+    block->bits = 0;
+    memset(enc, 0, sizeof(*enc));
+    enc->time_ms = time_ms;
+}
+
+// 把样本编码到块末尾，块已满或时间差超出范围时返回 false
+static bool block_append(history_block_t *block, uint8_t *page, history_codec_t *enc,
+                         int64_t time_ms, const int16_t value[SENSOR_COUNT]) {
+    int64_t delta = time_ms - enc->time_ms;
+    if (block->count == UINT16_MAX || block->bits + MAX_SAMPLE_BITS > PAGE_BITS || delta > INT32_MAX) {
+        return false;
+    }
+
+    if (block->count) {
+        put_code(page, &block->bits, zigzag(delta - enc->delta_ms), g_time_widths);
+        enc->delta_ms = (int32_t)delta;
+        enc->time_ms = time_ms;
+    }
+    for (int s = 0; s < SENSOR_COUNT; s++) {
+        put_code(page, &block->bits, zigzag((int32_t)value[s] - enc->value[s]), g_value_widths);
+        enc->value[s] = value[s];
+    }
+    block->count++;
+    return true;
+}
+
+// 顺序解码块内第 index 个样本，dec 保存上一个样本
+static void block_decode(const history_block_t *block, const uint8_t *page, uint32_t *bit, uint16_t index,
+                         history_codec_t *dec) {
+    if (index == 0) {
+        memset(dec, 0, sizeof(*dec));
+        dec->time_ms = block->base_ms;
+    } else {
+        dec->delta_ms += unzigzag(get_code(page, bit, g_time_widths));
+        dec->time_ms += dec->delta_ms;
+    }
+    for (int s = 0; s < SENSOR_COUNT; s++) {
+        dec->value[s] = (int16_t)(dec->value[s] + unzigzag(get_code(page, bit, g_value_widths)));
+    }
+}
+
+static inline void iter_start(history_iter_t *it, int k) {
+    memset(it, 0, sizeof(*it));
+    it->k = k;
+}
+
+// 解码下一个样本到 it->state，没有更多样本时 it->k 为 used 并返回 false，调用者持有锁
+static bool iter_next(history_iter_t *it) {
+    while (it->k < g_history.used) {
+        int p = physical_block(it->k);
+        if (it->index < g_history.blocks[p].count) {
+            block_decode(&g_history.blocks[p], g_history.pages[p], &it->bit, it->index, &it->state);
+            it->index++;
+            return true;
+        }
+        it->k++;
+        it->index = 0;
+        it->bit = 0;
+    }
+    return false;
+}
+
+// 定位到第一个时间不早于 time_ms 的样本，it->state 为该样本；全部更早时 it->k 为 used，调用者持有锁
+// 找最后一个起始时间早于 time_ms 的块，目标样本在该块内或是下一块的首样本
+static void locate(history_iter_t *it, int64_t time_ms) {
+    int lo = 0;
+    int hi = g_history.used - 1;
+    int found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (g_history.blocks[physical_block(mid)].base_ms < time_ms) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    iter_start(it, found < 0 ? 0 : found);
+    while (iter_next(it) && it->state.time_ms < time_ms) {
+    }
+}
+
+// 定位结果对应的样本序号（块内），越过末尾时为 0
+static inline int iter_offset(const history_iter_t *it) {
+    return it->k < g_history.used ? it->index - 1 : 0;
+}
+
+static void tier_append(history_tier_t *tier, int64_t time_ms, const int16_t value[SENSOR_COUNT]) {
+    uint32_t id = (uint32_t)(time_ms / tier->period_ms);
+    if (!tier->filled || id != tier->head_id) {
+        // 前进到新桶，清空跳过的桶（最多一整圈）
+        uint32_t steps = tier->filled ? id - tier->head_id : 1;
+        uint32_t clear = steps < tier->capacity ? steps : tier->capacity;
+        for (uint32_t i = 0; i < clear; i++) {
+            tier->buckets[(id - i) % tier->capacity].count = 0;
+        }
+        tier->filled = steps < tier->capacity - tier->filled ? tier->filled + steps : tier->capacity;
+        tier->head_id = id;
+        memset(tier->sum, 0, sizeof(tier->sum));
+    }
+
+    history_bucket_t *bucket = &tier->buckets[id % tier->capacity];
+    if (bucket->count == UINT16_MAX) {
+        return;
+    }
+    bucket->count++;
+    for (int s = 0; s < SENSOR_COUNT; s++) {
+        tier->sum[s] += value[s];
+        if (bucket->count == 1 || value[s] < bucket->min[s]) {
+            bucket->min[s] = value[s];
+        }
+        if (bucket->count == 1 || value[s] > bucket->max[s]) {
+            bucket->max[s] = value[s];
+        }
+        int32_t half = bucket->count / 2;
+        bucket->avg[s] = (tier->sum[s] + (tier->sum[s] >= 0 ? half : -half)) / bucket->count;
+    }
+}
+
+static void acc_add(history_acc_t *acc, int64_t time_ms, uint32_t count, const int16_t min[SENSOR_COUNT],
+                    const int16_t max[SENSOR_COUNT], const int16_t avg[SENSOR_COUNT]) {
+    for (int s = 0; s < SENSOR_COUNT; s++) {
+        if (!acc->count || min[s] < acc->min[s]) {
+            acc->min[s] = min[s];
+        }
+        if (!acc->count || max[s] > acc->max[s]) {
+            acc->max[s] = max[s];
+        }
+        acc->sum[s] += (int64_t)avg[s] * count;
+    }
+    if (!acc->count) {
+        acc->time_ms = time_ms;
+    }
+    acc->count += count;
+}
+
+// 输出一个合并后的条目并清空累加器，空累加器不输出
+static int acc_emit(history_acc_t *acc, mcp_history_sample_t *out) {
+    if (!acc->count) {
+        return 0;
+    }
+
+    out->time_ms = acc->time_ms;
+    out->count = acc->count;
+    out->temperature = (float)acc->sum[0] / acc->count / MCP_HISTORY_VALUE_SCALE;
+    out->temperature_min = decode_value(acc->min[0]);
+    out->temperature_max = decode_value(acc->max[0]);
+    out->humidity = (float)acc->sum[1] / acc->count / MCP_HISTORY_VALUE_SCALE;
+    out->humidity_min = decode_value(acc->min[1]);
+    out->humidity_max = decode_value(acc->max[1]);
+    memset(acc, 0, sizeof(*acc));
+    return 1;
+}
+
+static int64_t tier_oldest_ms(mcp_history_tier_t tier) {
+    if (tier == MCP_HISTORY_TIER_RAW) {
+        return g_history.used ? g_history.blocks[physical_block(0)].base_ms : INT64_MAX;
+    }
+    if (tier == MCP_HISTORY_TIER_FLASH) {
+        mcp_flashlog_stats_t flash;
+        mcp_flashlog_get_stats(&flash);
+        return flash.pages ? flash.oldest_ms : INT64_MAX;
+    }
+    const history_tier_t *t = &g_history.tiers[tier];
+    return (int64_t)(t->head_id - t->filled + 1) * t->period_ms;
+}
+
+// 满足分辨率且覆盖起点的最粗的层，同样粗细时优先内存中的层；没有时优先覆盖范围，调用者持有锁
+static mcp_history_tier_t select_tier(int64_t from_ms, uint32_t resolution_ms) {
+    int64_t start = from_ms > g_history.first_ms ? from_ms : g_history.first_ms;
+    int best = -1;
+    int covering = -1;
+    for (int t = 0; t < MCP_HISTORY_TIER_COUNT; t++) {
+        if (tier_oldest_ms(t) > start) {
+            continue;
+        }
+        if (covering < 0) {
+            covering = t;
+        }
+        uint32_t period_ms = g_history.tiers[t].period_ms;
+        if (period_ms <= resolution_ms && (best < 0 || period_ms > g_history.tiers[best].period_ms)) {
+            best = t;
+        }
+    }
+    if (best >= 0) {
+        return best;
+    }
+    return covering >= 0 ? covering : MCP_HISTORY_TIER_HOUR;
+}
+
+// 定位到 [from_ms, to_ms] 内的第一个样本，返回范围内的样本数，调用者持有锁
+static uint32_t raw_range(int64_t from_ms, int64_t to_ms, history_iter_t *it) {
+    history_iter_t end;
+    locate(it, from_ms);
+    if (from_ms > to_ms) {
+        return 0;
+    }
+    if (to_ms < INT64_MAX) {
+        locate(&end, to_ms + 1);
+    } else {
+        iter_start(&end, g_history.used);
+    }
+
+    // 范围内样本数由块计数直接得出，不需要解码
+    uint32_t in_range = 0;
+    for (int k = it->k; k < end.k; k++) {
+        in_range += g_history.blocks[physical_block(k)].count;
+    }
+    return in_range - iter_offset(it) + iter_offset(&end);
+}
+
+static int query_raw(int64_t from_ms, int64_t to_ms, mcp_history_sample_t *out, int max, uint32_t *total) {
+    history_iter_t it;
+    uint32_t in_range = raw_range(from_ms, to_ms, &it);
+    *total = in_range;
+
+    uint32_t stride = in_range > (uint32_t)max ? (in_range + max - 1) / max : 1;
+    history_acc_t acc = {0};
+    int written = 0;
+    for (uint32_t i = 0; i < in_range; i++) {
+        const int16_t *value = it.state.value;
+        acc_add(&acc, it.state.time_ms, 1, value, value, value);
+        if ((i + 1) % stride == 0 || i + 1 == in_range) {
+            written += acc_emit(&acc, &out[written]);
+        }
+        iter_next(&it);
+    }
+    return written;
+}
+
+static int query_tier(const history_tier_t *tier, int64_t from_ms, int64_t to_ms,
+                      mcp_history_sample_t *out, int max, uint32_t *total) {
+    uint32_t oldest = tier->head_id - tier->filled + 1;
+    uint32_t lo = from_ms > (int64_t)oldest * tier->period_ms ? (uint32_t)(from_ms / tier->period_ms) : oldest;
+    uint32_t hi = to_ms < (int64_t)tier->head_id * tier->period_ms ? (uint32_t)(to_ms / tier->period_ms) : tier->head_id;
+    if (to_ms < 0 || lo > hi) {
+        return 0;
+    }
+
+    uint32_t span = hi - lo + 1;
+    uint32_t stride = span > (uint32_t)max ? (span + max - 1) / max : 1;
+    history_acc_t acc = {0};
+    int written = 0;
+    for (uint32_t id = lo; id <= hi; id++) {
+        const history_bucket_t *bucket = &tier->buckets[id % tier->capacity];
+        if (bucket->count) {
+            acc_add(&acc, (int64_t)id * tier->period_ms, bucket->count, bucket->min, bucket->max, bucket->avg);
+            (*total)++;
+        }
+        if ((id - lo + 1) % stride == 0 || id == hi) {
+            written += acc_emit(&acc, &out[written]);
+        }
+    }
+    return written;
+}
+
+static void flash_query_add(history_flash_query_t *q, int64_t time_ms, const int16_t value[SENSOR_COUNT]) {
+    acc_add(&q->acc, time_ms, 1, value, value, value);
+    q->in_range++;
+    if (q->in_range % q->stride == 0 && q->written < q->max) {
+        q->written += acc_emit(&q->acc, &q->out[q->written]);
+    }
+}
+
+// 部分重叠的页按时间比例估计，多计一个样本，估计值不少于实际值
+static bool flash_count_page(const mcp_flashlog_page_t *page, const uint8_t *payload, void *ctx) {
+    history_flash_query_t *q = ctx;
+    int64_t start = page->first_ms > q->from_ms ? page->first_ms : q->from_ms;
+    int64_t stop = page->last_ms < q->to_ms ? page->last_ms : q->to_ms;
+    uint32_t count = page->count;
+    if (stop - start < page->last_ms - page->first_ms) {
+        uint32_t part = (uint32_t)(((double)(stop - start) * (page->count - 1)) / (page->last_ms - page->first_ms)) + 2;
+        count = part < count ? part : count;
+    }
+    q->in_range += count;
+    q->last_ms = page->last_ms;
+    return true;
+}
+
+static bool flash_decode_page(const mcp_flashlog_page_t *page, const uint8_t *payload, void *ctx) {
+    history_flash_query_t *q = ctx;
+    const history_block_t block = {.base_ms = page->first_ms, .count = page->count, .bits = page->bits};
+    history_codec_t dec;
+    uint32_t bit = 0;
+    for (uint16_t index = 0; index < block.count; index++) {
+        block_decode(&block, payload, &bit, index, &dec);
+        if (dec.time_ms > q->to_ms) {
+            return false;
+        }
+        if (dec.time_ms >= q->from_ms) {
+            flash_query_add(q, dec.time_ms, dec.value);
+        }
+        q->last_ms = dec.time_ms;
+    }
+    return true;
+}
+
+// 从 flash 日志查询，日志之后的样本从内存中的原始层补齐；日志读取时不持有历史锁
+static int query_flash(int64_t from_ms, int64_t to_ms, mcp_history_sample_t *out, int max, uint32_t *total) {
+    history_flash_query_t q = {
+        .from_ms = from_ms,
+        .to_ms = to_ms,
+        .last_ms = INT64_MIN,
+        .out = out,
+        .max = max,
+    };
+    history_iter_t it;
+
+    mcp_flashlog_read(from_ms, to_ms, true, flash_count_page, &q);
+    int64_t tail_ms = q.last_ms + 1 > from_ms ? q.last_ms + 1 : from_ms;
+    xSemaphoreTake(g_history.lock, portMAX_DELAY);
+    uint32_t estimate = q.in_range + raw_range(tail_ms, to_ms, &it);
+    xSemaphoreGive(g_history.lock);
+
+    q.stride = estimate > (uint32_t)max ? (estimate + max - 1) / max : 1;
+    q.in_range = 0;
+    q.last_ms = INT64_MIN;
+    mcp_flashlog_read(from_ms, to_ms, false, flash_decode_page, &q);
+
+    tail_ms = q.last_ms + 1 > from_ms ? q.last_ms + 1 : from_ms;
+    xSemaphoreTake(g_history.lock, portMAX_DELAY);
+    for (uint32_t n = raw_range(tail_ms, to_ms, &it); n > 0; n--) {
+        flash_query_add(&q, it.state.time_ms, it.state.value);
+        iter_next(&it);
+    }
+    xSemaphoreGive(g_history.lock);
+
+    if (q.written < max) {
+        q.written += acc_emit(&q.acc, &out[q.written]);
+    }
+    *total = q.in_range;
+    return q.written;
+}
+
+// 用 flash 日志中的页恢复汇总层，初始化时没有其他任务访问历史
+static bool replay_page(const mcp_flashlog_page_t *page, const uint8_t *payload, void *ctx) {
+    const history_block_t block = {.base_ms = page->first_ms, .count = page->count, .bits = page->bits};
+    history_codec_t dec;
+    uint32_t bit = 0;
+    for (uint16_t index = 0; index < block.count; index++) {
+        block_decode(&block, payload, &bit, index, &dec);
+        if (g_history.has_data && dec.time_ms < g_history.last_ms) {
+            continue;
+        }
+        if (!g_history.has_data) {
+            g_history.first_ms = dec.time_ms;
+            g_history.has_data = true;
+        }
+        g_history.last_ms = dec.time_ms;
+        for (int t = MCP_HISTORY_TIER_MINUTE; t < MCP_HISTORY_TIER_COUNT; t++) {
+            tier_append(&g_history.tiers[t], dec.time_ms, dec.value);
+        }
+    }
+    return true;
+}
+
+static inline int64_t to_internal_ms(int64_t time_ms) {
+    return time_ms > INT64_MAX - g_history.offset_ms ? INT64_MAX : time_ms + g_history.offset_ms;
+}
+
+int mcp_history_init(void) {
+    if (g_history.lock) {
+        return 0;
+    }
+
+    g_history.lock = xSemaphoreCreateMutex();
+    if (!g_history.lock) {
+        ESP_LOGE(TAG, "Failed to create history lock");
+        return -1;
+    }
+
+    if (mcp_flashlog_init() == 0) {
+        int pages = mcp_flashlog_read(INT64_MIN, INT64_MAX, false, replay_page, NULL);
+        if (g_history.has_data) {
+            g_history.offset_ms = g_history.last_ms + 1;
+            ESP_LOGI(TAG, "Restored %d pages from flash, %lld s of history",
+                     pages, (long long)((g_history.last_ms - g_history.first_ms) / 1000));
+        }
+    }
+
+    ESP_LOGI(TAG, "Sensor history: %d compressed pages, %d minute and %d hour buckets, %u bytes",
+             MCP_HISTORY_PAGES, MCP_HISTORY_MINUTE_BUCKETS, MCP_HISTORY_HOUR_BUCKETS,
+             (unsigned)(sizeof(g_history.pages) + sizeof(g_history.blocks) +
+                        sizeof(g_minute_buckets) + sizeof(g_hour_buckets)));
+    return 0;
+}
+
+void mcp_history_append(int64_t time_ms, float temperature, float humidity) {
+    if (!g_history.lock || time_ms < 0) {
+        return;
+    }
+
+    const int16_t value[SENSOR_COUNT] = {encode_value(temperature), encode_value(humidity)};
+    bool flush = false;
+    time_ms = to_internal_ms(time_ms);
+    xSemaphoreTake(g_history.lock, portMAX_DELAY);
+    // 时间回退时按与上一个样本同时处理，保持块起始时间有序
+    if (g_history.has_data && time_ms < g_history.last_ms) {
+        time_ms = g_history.last_ms;
+    }
+    if (!g_history.has_data) {
+        g_history.first_ms = time_ms;
+        g_history.has_data = true;
+    }
+    history_block_t *block = &g_history.blocks[g_history.head];
+    uint16_t bits = block->bits;
+    if (!g_history.used || !block_append(block, g_history.pages[g_history.head], &g_history.encoder, time_ms, value)) {
+        // 换块，写满的块写入 flash，满时淘汰最早的块
+        if (g_history.used) {
+            g_history.flush = (mcp_flashlog_page_t){
+                .first_ms = block->base_ms,
+                .last_ms = g_history.encoder.time_ms,
+                .count = block->count,
+                .bits = block->bits,
+            };
+            memcpy(g_history.flush_page, g_history.pages[g_history.head], MCP_HISTORY_PAGE_SIZE);
+            flush = true;
+            g_history.head = (g_history.head + 1) % MCP_HISTORY_PAGES;
+        }
+        block = &g_history.blocks[g_history.head];
+        if (g_history.used < MCP_HISTORY_PAGES) {
+            g_history.used++;
+        } else {
+            g_history.count -= block->count;
+            g_history.encoded_bits -= block->bits;
+        }
+        block_start(block, g_history.pages[g_history.head], &g_history.encoder, time_ms);
+        block_append(block, g_history.pages[g_history.head], &g_history.encoder, time_ms, value);
+        bits = 0;
+    }
+    g_history.encoded_bits += block->bits - bits;
+    g_history.count++;
+    g_history.appended++;
+    g_history.last_ms = time_ms;
+
+    for (int t = MCP_HISTORY_TIER_MINUTE; t < MCP_HISTORY_TIER_COUNT; t++) {
+        tier_append(&g_history.tiers[t], time_ms, value);
+    }
+    xSemaphoreGive(g_history.lock);
+
+    // flash 写入和擦除较慢，不在历史锁内进行
+    if (flush) {
+        mcp_flashlog_append(&g_history.flush, g_history.flush_page);
+    }
+}
+
+int mcp_history_query(int64_t from_ms, int64_t to_ms, uint32_t resolution_ms,
+                      mcp_history_sample_t *out, int max, uint32_t *total, mcp_history_tier_t *tier) {
+    uint32_t in_range = 0;
+    mcp_history_tier_t selected = MCP_HISTORY_TIER_RAW;
+    int written = 0;
+
+    if (g_history.lock && out && max > 0 && from_ms <= to_ms) {
+        from_ms = to_internal_ms(from_ms);
+        to_ms = to_internal_ms(to_ms);
+        xSemaphoreTake(g_history.lock, portMAX_DELAY);
+        if (g_history.has_data) {
+            if (!resolution_ms) {
+                int64_t start = from_ms > g_history.first_ms ? from_ms : g_history.first_ms;
+                int64_t stop = to_ms < g_history.last_ms ? to_ms : g_history.last_ms;
+                resolution_ms = stop > start ? (uint32_t)((stop - start) / max) : 0;
+            }
+            selected = select_tier(from_ms, resolution_ms);
+            if (selected == MCP_HISTORY_TIER_RAW) {
+                written = query_raw(from_ms, to_ms, out, max, &in_range);
+            } else if (selected != MCP_HISTORY_TIER_FLASH) {
+                written = query_tier(&g_history.tiers[selected], from_ms, to_ms, out, max, &in_range);
+            }
+        }
+        xSemaphoreGive(g_history.lock);
+
+        if (selected == MCP_HISTORY_TIER_FLASH) {
+            written = query_flash(from_ms, to_ms, out, max, &in_range);
+        }
+        for (int i = 0; i < written; i++) {
+            out[i].time_ms -= g_history.offset_ms;
+        }
+    }
+
+    if (total) {
+        *total = in_range;
+    }
+    if (tier) {
+        *tier = selected;
+    }
+    return written;
+}
+
+static void export_emit(history_export_t *e) {
+    mcp_history_sample_t sample;
+    if (!e->stopped && acc_emit(&e->acc, &sample)) {
+        sample.time_ms -= g_history.offset_ms;
+        e->visited++;
+        e->stopped = !e->visit(&sample, e->ctx);
+    }
+}
+
+static void export_add(history_export_t *e, int64_t time_ms, const int16_t value[SENSOR_COUNT]) {
+    acc_add(&e->acc, time_ms, 1, value, value, value);
+    if (e->acc.count >= e->downsample) {
+        export_emit(e);
+    }
+}
+
+// 复制第一个页，在日志锁外解码
+static bool export_copy_page(const mcp_flashlog_page_t *page, const uint8_t *payload, void *ctx) {
+    if (page->bits > PAGE_BITS) {
+        return true;
+    }
+    g_export.page = *page;
+    memcpy(g_export.payload, payload, (page->bits + 7) / 8);
+    g_export.found = true;
+    return false;
+}
+
+int mcp_history_export(int64_t from_ms, int64_t to_ms, uint32_t downsample, mcp_history_visit_t visit, void *ctx) {
+    if (!g_history.lock || !visit || from_ms > to_ms) {
+        return 0;
+    }
+
+    history_export_t e = {
+        .downsample = downsample > 1 ? downsample : 1,
+        .visit = visit,
+        .ctx = ctx,
+    };
+    int64_t cursor = to_internal_ms(from_ms);
+    to_ms = to_internal_ms(to_ms);
+
+    // 内存中的原始层之前的部分逐页从 flash 日志读取
+    xSemaphoreTake(g_history.lock, portMAX_DELAY);
+    int64_t ram_oldest = tier_oldest_ms(MCP_HISTORY_TIER_RAW);
+    xSemaphoreGive(g_history.lock);
+    while (!e.stopped && cursor < ram_oldest && cursor <= to_ms) {
+        g_export.found = false;
+        if (mcp_flashlog_read(cursor, to_ms, false, export_copy_page, NULL) <= 0 || !g_export.found) {
+            break;
+        }
+        const history_block_t block = {
+            .base_ms = g_export.page.first_ms,
+            .count = g_export.page.count,
+            .bits = g_export.page.bits,
+        };
+        history_codec_t dec;
+        uint32_t bit = 0;
+        for (uint16_t index = 0; index < block.count && !e.stopped; index++) {
+            block_decode(&block, g_export.payload, &bit, index, &dec);
+            if (dec.time_ms > to_ms) {
+                break;
+            }
+            if (dec.time_ms >= cursor) {
+                export_add(&e, dec.time_ms, dec.value);
+            }
+        }
+        if (g_export.page.last_ms == INT64_MAX) {
+            break;
+        }
+        cursor = g_export.page.last_ms + 1;
+    }
+
+    // 其余部分从内存中的原始层分批解码
+    while (!e.stopped && cursor <= to_ms) {
+        history_iter_t it;
+        int n = 0;
+        xSemaphoreTake(g_history.lock, portMAX_DELAY);
+        uint32_t in_range = raw_range(cursor, to_ms, &it);
+        while (n < MCP_HISTORY_EXPORT_BATCH && (uint32_t)n < in_range) {
+            g_export.samples[n++] = it.state;
+            iter_next(&it);
+        }
+        xSemaphoreGive(g_history.lock);
+
+        for (int i = 0; i < n; i++) {
+            export_add(&e, g_export.samples[i].time_ms, g_export.samples[i].value);
+        }
+        if (n < MCP_HISTORY_EXPORT_BATCH || g_export.samples[n - 1].time_ms == INT64_MAX) {
+            break;
+        }
+        cursor = g_export.samples[n - 1].time_ms + 1;
+    }
+
+    export_emit(&e);
+    return e.visited;
+}
+
+void mcp_history_get_stats(mcp_history_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->bytes = sizeof(g_history.pages) + sizeof(g_history.blocks) +
+                   sizeof(g_minute_buckets) + sizeof(g_hour_buckets);
+    if (!g_history.lock) {
+        return;
+    }
+
+    xSemaphoreTake(g_history.lock, portMAX_DELAY);
+    stats->count = g_history.count;
+    stats->encoded_bits = g_history.encoded_bits;
+    stats->appended = g_history.appended;
+    if (g_history.used) {
+        stats->oldest_ms = g_history.blocks[physical_block(0)].base_ms - g_history.offset_ms;
+        stats->newest_ms = g_history.last_ms - g_history.offset_ms;
+    }
+    xSemaphoreGive(g_history.lock);
+}
+
+int mcp_history_benchmark(mcp_history_source_t source, uint32_t samples, uint32_t interval_ms,
+                          mcp_history_bench_t *result) {
+    if (!source || !samples || !result) {
+        return -1;
+    }
+
+    // 每块至少容纳 PAGE_BITS / MAX_SAMPLE_BITS 个样本
+    uint32_t max_pages = samples / (PAGE_BITS / MAX_SAMPLE_BITS) + 1;
+    history_codec_t *input = malloc(samples * sizeof(*input));
+    uint8_t *pages = calloc(max_pages, MCP_HISTORY_PAGE_SIZE);
+    history_block_t *blocks = calloc(max_pages, sizeof(*blocks));
+    if (!input || !pages || !blocks) {
+        free(input);
+        free(pages);
+        free(blocks);
+        return -1;
+    }
+
+    // 样本生成不计入编码时间
+    for (uint32_t i = 0; i < samples; i++) {
+        float temperature, humidity;
+        input[i].time_ms = (int64_t)i * interval_ms;
+        source(input[i].time_ms, &temperature, &humidity);
+        input[i].value[0] = encode_value(temperature);
+        input[i].value[1] = encode_value(humidity);
+    }
+
+    history_codec_t codec;
+    uint32_t used = 0;
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t i = 0; i < samples; i++) {
+        if (!used || !block_append(&blocks[used - 1], pages + (used - 1) * MCP_HISTORY_PAGE_SIZE, &codec,
+                                   input[i].time_ms, input[i].value)) {
+            block_start(&blocks[used], pages + used * MCP_HISTORY_PAGE_SIZE, &codec, input[i].time_ms);
+            block_append(&blocks[used], pages + used * MCP_HISTORY_PAGE_SIZE, &codec, input[i].time_ms, input[i].value);
+            used++;
+        }
+    }
+    int64_t encoded_us = esp_timer_get_time();
+
+    uint32_t mismatches = 0;
+    uint32_t i = 0;
+    for (uint32_t b = 0; b < used; b++) {
+        uint32_t bit = 0;
+        for (uint16_t index = 0; index < blocks[b].count; index++, i++) {
+            block_decode(&blocks[b], pages + b * MCP_HISTORY_PAGE_SIZE, &bit, index, &codec);
+            if (codec.time_ms != input[i].time_ms || memcmp(codec.value, input[i].value, sizeof(codec.value)) != 0) {
+                mismatches++;
+            }
+        }
+    }
+    int64_t decoded_us = esp_timer_get_time();
+
+    uint32_t bytes = used * sizeof(history_block_t);
+    for (uint32_t b = 0; b < used; b++) {
+        bytes += (blocks[b].bits + 7) / 8;
+    }
+    result->samples = samples;
+    result->encoded_bytes = bytes;
+    result->bits_per_sample = (float)bytes * 8 / samples;
+    result->ratio = (float)samples * 16 / bytes;
+    result->encode_ns = (uint32_t)((encoded_us - start_us) * 1000 / samples);
+    result->decode_ns = (uint32_t)((decoded_us - encoded_us) * 1000 / samples);
+    result->mismatches = mismatches + (samples - i);
+
+    free(input);
+    free(pages);
+    free(blocks);
+    return 0;
+}
+
+// 把基准测试的块写入 flash 日志，累计写入时间
+static int bench_flush(const history_block_t *block, const uint8_t *page, int64_t last_ms, int64_t *elapsed_us) {
+    const mcp_flashlog_page_t header = {
+        .first_ms = block->base_ms,
+        .last_ms = last_ms,
+        .count = block->count,
+        .bits = block->bits,
+    };
+    int64_t start_us = esp_timer_get_time();
+    int ret = mcp_flashlog_append(&header, page);
+    *elapsed_us += esp_timer_get_time() - start_us;
+    return ret;
+}
+
+int mcp_history_benchmark_flash(mcp_history_source_t source, uint32_t samples, uint32_t interval_ms,
+                                uint32_t queries, mcp_history_flash_bench_t *result) {
+    if (!source || !samples || !queries || !result || mcp_flashlog_erase_all() != 0) {
+        return -1;
+    }
+
+    mcp_flashlog_stats_t before;
+    mcp_flashlog_stats_t after;
+    mcp_flashlog_get_stats(&before);
+    memset(result, 0, sizeof(*result));
+
+    history_block_t block;
+    history_codec_t codec;
+    uint8_t page[MCP_HISTORY_PAGE_SIZE];
+    int64_t append_us = 0;
+    int ret = 0;
+    for (uint32_t i = 0; i < samples && ret == 0; i++) {
+        float temperature, humidity;
+        int64_t time_ms = (int64_t)i * interval_ms;
+        source(time_ms, &temperature, &humidity);
+        const int16_t value[SENSOR_COUNT] = {encode_value(temperature), encode_value(humidity)};
+        if (!i || !block_append(&block, page, &codec, time_ms, value)) {
+            if (i) {
+                ret = bench_flush(&block, page, codec.time_ms, &append_us);
+                result->pages++;
+            }
+            block_start(&block, page, &codec, time_ms);
+            block_append(&block, page, &codec, time_ms, value);
+        }
+    }
+    if (ret == 0) {
+        ret = bench_flush(&block, page, codec.time_ms, &append_us);
+        result->pages++;
+    }
+    mcp_flashlog_get_stats(&after);
+    result->payload_bytes = after.payload_bytes - before.payload_bytes;
+    result->flash_bytes_written = after.flash_bytes_written - before.flash_bytes_written;
+    result->flash_bytes_erased = after.flash_bytes_erased - before.flash_bytes_erased;
+    result->write_amplification = result->payload_bytes ? (float)result->flash_bytes_written / result->payload_bytes : 0;
+    result->append_us = (uint32_t)(append_us / result->pages);
+
+    // 随机的 1 小时范围，只解码不输出
+    int64_t span_ms = (int64_t)(samples - 1) * interval_ms;
+    int64_t range_ms = span_ms < 3600000 ? span_ms : 3600000;
+    uint32_t seed = 1;
+    uint32_t decoded = 0;
+    int64_t start_us = esp_timer_get_time();
+    for (uint32_t n = 0; n < queries && ret == 0; n++) {
+        seed = seed * 1103515245 + 12345;
+        int64_t from_ms = span_ms > range_ms ? (int64_t)(seed >> 8) * interval_ms % (span_ms - range_ms) : 0;
+        history_flash_query_t q = {
+            .from_ms = from_ms,
+            .to_ms = from_ms + range_ms,
+            .stride = UINT32_MAX,
+        };
+        mcp_flashlog_read(q.from_ms, q.to_ms, false, flash_decode_page, &q);
+        decoded += q.in_range;
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    mcp_flashlog_get_stats(&before);
+    result->queries = queries;
+    result->query_us = (uint32_t)(elapsed_us / queries);
+    result->query_bytes_read = (before.flash_bytes_read - after.flash_bytes_read) / queries;
+    result->query_samples = decoded / queries;
+
+    if (mcp_flashlog_erase_all() != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+const char *mcp_history_tier_name_at(int index) {
+    return index >= 0 && index < MCP_HISTORY_TIER_COUNT ? g_tier_names[index] : NULL;
+}
@@ -0,0 +1,205 @@
+#ifndef _MCP_HISTORY_H_
+#define _MCP_HISTORY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 传感器历史配置
+#define MCP_HISTORY_PAGE_SIZE       232     // 每个压缩块的字节数，与 flash 日志的记录数据长度一致
+#define MCP_HISTORY_PAGES           52      // 原始层压缩块数 (12 KB)
+#define MCP_HISTORY_VALUE_SCALE     100     // 定点值单位 0.01 °C / 0.01 %
+#define MCP_HISTORY_MAX_QUERY       120     // 单次查询返回的最多条目数
+#define MCP_HISTORY_EXPORT_BATCH    32      // 导出时每次持锁解码的样本数
+
+// 汇总层配置，每个桶 14 字节
+#define MCP_HISTORY_MINUTE_BUCKETS  1440    // 1 分钟汇总，保留 24 小时
+#define MCP_HISTORY_HOUR_BUCKETS    336     // 1 小时汇总，保留 14 天
+
+/**
+ * @brief 历史数据层，从细到粗
+ */
+typedef enum {
+    MCP_HISTORY_TIER_RAW = 0,
+    MCP_HISTORY_TIER_FLASH,     ///< flash 日志中的原始样本，早于内存中的原始层
+    MCP_HISTORY_TIER_MINUTE,
+    MCP_HISTORY_TIER_HOUR,
+    MCP_HISTORY_TIER_COUNT
+} mcp_history_tier_t;
+
+/**
+ * @brief 历史条目（解码后），原始样本或一段时间的汇总
+ */
+typedef struct {
+    int64_t time_ms;        ///< 启动后的时间 (ms)，之前启动的数据为负值；汇总条目为起始时间
+    uint32_t count;         ///< 包含的原始样本数
+    float temperature;      ///< 平均值
+    float temperature_min;
+    float temperature_max;
+    float humidity;         ///< 平均值
+    float humidity_min;
+    float humidity_max;
+} mcp_history_sample_t;
+
+/**
+ * @brief 历史缓冲区统计
+ */
+typedef struct {
+    uint32_t count;         ///< 当前保存的原始样本数
+    uint32_t encoded_bits;  ///< 这些样本的压缩数据位数（不含块索引）
+    uint32_t appended;      ///< 累计写入的样本数
+    uint32_t bytes;         ///< 所有层占用的内存
+    int64_t oldest_ms;      ///< 内存中最早原始样本时间，没有样本时为 0
+    int64_t newest_ms;      ///< 最新样本时间，没有样本时为 0
+} mcp_history_stats_t;
+
+/**
+ * @brief 压缩编码基准测试结果
+ */
+typedef struct {
+    uint32_t samples;
+    uint32_t encoded_bytes;     ///< 压缩数据和块索引
+    float bits_per_sample;      ///< 含块索引
+    float ratio;                ///< 相对每个样本 16 字节 (int64 时间 + 两个 float)
+    uint32_t encode_ns;         ///< 每个样本的编码时间
+    uint32_t decode_ns;         ///< 每个样本的解码时间
+    uint32_t mismatches;        ///< 解码结果与输入不一致的样本数，应为 0
+} mcp_history_bench_t;
+
+/**
+ * @brief flash 日志基准测试结果
+ */
+typedef struct {
+    uint32_t pages;                 ///< 写入的页数
+    uint32_t payload_bytes;         ///< 压缩数据字节数
+    uint32_t flash_bytes_written;   ///< 实际写入 flash 的字节数（含页头和段头）
+    uint32_t flash_bytes_erased;
+    float write_amplification;      ///< flash_bytes_written / payload_bytes
+    uint32_t append_us;             ///< 每页的写入时间
+    uint32_t queries;
+    uint32_t query_us;              ///< 每次查询的时间
+    uint32_t query_bytes_read;      ///< 每次查询读取的 flash 字节数
+    uint32_t query_samples;         ///< 每次查询解码的样本数
+} mcp_history_flash_bench_t;
+
+/**
+ * @brief 基准测试的样本来源
+ * @param time_ms 样本时间 (ms)
+ * @param temperature 输出温度 °C
+ * @param humidity 输出湿度 %
+ */
+typedef void (*mcp_history_source_t)(int64_t time_ms, float *temperature, float *humidity);
+
+/**
+ * @brief 初始化历史缓冲区，打开 flash 日志并用保存的数据恢复分钟/小时汇总层
+ *
+ * 没有实时时钟，时间轴是累计的运行时间：本次启动的时间从 flash 中最新的样本之后开始，
+ * 接口上的时间仍是启动后的时间，之前启动的数据为负值。
+ *
+ * @return 0 on success, -1 on failure（flash 日志不可用时只保留内存中的历史，返回 0）
+ */
+int mcp_history_init(void);
+
+/**
+ * @brief 追加一个样本并增量更新各汇总层，原始层满时覆盖最早的一个压缩块
+ *
+ * 压缩块写满时整页写入 flash 日志，断电最多丢失当前未写满的一页。只应在一个任务中调用。
+ *
+ * @param time_ms 启动后的时间 (ms)，必须不早于上一个样本
+ * @param temperature 温度 °C
+ * @param humidity 湿度 %
+ */
+void mcp_history_append(int64_t time_ms, float temperature, float humidity);
+
+/**
+ * @brief 查询时间范围 [from_ms, to_ms] 内的历史
+ *
+ * 自动选择满足分辨率且覆盖范围起点的最粗的层，内存中的原始层不覆盖起点时从 flash 日志读取；
+ * 条目超过 max 个时相邻条目合并。内存中各层的查询代价只取决于 max，flash 层只读取与范围重叠的页。
+ *
+ * @param from_ms 起始时间 (ms)
+ * @param to_ms 结束时间 (ms)
+ * @param resolution_ms 需要的最粗时间分辨率，0 表示按 范围/max 自动选择
+ * @param out 输出数组（从旧到新）
+ * @param max 数组长度
+ * @param total 输出所选层在范围内的条目数 (可为 NULL)
+ * @param tier 输出所选的层 (可为 NULL)
+ * @return 写入 out 的条目数
+ */
+int mcp_history_query(int64_t from_ms, int64_t to_ms, uint32_t resolution_ms,
+                      mcp_history_sample_t *out, int max, uint32_t *total, mcp_history_tier_t *tier);
+
+/**
+ * @brief 导出回调
+ * @param sample 条目，downsample 大于 1 时为合并后的条目
+ * @param ctx 用户参数
+ * @return true 继续，false 停止导出
+ */
+typedef bool (*mcp_history_visit_t)(const mcp_history_sample_t *sample, void *ctx);
+
+/**
+ * @brief 按时间顺序导出 [from_ms, to_ms] 内的全部原始样本（flash 日志和内存）
+ *
+ * 分批解码，回调在不持有任何锁时调用，可以阻塞（例如等待发送）。
+ * 使用静态缓冲区，只应在一个任务中调用。
+ *
+ * @param from_ms 起始时间 (ms)
+ * @param to_ms 结束时间 (ms)
+ * @param downsample 每个条目合并的原始样本数，0 和 1 表示不合并
+ * @param visit 回调
+ * @param ctx 用户参数
+ * @return 导出的条目数
+ */
+int mcp_history_export(int64_t from_ms, int64_t to_ms, uint32_t downsample, mcp_history_visit_t visit, void *ctx);
+
+/**
+ * @brief 获取历史缓冲区统计
+ * @param stats 输出
+ */
+void mcp_history_get_stats(mcp_history_stats_t *stats);
+
+/**
+ * @brief 用独立的缓冲区测试原始层的压缩编码，不影响已保存的历史
+ *
+ * 输入样本和压缩数据都在堆上分配，适合在 Linux 目标上运行。
+ *
+ * @param source 样本来源
+ * @param samples 样本数
+ * @param interval_ms 采样间隔 (ms)
+ * @param result 输出结果
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int mcp_history_benchmark(mcp_history_source_t source, uint32_t samples, uint32_t interval_ms,
+                          mcp_history_bench_t *result);
+
+/**
+ * @brief 测试 flash 日志的写放大和查询延迟
+ *
+ * 擦除 flash 日志后写入模拟数据，再查询随机的 1 小时范围，结束后再次擦除。
+ * 会清除已保存的历史，适合在 Linux 目标的文件模拟分区上运行。
+ *
+ * @param source 样本来源
+ * @param samples 样本数
+ * @param interval_ms 采样间隔 (ms)
+ * @param queries 查询次数
+ * @param result 输出结果
+ * @return 0 on success, -1 if the flash log is unavailable or a write fails
+ */
+int mcp_history_benchmark_flash(mcp_history_source_t source, uint32_t samples, uint32_t interval_ms,
+                                uint32_t queries, mcp_history_flash_bench_t *result);
+
+/**
+ * @brief 层名称 ("raw", "flash", "1m", "1h")
+ * @param index 下标
+ * @return 名称，超出范围时为 NULL
+ */
+const char *mcp_history_tier_name_at(int index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_HISTORY_H_ */
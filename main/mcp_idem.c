@@ -0,0 +1,94 @@
+/**
+ * @file mcp_idem.c
+ * @brief 工具调用幂等缓存 - 按请求 id 和参数哈希缓存序列化的响应
+ *
+ * 断线重连后服务端可能用相同的 id 重发 tools/call，窗口内的重复请求直接返回缓存的响应，
+ * 不再修改设备状态或驱动硬件。
+ */
+
+#include "mcp_idem.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+#include <stdbool.h>
+
+static const char *TAG = "mcp_idem";
+
+#define FNV_PRIME 16777619u
+
+typedef struct {
+    char id[MCP_IDEM_MAX_ID_LEN];
+    uint32_t hash;
+    int64_t stored_us;
+    bool used;
+    char response[MCP_IDEM_MAX_RESPONSE_LEN];
+} idem_entry_t;
+
+static struct {
+    idem_entry_t entries[MCP_IDEM_CACHE_SIZE];
+    mcp_idem_stats_t stats;
+} g_idem;
+
+static bool entry_live(const idem_entry_t *entry, int64_t now) {
+    return entry->used && now - entry->stored_us < (int64_t)MCP_IDEM_WINDOW_MS * 1000;
+}
+
+uint32_t mcp_idem_hash(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+const char *mcp_idem_lookup(const char *id, uint32_t hash) {
+    int64_t now = esp_timer_get_time();
+
+    for (int i = 0; i < MCP_IDEM_CACHE_SIZE; i++) {
+        idem_entry_t *entry = &g_idem.entries[i];
+        if (entry->hash == hash && entry_live(entry, now) && strcmp(entry->id, id) == 0) {
+            g_idem.stats.hits++;
+            ESP_LOGI(TAG, "Duplicate request id %s answered from cache", id);
+            return entry->response;
+        }
+    }
+
+    g_idem.stats.misses++;
+    return NULL;
+}
+
+void mcp_idem_store(const char *id, uint32_t hash, const char *response) {
+    size_t len = strlen(response);
+    if (len >= MCP_IDEM_MAX_RESPONSE_LEN || strlen(id) >= MCP_IDEM_MAX_ID_LEN) {
+        g_idem.stats.too_large++;
+        ESP_LOGD(TAG, "Response for id %s too large to cache (%u bytes)", id, (unsigned)len);
+        return;
+    }
+
+    // 同 id 的旧条目优先复用，其次是过期或空闲的条目，最后替换最早的一条
+    int64_t now = esp_timer_get_time();
+    idem_entry_t *slot = NULL;
+    for (int i = 0; i < MCP_IDEM_CACHE_SIZE && (!slot || !slot->used || strcmp(slot->id, id) != 0); i++) {
+        idem_entry_t *entry = &g_idem.entries[i];
+        if (entry->used && strcmp(entry->id, id) == 0) {
+            slot = entry;
+        } else if (!slot || (entry_live(slot, now) &&
+                             (!entry_live(entry, now) || entry->stored_us < slot->stored_us))) {
+            slot = entry;
+        }
+    }
+
+    strlcpy(slot->id, id, sizeof(slot->id));
+    slot->hash = hash;
+    slot->stored_us = now;
+    slot->used = true;
+    memcpy(slot->response, response, len + 1);
+    g_idem.stats.stored++;
+}
+
+void mcp_idem_get_stats(mcp_idem_stats_t *stats) {
+    if (stats) {
+        *stats = g_idem.stats;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef _MCP_IDEM_H_
+#define _MCP_IDEM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 幂等缓存配置
+#define MCP_IDEM_CACHE_SIZE         8       // 缓存的响应条数
+#define MCP_IDEM_WINDOW_MS          30000   // 重复请求的判定窗口
+#define MCP_IDEM_MAX_RESPONSE_LEN   512     // 超过该长度的响应不缓存
+#define MCP_IDEM_MAX_ID_LEN         64      // 序列化后超过该长度的 id 不缓存
+
+/**
+ * @brief 幂等缓存统计
+ */
+typedef struct {
+    uint32_t hits;          ///< 由缓存应答的重复请求
+    uint32_t misses;        ///< 需要执行的请求
+    uint32_t stored;        ///< 写入缓存的响应
+    uint32_t too_large;     ///< 因过长未缓存的响应
+} mcp_idem_stats_t;
+
+#define MCP_IDEM_HASH_INIT          2166136261u     // FNV-1a 初始值
+
+/**
+ * @brief 计算请求参数的哈希 (FNV-1a)，可以分段累加
+ * @param hash 初始值，第一段传 MCP_IDEM_HASH_INIT
+ * @param data 数据
+ * @param len 长度
+ * @return 累加后的哈希
+ */
+uint32_t mcp_idem_hash(uint32_t hash, const void *data, size_t len);
+
+/**
+ * @brief 查找窗口内相同 id 和参数哈希的响应
+ *
+ * 缓存只在请求处理任务中使用，不加锁。
+ *
+ * @param id 序列化的 JSON-RPC 请求 id（数字和字符串 id 不会混淆）
+ * @param hash 参数哈希
+ * @return 缓存的响应，下一次 mcp_idem_store() 之前有效；没有命中时为 NULL
+ */
+const char *mcp_idem_lookup(const char *id, uint32_t hash);
+
+/**
+ * @brief 缓存响应，缓存满时替换最早的一条
+ * @param id 序列化的 JSON-RPC 请求 id
+ * @param hash 参数哈希
+ * @param response 序列化的响应
+ */
+void mcp_idem_store(const char *id, uint32_t hash, const char *response);
+
+/**
+ * @brief 获取幂等缓存统计
+ * @param stats 输出
+ */
+void mcp_idem_get_stats(mcp_idem_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_IDEM_H_ */
@@ -0,0 +1,228 @@
+/**
+ * @file mcp_light.c
+ * @brief RGB 灯光驱动 - 三个 LEDC 通道，渐变由 LEDC 硬件完成；Linux 目标上为模拟后端
+ */
+
+#include "mcp_light.h"
+#include "mcp_actuator.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "driver/ledc.h"
+#endif
+
+static const char *TAG = "mcp_light";
+
+uint32_t mcp_light_duty_for(bool enabled, int brightness, int level) {
+    if (!enabled || brightness <= 0 || level <= 0) {
+        return 0;
+    }
+    if (brightness > 100) brightness = 100;
+    if (level > 255) level = 255;
+    return (uint32_t)((uint64_t)MCP_LIGHT_DUTY_MAX * level * brightness / (255 * 100));
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#define LIGHT_SPEED_MODE    LEDC_LOW_SPEED_MODE
+#define LIGHT_TIMER         LEDC_TIMER_0
+
+static const int g_light_gpios[MCP_LIGHT_CHANNEL_COUNT] = {
+    CONFIG_MCP_LIGHT_GPIO_RED,
+    CONFIG_MCP_LIGHT_GPIO_GREEN,
+    CONFIG_MCP_LIGHT_GPIO_BLUE,
+};
+
+static esp_err_t backend_init(void) {
+    ledc_timer_config_t timer_config = {
+        .speed_mode = LIGHT_SPEED_MODE,
+        .duty_resolution = MCP_LIGHT_DUTY_BITS,
+        .timer_num = LIGHT_TIMER,
+        .freq_hz = CONFIG_MCP_LIGHT_PWM_FREQ_HZ,
+        .clk_cfg = LEDC_AUTO_CLK
+    };
+    esp_err_t ret = ledc_timer_config(&timer_config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    for (int i = 0; i < MCP_LIGHT_CHANNEL_COUNT; i++) {
+        ledc_channel_config_t channel_config = {
+            .gpio_num = g_light_gpios[i],
+            .speed_mode = LIGHT_SPEED_MODE,
+            .channel = (ledc_channel_t)(LEDC_CHANNEL_0 + i),
+            .timer_sel = LIGHT_TIMER,
+            .duty = 0,
+            .hpoint = 0
+        };
+        ret = ledc_channel_config(&channel_config);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    // 渐变由硬件完成，完成中断里不需要回调
+    return ledc_fade_func_install(0);
+}
+
+static esp_err_t backend_fade(mcp_light_channel_t channel, uint32_t duty, uint32_t fade_ms) {
+    ledc_channel_t ch = (ledc_channel_t)(LEDC_CHANNEL_0 + channel);
+
+    // 新目标打断正在进行的渐变，从当前占空比开始
+    ledc_fade_stop(LIGHT_SPEED_MODE, ch);
+    if (fade_ms == 0) {
+        esp_err_t ret = ledc_set_duty(LIGHT_SPEED_MODE, ch, duty);
+        return ret == ESP_OK ? ledc_update_duty(LIGHT_SPEED_MODE, ch) : ret;
+    }
+
+    esp_err_t ret = ledc_set_fade_with_time(LIGHT_SPEED_MODE, ch, duty, fade_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return ledc_fade_start(LIGHT_SPEED_MODE, ch, LEDC_FADE_NO_WAIT);
+}
+
+uint32_t mcp_light_get_duty(mcp_light_channel_t channel) {
+    if ((unsigned)channel >= MCP_LIGHT_CHANNEL_COUNT) {
+        return 0;
+    }
+    return ledc_get_duty(LIGHT_SPEED_MODE, (ledc_channel_t)(LEDC_CHANNEL_0 + channel));
+}
+
+#else /* CONFIG_IDF_TARGET_LINUX */
+
+// 模拟后端：记录每次渐变，按线性插值计算任意时刻的占空比
+static struct {
+    mcp_light_sim_fade_t history[MCP_LIGHT_SIM_HISTORY_SIZE];
+    uint32_t count;                 // 已记录的渐变数（单调递增）
+    portMUX_TYPE lock;
+} g_light_sim = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static uint32_t fade_duty_at(const mcp_light_sim_fade_t *fade, int64_t at_us) {
+    int64_t elapsed_us = at_us - fade->start_us;
+    int64_t fade_us = (int64_t)fade->fade_ms * 1000;
+    if (elapsed_us >= fade_us) {
+        return fade->to_duty;
+    }
+    return (uint32_t)(fade->from_duty + ((int64_t)fade->to_duty - fade->from_duty) * elapsed_us / fade_us);
+}
+
+// 调用时必须持有 g_light_sim.lock
+static uint32_t sim_duty_at_locked(mcp_light_channel_t channel, int64_t at_us) {
+    uint32_t oldest = g_light_sim.count > MCP_LIGHT_SIM_HISTORY_SIZE ?
+                      g_light_sim.count - MCP_LIGHT_SIM_HISTORY_SIZE : 0;
+    for (uint32_t i = g_light_sim.count; i > oldest; i--) {
+        const mcp_light_sim_fade_t *fade = &g_light_sim.history[(i - 1) % MCP_LIGHT_SIM_HISTORY_SIZE];
+        if (fade->channel == channel && fade->start_us <= at_us) {
+            return fade_duty_at(fade, at_us);
+        }
+    }
+    return 0;
+}
+
+static esp_err_t backend_init(void) {
+    ESP_LOGI(TAG, "Using simulated light backend");
+    return ESP_OK;
+}
+
+static esp_err_t backend_fade(mcp_light_channel_t channel, uint32_t duty, uint32_t fade_ms) {
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&g_light_sim.lock);
+    mcp_light_sim_fade_t *fade = &g_light_sim.history[g_light_sim.count % MCP_LIGHT_SIM_HISTORY_SIZE];
+    uint16_t from_duty = (uint16_t)sim_duty_at_locked(channel, now);
+    fade->start_us = now;
+    fade->fade_ms = fade_ms;
+    fade->from_duty = from_duty;
+    fade->to_duty = (uint16_t)duty;
+    fade->channel = (uint8_t)channel;
+    g_light_sim.count++;
+    portEXIT_CRITICAL(&g_light_sim.lock);
+
+    return ESP_OK;
+}
+
+uint32_t mcp_light_sim_duty_at(mcp_light_channel_t channel, int64_t at_us) {
+    portENTER_CRITICAL(&g_light_sim.lock);
+    uint32_t duty = sim_duty_at_locked(channel, at_us);
+    portEXIT_CRITICAL(&g_light_sim.lock);
+    return duty;
+}
+
+size_t mcp_light_sim_get_history(mcp_light_sim_fade_t *out, size_t max) {
+    if (!out) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&g_light_sim.lock);
+    uint32_t count = g_light_sim.count < MCP_LIGHT_SIM_HISTORY_SIZE ? g_light_sim.count : MCP_LIGHT_SIM_HISTORY_SIZE;
+    if (count > max) {
+        count = max;
+    }
+    uint32_t start = g_light_sim.count - count;
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = g_light_sim.history[(start + i) % MCP_LIGHT_SIM_HISTORY_SIZE];
+    }
+    portEXIT_CRITICAL(&g_light_sim.lock);
+
+    return count;
+}
+
+uint32_t mcp_light_get_duty(mcp_light_channel_t channel) {
+    if ((unsigned)channel >= MCP_LIGHT_CHANNEL_COUNT) {
+        return 0;
+    }
+    return mcp_light_sim_duty_at(channel, esp_timer_get_time());
+}
+
+#endif /* CONFIG_IDF_TARGET_LINUX */
+
+/**
+ * @brief 执行器驱动：把灯光目标状态换算为三个通道的占空比并启动渐变
+ */
+static esp_err_t light_apply(const mcp_actuator_cmd_t *cmd, void *ctx) {
+    if (cmd->index != 0) {
+        // 只有 light0 接在 LEDC 通道上
+        ESP_LOGD(TAG, "light%d has no output channel", cmd->index);
+        return ESP_OK;
+    }
+
+    const int levels[MCP_LIGHT_CHANNEL_COUNT] = { cmd->light.red, cmd->light.green, cmd->light.blue };
+    uint32_t fade_ms = cmd->light.fade_ms ? cmd->light.fade_ms : CONFIG_MCP_LIGHT_FADE_MS;
+
+    for (int i = 0; i < MCP_LIGHT_CHANNEL_COUNT; i++) {
+        uint32_t duty = mcp_light_duty_for(cmd->light.enabled, cmd->light.brightness, levels[i]);
+        esp_err_t ret = backend_fade((mcp_light_channel_t)i, duty, fade_ms);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    ESP_LOGD(TAG, "Light fading to %s, %d%%, RGB(%d, %d, %d)", cmd->light.enabled ? "on" : "off",
+             cmd->light.brightness, cmd->light.red, cmd->light.green, cmd->light.blue);
+    return ESP_OK;
+}
+
+int mcp_light_init(void) {
+    esp_err_t ret = backend_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize light backend: %s", esp_err_to_name(ret));
+        return -1;
+    }
+
+    mcp_actuator_driver_t driver = {
+        .apply = light_apply,
+        .ctx = NULL
+    };
+    if (mcp_actuator_register_driver(MCP_ACTUATOR_LIGHT, &driver) != 0) {
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Light driver initialized, fade: %d ms", CONFIG_MCP_LIGHT_FADE_MS);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef _MCP_LIGHT_H_
+#define _MCP_LIGHT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 灯光 PWM 配置
+#define MCP_LIGHT_DUTY_BITS         13
+#define MCP_LIGHT_DUTY_MAX          ((1U << MCP_LIGHT_DUTY_BITS) - 1)
+#define MCP_LIGHT_SIM_HISTORY_SIZE  32      // 模拟后端记录的渐变条数
+
+/**
+ * @brief 灯光通道
+ */
+typedef enum {
+    MCP_LIGHT_CHANNEL_RED = 0,
+    MCP_LIGHT_CHANNEL_GREEN,
+    MCP_LIGHT_CHANNEL_BLUE,
+    MCP_LIGHT_CHANNEL_COUNT
+} mcp_light_channel_t;
+
+/**
+ * @brief 初始化灯光驱动并注册为 MCP_ACTUATOR_LIGHT 的驱动
+ *
+ * 三个 LEDC 通道对应 R/G/B，开关、亮度和颜色换算为占空比后由硬件渐变到目标值。
+ * Linux 目标上使用模拟后端，只记录各通道的占空比变化。
+ *
+ * @return 0 on success, -1 on failure
+ */
+int mcp_light_init(void);
+
+/**
+ * @brief 计算通道目标占空比
+ * @param enabled 开关
+ * @param brightness 亮度 0-100%
+ * @param level 通道颜色分量 0-255
+ * @return 占空比 0-MCP_LIGHT_DUTY_MAX
+ */
+uint32_t mcp_light_duty_for(bool enabled, int brightness, int level);
+
+/**
+ * @brief 获取通道当前占空比（渐变过程中返回中间值）
+ * @param channel 通道
+ * @return 占空比
+ */
+uint32_t mcp_light_get_duty(mcp_light_channel_t channel);
+
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief 模拟后端记录的一次渐变
+ */
+typedef struct {
+    int64_t start_us;           ///< 渐变开始时间
+    uint32_t fade_ms;           ///< 渐变时长
+    uint16_t from_duty;
+    uint16_t to_duty;
+    uint8_t channel;
+} mcp_light_sim_fade_t;
+
+/**
+ * @brief 读取模拟后端记录的渐变（从旧到新）
+ * @param out 输出数组
+ * @param max 数组长度
+ * @return 写入的条数
+ */
+size_t mcp_light_sim_get_history(mcp_light_sim_fade_t *out, size_t max);
+
+/**
+ * @brief 计算模拟通道在指定时刻的占空比
+ * @param channel 通道
+ * @param at_us 时间 (esp_timer_get_time() 时间基准)
+ * @return 占空比
+ */
+uint32_t mcp_light_sim_duty_at(mcp_light_channel_t channel, int64_t at_us);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_LIGHT_H_ */
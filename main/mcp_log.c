@@ -0,0 +1,223 @@
+/**
+ * @file mcp_log.c
+ * @brief 延迟格式化日志 - 调用点只写入二进制环形缓冲区，由低优先级任务格式化输出
+ */
+
+#include "mcp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdarg.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "mcp_log";
+
+typedef struct {
+    const char *tag;
+    uint8_t argc;
+    const char *fmt;
+} mcp_log_fmt_desc_t;
+
+static const mcp_log_fmt_desc_t g_log_formats[MCP_LOG_FMT_COUNT] = {
+#define MCP_LOG_FMT_DESC(id, t, n, f) [id] = { .tag = t, .argc = n, .fmt = f },
+    MCP_LOG_FMT_TABLE(MCP_LOG_FMT_DESC)
+#undef MCP_LOG_FMT_DESC
+};
+
+// 日志环形缓冲区状态
+static struct {
+    mcp_log_entry_t entries[MCP_LOG_RING_SIZE];
+    uint32_t head;                  // 下一个写入位置（单调递增）
+    uint32_t tail;                  // 下一个读取位置（单调递增）
+    uint32_t recorded;
+    uint32_t dropped;
+    portMUX_TYPE lock;
+    mcp_log_sink_t sink;
+    esp_log_level_t sink_level;
+    TaskHandle_t drain_task;
+} g_log = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static char level_letter(esp_log_level_t level) {
+    switch (level) {
+        case ESP_LOG_ERROR:   return 'E';
+        case ESP_LOG_WARN:    return 'W';
+        case ESP_LOG_INFO:    return 'I';
+        case ESP_LOG_DEBUG:   return 'D';
+        case ESP_LOG_VERBOSE: return 'V';
+        default:              return '?';
+    }
+}
+
+void mcp_log_record(esp_log_level_t level, mcp_log_fmt_id_t fmt_id, ...) {
+    if ((unsigned)fmt_id >= MCP_LOG_FMT_COUNT) {
+        return;
+    }
+
+    uint8_t argc = g_log_formats[fmt_id].argc;
+    uint32_t args[MCP_LOG_MAX_ARGS] = {0};
+
+    va_list ap;
+    va_start(ap, fmt_id);
+    for (int i = 0; i < argc && i < MCP_LOG_MAX_ARGS; i++) {
+        args[i] = va_arg(ap, uint32_t);
+    }
+    va_end(ap);
+
+    uint32_t timestamp = esp_log_timestamp();
+
+    portENTER_CRITICAL_SAFE(&g_log.lock);
+    if (g_log.head - g_log.tail >= MCP_LOG_RING_SIZE) {
+        // 缓冲区满，覆盖最旧的条目
+        g_log.tail++;
+        g_log.dropped++;
+    }
+    mcp_log_entry_t *entry = &g_log.entries[g_log.head % MCP_LOG_RING_SIZE];
+    entry->timestamp = timestamp;
+    entry->fmt_id = fmt_id;
+    entry->level = level;
+    entry->argc = argc;
+    memcpy(entry->args, args, sizeof(args));
+    g_log.head++;
+    g_log.recorded++;
+    portEXIT_CRITICAL_SAFE(&g_log.lock);
+}
+
+static void format_entry(const mcp_log_entry_t *entry, char *buf, size_t len) {
+    const char *fmt = g_log_formats[entry->fmt_id].fmt;
+    // 多余的参数会被 snprintf 忽略，参数个数不足的格式表项在 record 时已补零
+    snprintf(buf, len, fmt,
+             (unsigned)entry->args[0], (unsigned)entry->args[1],
+             (unsigned)entry->args[2], (unsigned)entry->args[3]);
+}
+
+static bool pop_entry(mcp_log_entry_t *out) {
+    bool ok = false;
+
+    portENTER_CRITICAL_SAFE(&g_log.lock);
+    if (g_log.tail != g_log.head) {
+        *out = g_log.entries[g_log.tail % MCP_LOG_RING_SIZE];
+        g_log.tail++;
+        ok = true;
+    }
+    portEXIT_CRITICAL_SAFE(&g_log.lock);
+
+    return ok;
+}
+
+/**
+ * @brief 日志 drain 任务：格式化条目并输出到 UART 和可选的 sink
+ */
+static void log_drain_task(void *pvParameters) {
+    mcp_log_entry_t entry;
+    char message[160];
+
+    while (1) {
+        while (pop_entry(&entry)) {
+            const char *tag = g_log_formats[entry.fmt_id].tag;
+            format_entry(&entry, message, sizeof(message));
+
+            esp_log_write(entry.level, tag, "%c (%lu) %s: %s\n",
+                          level_letter(entry.level), (unsigned long)entry.timestamp, tag, message);
+
+            mcp_log_sink_t sink = g_log.sink;
+            if (sink && entry.level <= g_log.sink_level) {
+                sink(entry.level, tag, message);
+            }
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(MCP_LOG_DRAIN_PERIOD_MS));
+    }
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief 主机上运行时，进程退出时把环形缓冲区转储到 MCP_LOG_DUMP_PATH，
+ * 用 tools/mcp_log_decode.py 解码
+ */
+static void log_dump_at_exit(void) {
+    static uint8_t buf[sizeof(mcp_log_dump_header_t) + MCP_LOG_RING_SIZE * sizeof(mcp_log_entry_t)];
+    size_t len = mcp_log_dump(buf, sizeof(buf));
+    uint32_t recorded, dropped;
+    mcp_log_get_stats(&recorded, &dropped);
+
+    FILE *file = fopen(MCP_LOG_DUMP_PATH, "wb");
+    if (!file || fwrite(buf, 1, len, file) != len) {
+        fprintf(stderr, "mcp_log: failed to write %s\n", MCP_LOG_DUMP_PATH);
+    } else {
+        fprintf(stderr, "mcp_log: %lu entries recorded, %lu dropped, ring dumped to %s\n",
+                (unsigned long)recorded, (unsigned long)dropped, MCP_LOG_DUMP_PATH);
+    }
+    if (file) {
+        fclose(file);
+    }
+}
+#endif
+
+int mcp_log_init(void) {
+    if (g_log.drain_task) {
+        ESP_LOGW(TAG, "Log drain task already running");
+        return 0;
+    }
+
+    BaseType_t ret = xTaskCreate(log_drain_task, "mcp_log", MCP_LOG_DRAIN_TASK_STACK, NULL,
+                                 MCP_LOG_DRAIN_TASK_PRIORITY, &g_log.drain_task);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create log drain task");
+        g_log.drain_task = NULL;
+        return -1;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    atexit(log_dump_at_exit);
+#endif
+
+    ESP_LOGI(TAG, "Deferred log initialized, ring size: %d", MCP_LOG_RING_SIZE);
+    return 0;
+}
+
+void mcp_log_set_sink(mcp_log_sink_t sink, esp_log_level_t min_level) {
+    portENTER_CRITICAL_SAFE(&g_log.lock);
+    g_log.sink = sink;
+    g_log.sink_level = min_level;
+    portEXIT_CRITICAL_SAFE(&g_log.lock);
+}
+
+size_t mcp_log_dump(void *buf, size_t len) {
+    if (!buf || len < sizeof(mcp_log_dump_header_t)) {
+        return 0;
+    }
+
+    uint8_t *out = buf;
+    size_t capacity = (len - sizeof(mcp_log_dump_header_t)) / sizeof(mcp_log_entry_t);
+    mcp_log_dump_header_t header = {
+        .magic = MCP_LOG_DUMP_MAGIC,
+        .version = MCP_LOG_DUMP_VERSION,
+        .entry_size = sizeof(mcp_log_entry_t),
+    };
+
+    // 转储最近的 MCP_LOG_RING_SIZE 条（包括已输出的），不移动 tail
+    portENTER_CRITICAL_SAFE(&g_log.lock);
+    uint32_t count = g_log.head < MCP_LOG_RING_SIZE ? g_log.head : MCP_LOG_RING_SIZE;
+    if (count > capacity) {
+        count = capacity;
+    }
+    uint32_t start = g_log.head - count;
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(out + sizeof(header) + i * sizeof(mcp_log_entry_t),
+               &g_log.entries[(start + i) % MCP_LOG_RING_SIZE], sizeof(mcp_log_entry_t));
+    }
+    header.dropped = g_log.dropped;
+    portEXIT_CRITICAL_SAFE(&g_log.lock);
+
+    header.count = count;
+    memcpy(out, &header, sizeof(header));
+
+    return sizeof(header) + count * sizeof(mcp_log_entry_t);
+}
+
+void mcp_log_get_stats(uint32_t *recorded, uint32_t *dropped) {
+    if (recorded) *recorded = g_log.recorded;
+    if (dropped) *dropped = g_log.dropped;
+}
@@ -0,0 +1,112 @@
+#ifndef _MCP_LOG_H_
+#define _MCP_LOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_log.h"
+#include "mcp_log_fmt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 日志环形缓冲区配置
+#define MCP_LOG_RING_SIZE           128     // 条目数
+#define MCP_LOG_MAX_ARGS            4
+#define MCP_LOG_DRAIN_PERIOD_MS     100
+#define MCP_LOG_DRAIN_TASK_STACK    3072
+#define MCP_LOG_DRAIN_TASK_PRIORITY 1
+
+// 转储格式标识，主机端解码器据此识别文件
+#define MCP_LOG_DUMP_MAGIC          0x474F4C4D  // "MLOG"
+#define MCP_LOG_DUMP_VERSION        1
+#define MCP_LOG_DUMP_PATH           "mcp_log.bin"   // linux target：进程退出时转储到该文件
+
+/**
+ * @brief 格式 ID（由 mcp_log_fmt.h 中的格式表生成）
+ */
+typedef enum {
+#define MCP_LOG_FMT_ENUM(id, tag, argc, fmt) id,
+    MCP_LOG_FMT_TABLE(MCP_LOG_FMT_ENUM)
+#undef MCP_LOG_FMT_ENUM
+    MCP_LOG_FMT_COUNT
+} mcp_log_fmt_id_t;
+
+/**
+ * @brief 环形缓冲区中的二进制日志条目（24字节）
+ */
+typedef struct {
+    uint32_t timestamp;                 ///< 记录时间 (ms)
+    uint16_t fmt_id;                    ///< 格式 ID
+    uint8_t level;                      ///< esp_log_level_t
+    uint8_t argc;                       ///< 参数个数
+    uint32_t args[MCP_LOG_MAX_ARGS];    ///< 原始参数
+} mcp_log_entry_t;
+
+/**
+ * @brief 转储文件头，后面紧跟 count 个 mcp_log_entry_t（从旧到新）
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t count;
+    uint32_t dropped;
+} mcp_log_dump_header_t;
+
+/**
+ * @brief 日志输出回调，在 drain 任务中调用，message 已格式化
+ */
+typedef void (*mcp_log_sink_t)(esp_log_level_t level, const char *tag, const char *message);
+
+/**
+ * @brief 启动日志 drain 任务（记录在此之前也可以进行）
+ * @return 0 on success, -1 on failure
+ */
+int mcp_log_init(void);
+
+/**
+ * @brief 记录一条日志：只保存格式 ID 和原始参数，不做格式化
+ * @param level 日志级别
+ * @param fmt_id 格式 ID
+ * @param ... 32 位整数参数，个数必须与格式表一致
+ */
+void mcp_log_record(esp_log_level_t level, mcp_log_fmt_id_t fmt_id, ...);
+
+/**
+ * @brief 设置额外的日志输出（例如 MCP notifications/message）
+ * @param sink 回调函数，NULL 表示关闭
+ * @param min_level 转发给 sink 的最低级别
+ */
+void mcp_log_set_sink(mcp_log_sink_t sink, esp_log_level_t min_level);
+
+/**
+ * @brief 将当前环形缓冲区内容转储为二进制格式，供主机端解码
+ * @param buf 输出缓冲区
+ * @param len 缓冲区长度
+ * @return 写入的字节数，缓冲区不足以容纳文件头时返回 0
+ */
+size_t mcp_log_dump(void *buf, size_t len);
+
+/**
+ * @brief 获取日志统计信息
+ * @param recorded 已记录的条目数 (可为 NULL)
+ * @param dropped 因缓冲区满被覆盖的条目数 (可为 NULL)
+ */
+void mcp_log_get_stats(uint32_t *recorded, uint32_t *dropped);
+
+// 调用点宏，级别过滤与 ESP_LOGx 相同，在编译期完成
+#define MCP_LOG_DEFER(level, fmt_id, ...) do { \
+        if (LOG_LOCAL_LEVEL >= (level)) { mcp_log_record((level), (fmt_id), ##__VA_ARGS__); } \
+    } while (0)
+
+#define MCP_LOGE_DEFER(fmt_id, ...) MCP_LOG_DEFER(ESP_LOG_ERROR, fmt_id, ##__VA_ARGS__)
+#define MCP_LOGW_DEFER(fmt_id, ...) MCP_LOG_DEFER(ESP_LOG_WARN, fmt_id, ##__VA_ARGS__)
+#define MCP_LOGI_DEFER(fmt_id, ...) MCP_LOG_DEFER(ESP_LOG_INFO, fmt_id, ##__VA_ARGS__)
+#define MCP_LOGD_DEFER(fmt_id, ...) MCP_LOG_DEFER(ESP_LOG_DEBUG, fmt_id, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_LOG_H_ */
@@ -0,0 +1,24 @@
+#ifndef _MCP_LOG_FMT_H_
+#define _MCP_LOG_FMT_H_
+
+/*
+ * 延迟格式化日志的格式表
+ *
+ * 每一项: X(ID, TAG, 参数个数, 格式字符串)
+ * - 参数只能是 32 位整数（%d/%u/%x/%c），不支持字符串、指针和浮点数
+ * - 只允许在末尾追加新项，已有 ID 的顺序不能改变，否则主机端解码器
+ *   (tools/mcp_log_decode.py) 无法正确解析旧的日志转储
+ */
+#define MCP_LOG_FMT_TABLE(X) \
+    X(MCP_LOG_WS_STATE_CHANGE,  "mcp_websocket", 2, "State change: %d -> %d") \
+    X(MCP_LOG_WS_ENQUEUED,      "mcp_websocket", 2, "Message enqueued, type: %d, size: %d") \
+    X(MCP_LOG_WS_SENDING,       "mcp_websocket", 2, "Sending WebSocket message, type: %d, size: %d") \
+    X(MCP_LOG_WS_SEND_FAILED,   "mcp_websocket", 1, "Failed to send message: %d") \
+    X(MCP_LOG_WS_RECV_TEXT,     "mcp_websocket", 1, "Received text: %d bytes") \
+    X(MCP_LOG_WS_RECV_BINARY,   "mcp_websocket", 1, "Received binary: %d bytes") \
+    X(MCP_LOG_WS_RECV_PING,     "mcp_websocket", 0, "Received ping, sending pong") \
+    X(MCP_LOG_WS_RECV_PONG,     "mcp_websocket", 0, "Received pong") \
+    X(MCP_LOG_WS_READ_ERROR,    "mcp_websocket", 1, "Read error: %d") \
+    X(MCP_LOG_WS_PING_TIMER,    "mcp_websocket", 0, "Ping timer triggered - sending WebSocket PING frame")
+
+#endif /* _MCP_LOG_FMT_H_ */
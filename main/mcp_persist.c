@@ -0,0 +1,139 @@
+/**
+ * @file mcp_persist.c
+ * @brief 设备状态持久化 - 记录修改过的字段，由低优先级任务合并后定期写入 NVS
+ */
+
+#include "mcp_persist.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "mcp_persist";
+
+static struct {
+    uint32_t dirty;                 // 待写入的字段
+    mcp_persist_flush_cb_t flush_cb;
+    TaskHandle_t task;
+    mcp_persist_stats_t stats;
+    portMUX_TYPE lock;
+} g_persist = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static esp_err_t flush_dirty(uint32_t mask) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(MCP_PERSIST_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = g_persist.flush_cb(handle, mask);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
+
+/**
+ * @brief 持久化任务：收到修改通知后等待合并，距离上次写入不足最小间隔时继续等待
+ */
+static void persist_task(void *pvParameters) {
+    int64_t last_flush_us = 0;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        vTaskDelay(pdMS_TO_TICKS(MCP_PERSIST_SETTLE_MS));
+        int64_t wait_us = last_flush_us + (int64_t)MCP_PERSIST_MIN_INTERVAL_MS * 1000 - esp_timer_get_time();
+        if (last_flush_us && wait_us > 0) {
+            vTaskDelay(pdMS_TO_TICKS(wait_us / 1000));
+        }
+        // 等待期间的通知已经包含在本次写入中
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        portENTER_CRITICAL(&g_persist.lock);
+        uint32_t mask = g_persist.dirty;
+        g_persist.dirty = 0;
+        portEXIT_CRITICAL(&g_persist.lock);
+
+        if (!mask) {
+            continue;
+        }
+
+        esp_err_t ret = flush_dirty(mask);
+        last_flush_us = esp_timer_get_time();
+
+        portENTER_CRITICAL(&g_persist.lock);
+        if (ret == ESP_OK) {
+            g_persist.stats.flushes++;
+        } else {
+            // 失败的字段并回待写入集合，下一轮重试
+            g_persist.dirty |= mask;
+            g_persist.stats.failed++;
+        }
+        portEXIT_CRITICAL(&g_persist.lock);
+
+        if (ret == ESP_OK) {
+            ESP_LOGD(TAG, "State flushed, fields: 0x%08lx", (unsigned long)mask);
+        } else {
+            ESP_LOGW(TAG, "Failed to persist state: %s", esp_err_to_name(ret));
+            xTaskNotifyGive(g_persist.task);
+        }
+    }
+}
+
+int mcp_persist_init(mcp_persist_flush_cb_t flush_cb) {
+    if (!flush_cb) {
+        return -1;
+    }
+    if (g_persist.task) {
+        return 0;
+    }
+
+    g_persist.flush_cb = flush_cb;
+    if (xTaskCreate(persist_task, "mcp_persist", MCP_PERSIST_TASK_STACK, NULL,
+                    MCP_PERSIST_TASK_PRIORITY, &g_persist.task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create persist task");
+        g_persist.task = NULL;
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "State persistence started, min interval: %d ms", MCP_PERSIST_MIN_INTERVAL_MS);
+    return 0;
+}
+
+void mcp_persist_mark_dirty(uint32_t mask) {
+    if (!mask || !g_persist.task) {
+        return;
+    }
+
+    portENTER_CRITICAL(&g_persist.lock);
+    g_persist.dirty |= mask;
+    g_persist.stats.marked++;
+    portEXIT_CRITICAL(&g_persist.lock);
+
+    xTaskNotifyGive(g_persist.task);
+}
+
+int mcp_persist_get_i32(const char *key, int32_t *value) {
+    nvs_handle_t handle;
+    if (nvs_open(MCP_PERSIST_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return -1;
+    }
+
+    esp_err_t ret = nvs_get_i32(handle, key, value);
+    nvs_close(handle);
+    return ret == ESP_OK ? 0 : -1;
+}
+
+void mcp_persist_get_stats(mcp_persist_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    portENTER_CRITICAL(&g_persist.lock);
+    *stats = g_persist.stats;
+    portEXIT_CRITICAL(&g_persist.lock);
+}
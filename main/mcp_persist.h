@@ -0,0 +1,67 @@
+#ifndef _MCP_PERSIST_H_
+#define _MCP_PERSIST_H_
+
+#include <stdint.h>
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 持久化配置
+#define MCP_PERSIST_NVS_NAMESPACE   "mcp_state"
+#define MCP_PERSIST_MIN_INTERVAL_MS 5000    // 两次写入 flash 的最小间隔
+#define MCP_PERSIST_SETTLE_MS       500     // 第一次修改后等待后续修改合并的时间
+#define MCP_PERSIST_TASK_STACK      3072
+#define MCP_PERSIST_TASK_PRIORITY   1
+
+/**
+ * @brief 写入回调，在持久化任务中调用
+ * @param handle 已打开的 NVS 句柄，回调只需写入，提交由持久化任务完成
+ * @param dirty_mask 自上次写入以来修改过的字段
+ * @return ESP_OK on success
+ */
+typedef esp_err_t (*mcp_persist_flush_cb_t)(nvs_handle_t handle, uint32_t dirty_mask);
+
+/**
+ * @brief 持久化统计
+ */
+typedef struct {
+    uint32_t marked;        ///< mcp_persist_mark_dirty 调用次数
+    uint32_t flushes;       ///< 实际写入 flash 的次数
+    uint32_t failed;        ///< 写入失败次数（字段会在下次重试）
+} mcp_persist_stats_t;
+
+/**
+ * @brief 启动持久化任务
+ * @param flush_cb 写入回调
+ * @return 0 on success, -1 on failure
+ */
+int mcp_persist_init(mcp_persist_flush_cb_t flush_cb);
+
+/**
+ * @brief 标记字段已修改，写入被延迟并与其他修改合并，每 MCP_PERSIST_MIN_INTERVAL_MS 最多一次
+ * 持久化任务启动前调用无效（例如启动时恢复状态）
+ * @param mask 字段位掩码
+ */
+void mcp_persist_mark_dirty(uint32_t mask);
+
+/**
+ * @brief 读取持久化的值（用于启动时恢复）
+ * @param key NVS 键
+ * @param value 输出
+ * @return 0 on success, -1 if not stored
+ */
+int mcp_persist_get_i32(const char *key, int32_t *value);
+
+/**
+ * @brief 获取持久化统计
+ * @param stats 输出
+ */
+void mcp_persist_get_stats(mcp_persist_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_PERSIST_H_ */
@@ -0,0 +1,308 @@
+/**
+ * @file mcp_rule.c
+ * @brief 本地阈值规则 - 在传感器更新路径中评估，带回差和冷却时间，规则表保存在 NVS
+ *
+ * 规则在条件满足时触发一次并锁存，读数越过 阈值±回差 回到另一侧后才能再次触发；
+ * 冷却时间内满足条件时不锁存，冷却结束后若条件仍满足则触发。
+ */
+
+#include "mcp_rule.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "mcp_rule";
+
+#define RULE_NVS_KEY "rules"
+
+static const char *const g_sensor_names[MCP_RULE_SENSOR_COUNT] = {
+    [MCP_RULE_SENSOR_TEMPERATURE] = "temperature",
+    [MCP_RULE_SENSOR_HUMIDITY] = "humidity",
+};
+
+static const char *const g_condition_names[MCP_RULE_CONDITION_COUNT] = {
+    [MCP_RULE_ABOVE] = "above",
+    [MCP_RULE_BELOW] = "below",
+};
+
+static const char *const g_action_names[MCP_RULE_ACTION_COUNT] = {
+    [MCP_RULE_LIGHT_ON] = "light_on",
+    [MCP_RULE_LIGHT_OFF] = "light_off",
+    [MCP_RULE_FAN_ON] = "fan_on",
+    [MCP_RULE_FAN_OFF] = "fan_off",
+    [MCP_RULE_FAN_SPEED] = "fan_speed",
+};
+
+static struct {
+    mcp_rule_t rules[MCP_RULE_MAX];             // id 为 0 的槽位为空
+    bool latched[MCP_RULE_MAX];                 // 已触发，等待读数回到另一侧
+    int64_t last_fire_us[MCP_RULE_MAX];
+    uint8_t next_id;
+    mcp_rule_action_cb_t action_cb;
+    SemaphoreHandle_t lock;
+} g_rule;
+
+static int name_index(const char *const names[], int count, const char *name) {
+    for (int i = 0; name && i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 整表写入 NVS，调用者持有锁
+static esp_err_t save_locked(void) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(MCP_RULE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = nvs_set_blob(handle, RULE_NVS_KEY, g_rule.rules, sizeof(g_rule.rules));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
+
+static bool rule_valid(const mcp_rule_t *rule) {
+    return rule->sensor < MCP_RULE_SENSOR_COUNT && rule->condition < MCP_RULE_CONDITION_COUNT &&
+           rule->action < MCP_RULE_ACTION_COUNT && rule->cooldown_s <= MCP_RULE_MAX_COOLDOWN_S &&
+           fabsf(rule->threshold) <= MCP_RULE_MAX_ABS_THRESHOLD &&
+           rule->hysteresis >= 0 && rule->hysteresis <= MCP_RULE_MAX_ABS_THRESHOLD &&
+           (rule->action != MCP_RULE_FAN_SPEED || (rule->value >= 1 && rule->value <= 5)) &&
+           memchr(rule->device_id, '\0', sizeof(rule->device_id)) != NULL;
+}
+
+int mcp_rule_init(mcp_rule_action_cb_t action_cb) {
+    if (g_rule.lock) {
+        return 0;
+    }
+
+    g_rule.lock = xSemaphoreCreateMutex();
+    if (!g_rule.lock) {
+        ESP_LOGE(TAG, "Failed to create rule lock");
+        return -1;
+    }
+    g_rule.action_cb = action_cb;
+    g_rule.next_id = 1;
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(MCP_RULE_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No saved rules");
+        return 0;
+    } else if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open rule storage: %s", esp_err_to_name(ret));
+        return -1;
+    }
+
+    size_t len = sizeof(g_rule.rules);
+    ret = nvs_get_blob(handle, RULE_NVS_KEY, g_rule.rules, &len);
+    nvs_close(handle);
+    if (ret != ESP_OK || len != sizeof(g_rule.rules)) {
+        // 没有保存过，或者规则布局已改变
+        memset(g_rule.rules, 0, sizeof(g_rule.rules));
+        ESP_LOGI(TAG, "No saved rules");
+        return 0;
+    }
+
+    int loaded = 0;
+    for (int i = 0; i < MCP_RULE_MAX; i++) {
+        mcp_rule_t *rule = &g_rule.rules[i];
+        if (rule->id && !rule_valid(rule)) {
+            ESP_LOGW(TAG, "Dropping invalid saved rule %d", rule->id);
+            rule->id = 0;
+        }
+        if (rule->id) {
+            loaded++;
+            if (rule->id >= g_rule.next_id) {
+                g_rule.next_id = rule->id + 1;
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "Loaded %d rules", loaded);
+    return 0;
+}
+
+int mcp_rule_add(mcp_rule_t *rule) {
+    if (!rule || !g_rule.lock || !rule_valid(rule)) {
+        return -1;
+    }
+
+    xSemaphoreTake(g_rule.lock, portMAX_DELAY);
+    int slot = -1;
+    for (int i = 0; i < MCP_RULE_MAX; i++) {
+        if (!g_rule.rules[i].id) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        xSemaphoreGive(g_rule.lock);
+        ESP_LOGW(TAG, "Rule table full");
+        return -1;
+    }
+
+    // 分配一个未使用的 id（1-255，表最多 MCP_RULE_MAX 条，总能找到）
+    uint8_t id = g_rule.next_id;
+    while (1) {
+        if (id == 0) {
+            id = 1;
+        }
+        bool in_use = false;
+        for (int i = 0; i < MCP_RULE_MAX; i++) {
+            in_use |= g_rule.rules[i].id == id;
+        }
+        if (!in_use) {
+            break;
+        }
+        id++;
+    }
+    rule->id = id;
+    g_rule.next_id = id + 1;
+
+    g_rule.rules[slot] = *rule;
+    g_rule.latched[slot] = false;
+    g_rule.last_fire_us[slot] = 0;
+    esp_err_t ret = save_locked();
+    if (ret != ESP_OK) {
+        g_rule.rules[slot].id = 0;
+    }
+    xSemaphoreGive(g_rule.lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save rule: %s", esp_err_to_name(ret));
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Rule %d added: %s %s %.1f -> %s", rule->id, g_sensor_names[rule->sensor],
+             g_condition_names[rule->condition], rule->threshold, g_action_names[rule->action]);
+    return 0;
+}
+
+int mcp_rule_remove(uint8_t id) {
+    if (!id || !g_rule.lock) {
+        return -1;
+    }
+
+    xSemaphoreTake(g_rule.lock, portMAX_DELAY);
+    int slot = -1;
+    for (int i = 0; i < MCP_RULE_MAX; i++) {
+        if (g_rule.rules[i].id == id) {
+            slot = i;
+            break;
+        }
+    }
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    if (slot >= 0) {
+        mcp_rule_t removed = g_rule.rules[slot];
+        g_rule.rules[slot].id = 0;
+        ret = save_locked();
+        if (ret != ESP_OK) {
+            g_rule.rules[slot] = removed;
+        }
+    }
+    xSemaphoreGive(g_rule.lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to remove rule %d: %s", id, esp_err_to_name(ret));
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Rule %d removed", id);
+    return 0;
+}
+
+int mcp_rule_list(mcp_rule_t *rules, int max) {
+    if (!rules || !g_rule.lock) {
+        return 0;
+    }
+
+    int count = 0;
+    xSemaphoreTake(g_rule.lock, portMAX_DELAY);
+    for (int i = 0; i < MCP_RULE_MAX && count < max; i++) {
+        if (g_rule.rules[i].id) {
+            rules[count++] = g_rule.rules[i];
+        }
+    }
+    xSemaphoreGive(g_rule.lock);
+    return count;
+}
+
+void mcp_rule_evaluate(float temperature, float humidity) {
+    if (!g_rule.lock) {
+        return;
+    }
+
+    const float values[MCP_RULE_SENSOR_COUNT] = {
+        [MCP_RULE_SENSOR_TEMPERATURE] = temperature,
+        [MCP_RULE_SENSOR_HUMIDITY] = humidity,
+    };
+    mcp_rule_t fired[MCP_RULE_MAX];
+    int fired_count = 0;
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(g_rule.lock, portMAX_DELAY);
+    for (int i = 0; i < MCP_RULE_MAX; i++) {
+        const mcp_rule_t *rule = &g_rule.rules[i];
+        if (!rule->id) {
+            continue;
+        }
+
+        float value = values[rule->sensor];
+        bool above = rule->condition == MCP_RULE_ABOVE;
+        bool met = above ? value > rule->threshold : value < rule->threshold;
+        bool cleared = above ? value < rule->threshold - rule->hysteresis
+                             : value > rule->threshold + rule->hysteresis;
+
+        if (g_rule.latched[i]) {
+            g_rule.latched[i] = !cleared;
+        } else if (met && (!g_rule.last_fire_us[i] ||
+                           now - g_rule.last_fire_us[i] >= (int64_t)rule->cooldown_s * 1000000)) {
+            g_rule.latched[i] = true;
+            g_rule.last_fire_us[i] = now;
+            fired[fired_count++] = *rule;
+        }
+    }
+    xSemaphoreGive(g_rule.lock);
+
+    // 动作在锁外执行，动作中可以查询规则
+    for (int i = 0; i < fired_count; i++) {
+        int ret = g_rule.action_cb ? g_rule.action_cb(&fired[i]) : -1;
+        ESP_LOGI(TAG, "Rule %d fired: %s %.1f %s %.1f -> %s (ret=%d)", fired[i].id,
+                 g_sensor_names[fired[i].sensor], values[fired[i].sensor], g_condition_names[fired[i].condition],
+                 fired[i].threshold, g_action_names[fired[i].action], ret);
+    }
+}
+
+const char *mcp_rule_sensor_name_at(int index) {
+    return index >= 0 && index < MCP_RULE_SENSOR_COUNT ? g_sensor_names[index] : NULL;
+}
+
+const char *mcp_rule_condition_name_at(int index) {
+    return index >= 0 && index < MCP_RULE_CONDITION_COUNT ? g_condition_names[index] : NULL;
+}
+
+const char *mcp_rule_action_name_at(int index) {
+    return index >= 0 && index < MCP_RULE_ACTION_COUNT ? g_action_names[index] : NULL;
+}
+
+int mcp_rule_sensor_from_name(const char *name) {
+    return name_index(g_sensor_names, MCP_RULE_SENSOR_COUNT, name);
+}
+
+int mcp_rule_condition_from_name(const char *name) {
+    return name_index(g_condition_names, MCP_RULE_CONDITION_COUNT, name);
+}
+
+int mcp_rule_action_from_name(const char *name) {
+    return name_index(g_action_names, MCP_RULE_ACTION_COUNT, name);
+}
@@ -0,0 +1,130 @@
+#ifndef _MCP_RULE_H_
+#define _MCP_RULE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 规则引擎配置
+#define MCP_RULE_MAX                8
+#define MCP_RULE_NVS_NAMESPACE      "mcp_rule"
+#define MCP_RULE_DEVICE_ID_LEN      8
+#define MCP_RULE_DEFAULT_HYSTERESIS 0.5f
+#define MCP_RULE_DEFAULT_COOLDOWN_S 60
+#define MCP_RULE_MAX_COOLDOWN_S     43200   // 12 小时
+#define MCP_RULE_MAX_ABS_THRESHOLD  1000.0f
+
+/**
+ * @brief 规则监视的传感器
+ */
+typedef enum {
+    MCP_RULE_SENSOR_TEMPERATURE = 0,
+    MCP_RULE_SENSOR_HUMIDITY,
+    MCP_RULE_SENSOR_COUNT
+} mcp_rule_sensor_t;
+
+/**
+ * @brief 触发条件
+ */
+typedef enum {
+    MCP_RULE_ABOVE = 0,             ///< 高于阈值时触发，低于 阈值-回差 后重新生效
+    MCP_RULE_BELOW,                 ///< 低于阈值时触发，高于 阈值+回差 后重新生效
+    MCP_RULE_CONDITION_COUNT
+} mcp_rule_condition_t;
+
+/**
+ * @brief 触发动作
+ */
+typedef enum {
+    MCP_RULE_LIGHT_ON = 0,
+    MCP_RULE_LIGHT_OFF,
+    MCP_RULE_FAN_ON,
+    MCP_RULE_FAN_OFF,
+    MCP_RULE_FAN_SPEED,             ///< value 为速度 1-5
+    MCP_RULE_ACTION_COUNT
+} mcp_rule_action_t;
+
+/**
+ * @brief 规则（按此布局整表保存到 NVS）
+ */
+typedef struct {
+    uint8_t id;                     ///< 1-255，0 表示空槽位
+    uint8_t sensor;                 ///< mcp_rule_sensor_t
+    uint8_t condition;              ///< mcp_rule_condition_t
+    uint8_t action;                 ///< mcp_rule_action_t
+    int8_t value;                   ///< 动作参数（MCP_RULE_FAN_SPEED 的速度）
+    uint16_t cooldown_s;            ///< 两次触发的最小间隔
+    float threshold;
+    float hysteresis;               ///< >= 0
+    char device_id[MCP_RULE_DEVICE_ID_LEN];     ///< 动作的目标设备，空字符串为实例 0
+} mcp_rule_t;
+
+/**
+ * @brief 执行规则动作，在传感器任务中调用（锁外）
+ * @param rule 触发的规则
+ * @return 0 on success, -1 on failure
+ */
+typedef int (*mcp_rule_action_cb_t)(const mcp_rule_t *rule);
+
+/**
+ * @brief 初始化规则引擎并从 NVS 加载规则
+ * @param action_cb 动作回调
+ * @return 0 on success, -1 on failure
+ */
+int mcp_rule_init(mcp_rule_action_cb_t action_cb);
+
+/**
+ * @brief 添加规则并保存到 NVS
+ * @param rule 规则，id 由规则引擎分配并写回
+ * @return 0 on success, -1 on invalid rule, full table or storage failure
+ */
+int mcp_rule_add(mcp_rule_t *rule);
+
+/**
+ * @brief 删除规则并保存到 NVS
+ * @param id 规则 id
+ * @return 0 on success, -1 if not found or storage failure
+ */
+int mcp_rule_remove(uint8_t id);
+
+/**
+ * @brief 获取所有规则
+ * @param rules 输出数组
+ * @param max 数组长度
+ * @return 规则数
+ */
+int mcp_rule_list(mcp_rule_t *rules, int max);
+
+/**
+ * @brief 用新的传感器读数评估所有规则，触发的规则在返回前执行
+ * @param temperature 温度
+ * @param humidity 湿度
+ */
+void mcp_rule_evaluate(float temperature, float humidity);
+
+/**
+ * @brief 名称表，可作为工具参数的 enum_source
+ * @param index 下标
+ * @return 名称，超出范围时为 NULL
+ */
+const char *mcp_rule_sensor_name_at(int index);
+const char *mcp_rule_condition_name_at(int index);
+const char *mcp_rule_action_name_at(int index);
+
+/**
+ * @brief 按名称查找
+ * @param name 名称
+ * @return 枚举值，未知名称时为 -1
+ */
+int mcp_rule_sensor_from_name(const char *name);
+int mcp_rule_condition_from_name(const char *name);
+int mcp_rule_action_from_name(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_RULE_H_ */
@@ -0,0 +1,208 @@
+/**
+ * @file mcp_scene.c
+ * @brief 场景预设 - 编译期内置场景加上保存在 NVS 中的运行时场景
+ */
+
+#include "mcp_scene.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "mcp_scene";
+
+// 内置场景
+static const mcp_scene_t g_builtin_scenes[] = {
+    {
+        .name = "reading",
+        .light_enabled = true, .light_brightness = 80,
+        .light_red = 255, .light_green = 214, .light_blue = 170,    // 暖白
+        .fan_enabled = false, .fan_speed = 3
+    },
+    {
+        .name = "night",
+        .light_enabled = true, .light_brightness = 10,
+        .light_red = 255, .light_green = 120, .light_blue = 40,     // 低亮度橙光
+        .fan_enabled = true, .fan_speed = 1
+    },
+    {
+        .name = "movie",
+        .light_enabled = true, .light_brightness = 20,
+        .light_red = 80, .light_green = 80, .light_blue = 255,
+        .fan_enabled = true, .fan_speed = 2
+    },
+    {
+        .name = "away",
+        .light_enabled = false, .light_brightness = 50,
+        .light_red = 255, .light_green = 255, .light_blue = 255,
+        .fan_enabled = false, .fan_speed = 3
+    },
+};
+
+#define BUILTIN_SCENE_COUNT (sizeof(g_builtin_scenes) / sizeof(g_builtin_scenes[0]))
+
+// 运行时保存的场景，槽位 i 对应 NVS 键 "s<i>"
+static struct {
+    mcp_scene_t saved[MCP_SCENE_MAX_SAVED];
+    bool used[MCP_SCENE_MAX_SAVED];
+    SemaphoreHandle_t lock;
+} g_scene;
+
+static void slot_key(int slot, char *key, size_t len) {
+    snprintf(key, len, "s%d", slot);
+}
+
+static int find_saved_locked(const char *name) {
+    for (int i = 0; i < MCP_SCENE_MAX_SAVED; i++) {
+        if (g_scene.used[i] && strcmp(g_scene.saved[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const mcp_scene_t *find_builtin(const char *name) {
+    for (int i = 0; i < BUILTIN_SCENE_COUNT; i++) {
+        if (strcmp(g_builtin_scenes[i].name, name) == 0) {
+            return &g_builtin_scenes[i];
+        }
+    }
+    return NULL;
+}
+
+int mcp_scene_init(void) {
+    if (!g_scene.lock) {
+        g_scene.lock = xSemaphoreCreateMutex();
+        if (!g_scene.lock) {
+            ESP_LOGE(TAG, "Failed to create scene lock");
+            return -1;
+        }
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(MCP_SCENE_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        // 还没有保存过场景
+        ESP_LOGI(TAG, "Scenes: %d built-in, 0 saved", (int)BUILTIN_SCENE_COUNT);
+        return 0;
+    } else if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open scene storage: %s", esp_err_to_name(ret));
+        return -1;
+    }
+
+    int loaded = 0;
+    xSemaphoreTake(g_scene.lock, portMAX_DELAY);
+    for (int i = 0; i < MCP_SCENE_MAX_SAVED; i++) {
+        char key[8];
+        size_t len = sizeof(mcp_scene_t);
+        slot_key(i, key, sizeof(key));
+        g_scene.used[i] = nvs_get_blob(handle, key, &g_scene.saved[i], &len) == ESP_OK && len == sizeof(mcp_scene_t);
+        if (g_scene.used[i]) {
+            g_scene.saved[i].name[MCP_SCENE_NAME_LEN - 1] = '\0';
+            loaded++;
+        }
+    }
+    xSemaphoreGive(g_scene.lock);
+    nvs_close(handle);
+
+    ESP_LOGI(TAG, "Scenes: %d built-in, %d saved", (int)BUILTIN_SCENE_COUNT, loaded);
+    return 0;
+}
+
+int mcp_scene_find(const char *name, mcp_scene_t *scene) {
+    if (!name || !scene || !g_scene.lock) {
+        return -1;
+    }
+
+    xSemaphoreTake(g_scene.lock, portMAX_DELAY);
+    int slot = find_saved_locked(name);
+    if (slot >= 0) {
+        *scene = g_scene.saved[slot];
+    }
+    xSemaphoreGive(g_scene.lock);
+    if (slot >= 0) {
+        return 0;
+    }
+
+    const mcp_scene_t *builtin = find_builtin(name);
+    if (builtin) {
+        *scene = *builtin;
+        return 0;
+    }
+    return -1;
+}
+
+int mcp_scene_save(const mcp_scene_t *scene) {
+    if (!scene || scene->name[0] == '\0' || !g_scene.lock) {
+        return -1;
+    }
+
+    xSemaphoreTake(g_scene.lock, portMAX_DELAY);
+    int slot = find_saved_locked(scene->name);
+    for (int i = 0; slot < 0 && i < MCP_SCENE_MAX_SAVED; i++) {
+        if (!g_scene.used[i]) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        xSemaphoreGive(g_scene.lock);
+        ESP_LOGW(TAG, "No free scene slot for '%s'", scene->name);
+        return -1;
+    }
+
+    nvs_handle_t handle;
+    char key[8];
+    slot_key(slot, key, sizeof(key));
+    esp_err_t ret = nvs_open(MCP_SCENE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(handle, key, scene, sizeof(mcp_scene_t));
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (ret == ESP_OK) {
+        g_scene.saved[slot] = *scene;
+        g_scene.used[slot] = true;
+    }
+    xSemaphoreGive(g_scene.lock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save scene '%s': %s", scene->name, esp_err_to_name(ret));
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Scene '%s' saved to slot %d", scene->name, slot);
+    return 0;
+}
+
+const char *mcp_scene_name_at(int index) {
+    if (index < 0) {
+        return NULL;
+    }
+    if (index < BUILTIN_SCENE_COUNT) {
+        return g_builtin_scenes[index].name;
+    }
+    if (!g_scene.lock) {
+        return NULL;
+    }
+
+    // 保存的场景中跳过与内置场景同名的
+    const char *name = NULL;
+    int remaining = index - BUILTIN_SCENE_COUNT;
+    xSemaphoreTake(g_scene.lock, portMAX_DELAY);
+    for (int i = 0; i < MCP_SCENE_MAX_SAVED; i++) {
+        if (!g_scene.used[i] || find_builtin(g_scene.saved[i].name)) {
+            continue;
+        }
+        if (remaining-- == 0) {
+            name = g_scene.saved[i].name;   // 已使用的槽位只会被同名场景覆盖，名称不变
+            break;
+        }
+    }
+    xSemaphoreGive(g_scene.lock);
+
+    return name;
+}
@@ -0,0 +1,62 @@
+#ifndef _MCP_SCENE_H_
+#define _MCP_SCENE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 场景配置
+#define MCP_SCENE_NAME_LEN          16      // 含结尾 '\0'
+#define MCP_SCENE_MAX_SAVED         8       // 运行时保存的场景数上限
+#define MCP_SCENE_NVS_NAMESPACE     "mcp_scene"
+
+/**
+ * @brief 场景：灯光和风扇的完整状态
+ */
+typedef struct {
+    char name[MCP_SCENE_NAME_LEN];
+    bool light_enabled;
+    uint8_t light_brightness;       ///< 0-100%
+    uint8_t light_red;
+    uint8_t light_green;
+    uint8_t light_blue;
+    bool fan_enabled;
+    uint8_t fan_speed;              ///< 1-5
+} mcp_scene_t;
+
+/**
+ * @brief 从 NVS 加载运行时保存的场景（NVS 必须已初始化）
+ * @return 0 on success, -1 on failure
+ */
+int mcp_scene_init(void);
+
+/**
+ * @brief 按名称查找场景（保存的场景优先于内置场景）
+ * @param name 场景名
+ * @param scene 输出
+ * @return 0 on success, -1 if not found
+ */
+int mcp_scene_find(const char *name, mcp_scene_t *scene);
+
+/**
+ * @brief 保存场景到 NVS，同名场景会被覆盖（内置场景也可以被同名保存覆盖）
+ * @param scene 场景
+ * @return 0 on success, -1 on failure
+ */
+int mcp_scene_save(const mcp_scene_t *scene);
+
+/**
+ * @brief 按序号获取场景名，用于枚举所有场景（内置在前，保存的在后，重名只出现一次）
+ * @param index 序号
+ * @return 场景名，超出范围时返回 NULL
+ */
+const char *mcp_scene_name_at(int index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_SCENE_H_ */
@@ -1,5 +1,8 @@
 #include "mcp_sensor.h"
 #include "mcp_server.h"
+#include "mcp_fan_auto.h"
+#include "mcp_history.h"
+#include "mcp_stats.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -31,13 +34,11 @@ static struct {
 /**
  * @brief 生成随机传感器数据
  */
-static void generate_sensor_data(float *temperature, float *humidity) {
+static void generate_sensor_data(uint32_t current_time, float *temperature, float *humidity) {
     static float temp_offset = 0.0f;
     static float humidity_offset = 0.0f;
     static uint32_t last_update_time = 0;
     
-    uint32_t current_time = esp_timer_get_time() / 1000000; // 转换为秒
-    
     // 模拟缓慢变化的环境条件
     if (current_time - last_update_time > 10) { // 每10秒调整一次基础偏移
         temp_offset += ((float)esp_random() / UINT32_MAX - 0.5f) * 0.5f;
@@ -68,6 +69,41 @@ static void generate_sensor_data(float *temperature, float *humidity) {
     if (*humidity < 10.0f) *humidity = 10.0f;
 }
 
+#if CONFIG_MCP_HISTORY_BENCHMARK
+static void benchmark_source(int64_t time_ms, float *temperature, float *humidity) {
+    generate_sensor_data((uint32_t)(time_ms / 1000), temperature, humidity);
+}
+
+/**
+ * @brief 用模拟数据测试历史压缩和 flash 日志，一天的 2 秒样本
+ */
+static void benchmark_history(void) {
+    mcp_history_bench_t result;
+    if (mcp_history_benchmark(benchmark_source, 86400 / 2, SENSOR_UPDATE_INTERVAL_MS, &result) != 0) {
+        ESP_LOGW(TAG, "History benchmark failed: not enough memory");
+        return;
+    }
+    ESP_LOGI(TAG, "History benchmark: %lu samples -> %lu bytes, %.1f bits/sample, %.1fx vs float records, "
+             "encode %lu ns/sample, decode %lu ns/sample, %lu mismatches",
+             (unsigned long)result.samples, (unsigned long)result.encoded_bytes, result.bits_per_sample,
+             result.ratio, (unsigned long)result.encode_ns, (unsigned long)result.decode_ns,
+             (unsigned long)result.mismatches);
+
+    mcp_history_flash_bench_t flash;
+    if (mcp_history_benchmark_flash(benchmark_source, 86400 / 2, SENSOR_UPDATE_INTERVAL_MS, 100, &flash) != 0) {
+        ESP_LOGW(TAG, "Flash log benchmark failed: no history partition");
+        return;
+    }
+    ESP_LOGI(TAG, "Flash log benchmark: %lu pages, %lu payload bytes -> %lu written (%.2fx), %lu erased, "
+             "append %lu us/page, 1 h query %lu us, %lu bytes read, %lu samples",
+             (unsigned long)flash.pages, (unsigned long)flash.payload_bytes,
+             (unsigned long)flash.flash_bytes_written, flash.write_amplification,
+             (unsigned long)flash.flash_bytes_erased, (unsigned long)flash.append_us,
+             (unsigned long)flash.query_us, (unsigned long)flash.query_bytes_read,
+             (unsigned long)flash.query_samples);
+}
+#endif
+
 /**
  * @brief 传感器数据采集任务
  */
@@ -78,7 +114,7 @@ static void sensor_task(void *pvParameters) {
         float temperature, humidity;
         
         // 生成传感器数据
-        generate_sensor_data(&temperature, &humidity);
+        generate_sensor_data(esp_timer_get_time() / 1000000, &temperature, &humidity);
         
         // 更新全局状态
         if (xSemaphoreTake(g_sensor.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
@@ -86,11 +122,18 @@ static void sensor_task(void *pvParameters) {
             g_sensor.humidity = humidity;
             xSemaphoreGive(g_sensor.mutex);
             
+            int64_t now_ms = esp_timer_get_time() / 1000;
+            mcp_history_append(now_ms, temperature, humidity);
+            mcp_stats_add(now_ms, temperature, humidity);
+            
             // 调用回调函数更新 MCP 服务器
             if (g_sensor.update_callback) {
                 g_sensor.update_callback(temperature, humidity);
             }
             
+            // 风扇自动调速（未开启时直接返回）
+            mcp_fan_auto_sample(temperature);
+            
             // ESP_LOGI(TAG, "Sensor data updated: T=%.1f°C, H=%.1f%%", 
             //         temperature, humidity);
         }
@@ -115,6 +158,16 @@ int mcp_sensor_init(void) {
         return -1;
     }
     
+    if (mcp_history_init() != 0) {
+        ESP_LOGW(TAG, "Sensor history unavailable");
+    }
+    if (mcp_stats_init() != 0) {
+        ESP_LOGW(TAG, "Sensor statistics unavailable");
+    }
+#if CONFIG_MCP_HISTORY_BENCHMARK
+    benchmark_history();
+#endif
+    
     // 初始化传感器数据
     g_sensor.temperature = BASE_TEMPERATURE;
     g_sensor.humidity = BASE_HUMIDITY;
@@ -1,34 +1,142 @@
 #include "mcp_server.h"
 #include "mcp_websocket.h"
+#include "mcp_log.h"
+#include "mcp_timer.h"
+#include "mcp_actuator.h"
+#include "mcp_scene.h"
+#include "mcp_persist.h"
+#include "mcp_effect.h"
+#include "mcp_idem.h"
+#include "mcp_rule.h"
+#include "mcp_fan_auto.h"
+#include "mcp_history.h"
+#include "mcp_stats.h"
 #include "esp_log.h"
 
 #include "cJSON.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_timer.h"
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <math.h>
 
 static const char *TAG = "mcp_server";
 
+// 状态字段表：用于变更检测、序列化和持久化，新增字段时同步添加
+typedef enum {
+    STATUS_FIELD_BOOL = 0,
+    STATUS_FIELD_INT,
+    STATUS_FIELD_UINT32,
+    STATUS_FIELD_FLOAT
+} status_field_type_t;
+
+typedef struct {
+    const char *name;
+    status_field_type_t type;
+    size_t offset;
+    size_t size;
+    const char *nvs_key;        // 持久化的 NVS 键 (最长 15 字符)，NULL 表示不持久化
+} status_field_t;
+
+#define STATUS_FIELD(field, t, key) \
+    { #field, STATUS_FIELD_##t, offsetof(mcp_device_status_t, field), sizeof(((mcp_device_status_t *)0)->field), key }
+
+static const status_field_t g_status_fields[] = {
+    STATUS_FIELD(light_enabled, BOOL, "l_on"),
+    STATUS_FIELD(light_brightness, INT, "l_bri"),
+    STATUS_FIELD(light_red, INT, "l_r"),
+    STATUS_FIELD(light_green, INT, "l_g"),
+    STATUS_FIELD(light_blue, INT, "l_b"),
+    STATUS_FIELD(fan_enabled, BOOL, "f_on"),
+    STATUS_FIELD(fan_speed, INT, "f_spd"),
+    STATUS_FIELD(fan_timer_minutes, INT, NULL),     // 定时器不跨重启
+    STATUS_FIELD(fan_timer_start, UINT32, NULL),
+    STATUS_FIELD(temperature, FLOAT, NULL),
+    STATUS_FIELD(humidity, FLOAT, NULL),
+    STATUS_FIELD(last_sensor_update, UINT32, NULL),
+};
+
+_Static_assert(sizeof(g_status_fields) / sizeof(g_status_fields[0]) <= 32, "dirty mask is 32 bits");
+
+#define STATUS_FIELD_COUNT (sizeof(g_status_fields) / sizeof(g_status_fields[0]))
+
+// 设备注册表：同类设备的各个实例按 struct-of-arrays 存放，
+// "全部关闭" 和状态序列化都是对几个小数组的顺序遍历
+typedef struct {
+    mcp_light_table_t lights;
+    mcp_fan_table_t fans;
+} device_registry_t;
+
+_Static_assert(CONFIG_MCP_LIGHT_COUNT >= 1 && CONFIG_MCP_LIGHT_COUNT <= MCP_MAX_LIGHTS, "CONFIG_MCP_LIGHT_COUNT out of range");
+_Static_assert(CONFIG_MCP_FAN_COUNT >= 1 && CONFIG_MCP_FAN_COUNT <= MCP_MAX_FANS, "CONFIG_MCP_FAN_COUNT out of range");
+_Static_assert(MCP_MAX_LIGHTS <= MCP_ACTUATOR_MAX_INSTANCES && MCP_MAX_FANS <= MCP_ACTUATOR_MAX_INSTANCES,
+               "one actuator slot per instance");
+
+static const char *const g_light_ids[MCP_MAX_LIGHTS] = { "light0", "light1", "light2", "light3" };
+static const char *const g_fan_ids[MCP_MAX_FANS] = { "fan0", "fan1" };
+
+// 状态快照：状态本身加版本号。version 在每次有字段变化的提交时递增，
+// field_version[i] 记录字段 i 最后一次变化时的 version，devices_version 记录注册表最后一次变化时的 version
+typedef struct {
+    mcp_device_status_t status;
+    device_registry_t devices;
+    uint32_t version;
+    uint32_t field_version[STATUS_FIELD_COUNT];
+    uint32_t devices_version;
+} status_snapshot_t;
+
 // Global device status
-static mcp_device_status_t g_device_status = {
-    .light_enabled = false,
-    .light_brightness = 50,   // Default 50% brightness
-    .light_red = 255,
-    .light_green = 255,
-    .light_blue = 255,        // Default white light
-    .fan_enabled = false,
-    .fan_speed = 3,           // Default medium speed
-    .fan_timer_minutes = 0,   // No timer by default
-    .fan_timer_start = 0,
-    .temperature = 22.5f,     // Default temperature
-    .humidity = 45.0f,        // Default humidity
-    .last_sensor_update = 0
+// 双缓冲快照：写者在非活动副本上修改后递增 seq 发布，活动副本为 buf[seq & 1]。
+// 读者复制活动副本，若复制期间 seq 变化则重试，从不阻塞。
+static struct {
+    status_snapshot_t buf[2];
+    uint32_t seq;
+    SemaphoreHandle_t writer_lock;      // 写者之间串行，读者不使用
+} g_status = {
+    .buf[0].status = {
+        .light_enabled = false,
+        .light_brightness = 50,   // Default 50% brightness
+        .light_red = 255,
+        .light_green = 255,
+        .light_blue = 255,        // Default white light
+        .fan_enabled = false,
+        .fan_speed = 3,           // Default medium speed
+        .fan_timer_minutes = 0,   // No timer by default
+        .fan_timer_start = 0,
+        .temperature = 22.5f,     // Default temperature
+        .humidity = 45.0f,        // Default humidity
+        .last_sensor_update = 0
+    },
 };
 
-static SemaphoreHandle_t g_status_mutex = NULL;
+// 风扇定时关闭
+static mcp_timer_t g_fan_off_timer;
+
+// 请求处理任务和待处理消息队列（元素为已认领的接收缓冲区）
+static TaskHandle_t g_request_task = NULL;
+static QueueHandle_t g_request_queue = NULL;
+
+// 控制任务和事件队列。定时器和效果回调在 esp_timer 任务中执行，不能等待写者锁和执行器，
+// 只把事件交给控制任务，由控制任务走正常的控制路径
+typedef enum {
+    CONTROL_EVT_FAN_OFF = 0,    // 风扇定时到期
+    CONTROL_EVT_EFFECT_DONE,    // 灯光效果自然结束
+} control_event_type_t;
+
+typedef struct {
+    control_event_type_t type;
+    uint8_t index;                  // EFFECT_DONE: 灯光实例
+    bool has_final;                 // EFFECT_DONE: final 有效（渐变的终点帧）
+    mcp_effect_frame_t final;
+    uint32_t generation;            // EFFECT_DONE: 效果结束时实例的代号
+} control_event_t;
+
+static TaskHandle_t g_control_task = NULL;
+static QueueHandle_t g_control_queue = NULL;
 
 // WebSocket 相关状态
 static struct {
@@ -41,6 +149,19 @@ static struct {
     .connected = false
 };
 
+// JSON-RPC 响应发送延迟统计（在 WebSocket 发送任务中更新）
+static struct {
+    uint32_t sent;
+    uint32_t failed;
+    uint64_t queue_total_us;
+    uint32_t queue_max_us;
+    uint64_t wire_total_us;
+    uint32_t wire_max_us;
+    portMUX_TYPE lock;
+} g_response_latency = {
+    .lock = portMUX_INITIALIZER_UNLOCKED
+};
+
 // Tool definitions
 static const mcp_tool_t g_tools[] = {
     {
@@ -55,21 +176,48 @@ static const mcp_tool_t g_tools[] = {
         .params = {},
         .param_count = 0
     },
+    {
+        .name = "get_sensor_history",
+        .description = "Get past temperature and humidity, range in seconds before now. Raw samples are kept in "
+                       "flash across reboots (ages exclude power-off time), 1-minute averages cover a day, "
+                       "1-hour averages two weeks",
+        .params = {
+            {.name = "start_s", .type = "number", .description = "Range start, seconds ago (default: oldest sample)", .required = false},
+            {.name = "end_s", .type = "number", .description = "Range end, seconds ago (default 0 = now)", .required = false},
+            {.name = "resolution_s", .type = "number", .description = "Coarsest acceptable spacing in seconds (default: range / max_samples)", .required = false},
+            {.name = "max_samples", .type = "number", .description = "Maximum entries to return 1-120 (default 60)", .required = false}
+        },
+        .param_count = 4
+    },
+    {
+        .name = "get_sensor_stats",
+        .description = "Get temperature and humidity min, max, mean and standard deviation over the last minute, "
+                       "hour or 24 hours, computed on the device",
+        .params = {
+            {.name = "window", .type = "string", .description = "Time window (default: all windows)", .required = false,
+             .enum_source = mcp_stats_window_name_at}
+        },
+        .param_count = 1
+    },
     {
         .name = "light_power_control",
         .description = "Control light power on/off",
         .params = {
-            {.name = "enabled", .type = "boolean", .description = "Enable or disable light", .required = true}
+            {.name = "enabled", .type = "boolean", .description = "Enable or disable light", .required = true},
+            {.name = "device_id", .type = "string", .description = "Light id, or \"all\" for every light (default light0)",
+             .required = false, .enum_source = mcp_server_light_id_at}
         },
-        .param_count = 1
+        .param_count = 2
     },
     {
         .name = "light_brightness_control",
         .description = "Set light brightness level",
         .params = {
-            {.name = "brightness", .type = "number", .description = "Brightness level 0-100%", .required = true}
+            {.name = "brightness", .type = "number", .description = "Brightness level 0-100%", .required = true},
+            {.name = "device_id", .type = "string", .description = "Light id, or \"all\" for every light (default light0)",
+             .required = false, .enum_source = mcp_server_light_id_at}
         },
-        .param_count = 1
+        .param_count = 2
     },
     {
         .name = "light_color_control",
@@ -77,31 +225,132 @@ static const mcp_tool_t g_tools[] = {
         .params = {
             {.name = "red", .type = "number", .description = "Red component 0-255", .required = true},
             {.name = "green", .type = "number", .description = "Green component 0-255", .required = true},
-            {.name = "blue", .type = "number", .description = "Blue component 0-255", .required = true}
+            {.name = "blue", .type = "number", .description = "Blue component 0-255", .required = true},
+            {.name = "device_id", .type = "string", .description = "Light id, or \"all\" for every light (default light0)",
+             .required = false, .enum_source = mcp_server_light_id_at}
+        },
+        .param_count = 4
+    },
+    {
+        .name = "light_set_state",
+        .description = "Set light power, brightness and color in one call. Omitted fields are left unchanged",
+        .params = {
+            {.name = "enabled", .type = "boolean", .description = "true to turn on, false to turn off", .required = false},
+            {.name = "brightness", .type = "number", .description = "Brightness level 0-100", .required = false},
+            {.name = "red", .type = "number", .description = "Red component 0-255", .required = false},
+            {.name = "green", .type = "number", .description = "Green component 0-255", .required = false},
+            {.name = "blue", .type = "number", .description = "Blue component 0-255", .required = false},
+            {.name = "device_id", .type = "string", .description = "Light id, or \"all\" for every light (default light0)",
+             .required = false, .enum_source = mcp_server_light_id_at}
+        },
+        .param_count = 6
+    },
+    {
+        .name = "light_effect",
+        .description = "Run a light effect on the device: fade to a brightness/color, breathe, or cycle colors. "
+                       "Use \"stop\" to end a running effect. Omitted brightness/color use the light's current values",
+        .params = {
+            {.name = "effect", .type = "string", .description = "Effect to run", .required = true,
+             .enum_source = mcp_effect_name_at},
+            {.name = "duration_ms", .type = "number", .description = "Fade time, or breathe/cycle period in ms (200-600000, default 2000)", .required = false},
+            {.name = "repeat", .type = "number", .description = "Breathe/cycle periods to run, 0 = until stopped (default 0)", .required = false},
+            {.name = "brightness", .type = "number", .description = "Fade target, breathe peak or cycle brightness 0-100", .required = false},
+            {.name = "red", .type = "number", .description = "Fade target or breathe color, red 0-255", .required = false},
+            {.name = "green", .type = "number", .description = "Fade target or breathe color, green 0-255", .required = false},
+            {.name = "blue", .type = "number", .description = "Fade target or breathe color, blue 0-255", .required = false},
+            {.name = "device_id", .type = "string", .description = "Light id, or \"all\" for every light (default light0)",
+             .required = false, .enum_source = mcp_server_light_id_at}
+        },
+        .param_count = 8
+    },
+    {
+        .name = "scene_apply",
+        .description = "Apply a named scene that sets light0 and fan0 together",
+        .params = {
+            {.name = "name", .type = "string", .description = "Scene name", .required = true,
+             .enum_source = mcp_scene_name_at}
+        },
+        .param_count = 1
+    },
+    {
+        .name = "scene_save",
+        .description = "Save the current light0 and fan0 state as a named scene",
+        .params = {
+            {.name = "name", .type = "string", .description = "Scene name (max 15 characters)", .required = true}
+        },
+        .param_count = 1
+    },
+    {
+        .name = "rule_add",
+        .description = "Add an on-device automation rule that runs an action when a sensor crosses a threshold. "
+                       "The rule fires once per crossing and re-arms after the reading moves back past the hysteresis",
+        .params = {
+            {.name = "sensor", .type = "string", .description = "Sensor to watch", .required = true,
+             .enum_source = mcp_rule_sensor_name_at},
+            {.name = "condition", .type = "string", .description = "Fire when the reading goes above or below the threshold",
+             .required = true, .enum_source = mcp_rule_condition_name_at},
+            {.name = "threshold", .type = "number", .description = "Threshold in °C or %", .required = true},
+            {.name = "action", .type = "string", .description = "Action to run", .required = true,
+             .enum_source = mcp_rule_action_name_at},
+            {.name = "value", .type = "number", .description = "Fan speed 1-5 for fan_speed", .required = false},
+            {.name = "hysteresis", .type = "number", .description = "Re-arm margin in °C or % (default 0.5)", .required = false},
+            {.name = "cooldown_s", .type = "number", .description = "Minimum seconds between firings (default 60)", .required = false},
+            {.name = "device_id", .type = "string", .description = "Target light/fan id or \"all\" (default light0/fan0)", .required = false}
         },
-        .param_count = 3
+        .param_count = 8
+    },
+    {
+        .name = "rule_list",
+        .description = "List the on-device automation rules",
+        .params = {},
+        .param_count = 0
+    },
+    {
+        .name = "rule_remove",
+        .description = "Remove an on-device automation rule",
+        .params = {
+            {.name = "id", .type = "number", .description = "Rule id from rule_add or rule_list", .required = true}
+        },
+        .param_count = 1
     },
     {
         .name = "fan_power_control",
         .description = "Control fan power on/off",
         .params = {
-            {.name = "enabled", .type = "boolean", .description = "Enable or disable fan", .required = true}
+            {.name = "enabled", .type = "boolean", .description = "Enable or disable fan", .required = true},
+            {.name = "device_id", .type = "string", .description = "Fan id, or \"all\" for every fan (default fan0)",
+             .required = false, .enum_source = mcp_server_fan_id_at}
         },
-        .param_count = 1
+        .param_count = 2
     },
     {
         .name = "fan_speed_control",
         .description = "Set fan speed level",
         .params = {
-            {.name = "speed", .type = "number", .description = "Fan speed level 1-5", .required = true}
+            {.name = "speed", .type = "number", .description = "Fan speed level 1-5", .required = true},
+            {.name = "device_id", .type = "string", .description = "Fan id, or \"all\" for every fan (default fan0)",
+             .required = false, .enum_source = mcp_server_fan_id_at}
         },
-        .param_count = 1
+        .param_count = 2
+    },
+    {
+        .name = "fan_auto_mode",
+        .description = "Let fan0 follow the temperature: a PI controller picks speed 1-5 on each sensor sample "
+                       "and turns the fan off below the setpoint. Manual fan0 commands, rules and the fan timer are overridden at the next sample while it is on",
+        .params = {
+            {.name = "enabled", .type = "boolean", .description = "Enable or disable automatic fan speed", .required = true},
+            {.name = "setpoint", .type = "number", .description = "Target temperature 5-40 °C (default 25)", .required = false},
+            {.name = "kp", .type = "number", .description = "Proportional gain 0-10 speed levels per °C (default 1)", .required = false},
+            {.name = "ki", .type = "number", .description = "Integral gain 0-1 speed levels per °C·s (default 0.01)", .required = false},
+            {.name = "dwell_s", .type = "number", .description = "Minimum seconds between speed steps 0-600 (default 30)", .required = false}
+        },
+        .param_count = 5
     },
     {
         .name = "fan_timer_control",
-        .description = "Set fan timer in minutes",
+        .description = "Set fan0 auto-off timer in minutes",
         .params = {
-            {.name = "minutes", .type = "number", .description = "Timer in minutes (0 to disable timer)", .required = true}
+            {.name = "minutes", .type = "number", .description = "Timer in minutes (0 to disable timer, max 1440)", .required = true}
         },
         .param_count = 1
     }
@@ -114,9 +363,26 @@ static const mcp_resource_t g_resources[] = {
     {
         .uri = "device://status",
         .name = "Device Status",
-        .description = "Real-time device status including sensors and controls",
+        .description = "Real-time device status including sensors and controls, with every light and fan "
+                       "instance under lights/fans. Pass sinceVersion to get only the fields changed after that version",
+        .mime_type = "application/json"
+    },
+    {
+        .uri = "device://history",
+        .name = "Sensor History",
+        .description = "Past temperature and humidity samples, ages in seconds before now. "
+                       "Pass startSeconds/endSeconds/resolutionSeconds/maxSamples to select a range "
+                       "(default: last hour, 60 entries)",
         .mime_type = "application/json"
     },
+    {
+        .uri = "device://sensor/history",
+        .name = "Sensor History Export",
+        .description = "All raw samples in a range, streamed. Pass startSeconds/endSeconds (default: all), "
+                       "downsample (average N samples) and format csv or binary (base64 of 8-byte LE records: "
+                       "uint32 age_s, int16 temperature, int16 humidity in 0.01 units)",
+        .mime_type = "text/csv"
+    },
     {
         .uri = "device://sensors", 
         .name = "Environmental Sensors",
@@ -133,6 +399,9 @@ static const mcp_resource_t g_resources[] = {
 
 #define RESOURCE_COUNT (sizeof(g_resources) / sizeof(g_resources[0]))
 
+static esp_err_t post_device_state(const device_registry_t *devices, uint32_t light_mask, uint32_t fan_mask);
+static bool light_update_valid(const mcp_light_update_t *update);
+
 // Utility functions
 static cJSON* create_error_response(int id, int code, const char* message);
 static cJSON* create_success_response(int id, cJSON* result);
@@ -145,6 +414,10 @@ static cJSON* process_call_tool_request(cJSON *request, int id);
 static cJSON* process_list_resources_request(cJSON *request, int id);
 static cJSON* process_read_resource_request(cJSON *request, int id);
 static void mcp_websocket_event_handler(mcp_ws_event_t *event);
+static void mcp_log_notification_sink(esp_log_level_t level, const char *tag, const char *message);
+static void mcp_response_sent_cb(const mcp_ws_send_result_t *result, void *cookie);
+static void handle_mcp_message(mcp_ws_rx_buffer_t *buffer);
+static void mcp_request_task(void *pvParameters);
 
 static cJSON* create_error_response(int id, int code, const char* message) {
     cJSON *response = cJSON_CreateObject();
@@ -168,12 +441,881 @@ static cJSON* create_success_response(int id, cJSON* result) {
     return response;
 }
 
+static void status_read(status_snapshot_t *out) {
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&g_status.seq, __ATOMIC_ACQUIRE);
+        *out = g_status.buf[seq & 1];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&g_status.seq, __ATOMIC_RELAXED) != seq);
+}
+
+/**
+ * @brief 开始一次状态更新，返回可修改的副本（已复制当前状态）
+ * 必须与 status_write_commit() 成对调用，期间不能调用其他写者
+ */
+static mcp_device_status_t *status_write_begin(void) {
+    xSemaphoreTake(g_status.writer_lock, portMAX_DELAY);
+    uint32_t seq = g_status.seq;
+    status_snapshot_t *next = &g_status.buf[(seq + 1) & 1];
+    *next = g_status.buf[seq & 1];
+    return &next->status;
+}
+
+// 本次更新中的设备注册表，只能在 status_write_begin() 与 commit/abort 之间使用
+static device_registry_t *status_write_devices(void) {
+    return &g_status.buf[(g_status.seq + 1) & 1].devices;
+}
+
+// 实例 0 镜像到单实例字段，字段表的版本和持久化对 light0/fan0 照常工作
+static void devices_to_status(const device_registry_t *devices, mcp_device_status_t *status) {
+    status->light_enabled = devices->lights.enabled[0];
+    status->light_brightness = devices->lights.brightness[0];
+    status->light_red = devices->lights.red[0];
+    status->light_green = devices->lights.green[0];
+    status->light_blue = devices->lights.blue[0];
+    status->fan_enabled = devices->fans.enabled[0];
+    status->fan_speed = devices->fans.speed[0];
+}
+
+static void light_from_status(mcp_light_table_t *lights, int index, const mcp_device_status_t *status) {
+    lights->enabled[index] = status->light_enabled;
+    lights->brightness[index] = status->light_brightness;
+    lights->red[index] = status->light_red;
+    lights->green[index] = status->light_green;
+    lights->blue[index] = status->light_blue;
+}
+
+static void fan_from_status(mcp_fan_table_t *fans, int index, const mcp_device_status_t *status) {
+    fans->enabled[index] = status->fan_enabled;
+    fans->speed[index] = status->fan_speed;
+}
+
+// 放弃本次更新（不发布）
+static void status_write_abort(void) {
+    xSemaphoreGive(g_status.writer_lock);
+}
+
+// 发布本次更新并释放写者锁，返回需要持久化的字段掩码
+static uint32_t status_write_publish(void) {
+    uint32_t seq = g_status.seq;
+    const status_snapshot_t *cur = &g_status.buf[seq & 1];
+    status_snapshot_t *next = &g_status.buf[(seq + 1) & 1];
+
+    devices_to_status(&next->devices, &next->status);
+    
+    // 只给实际变化的字段打上新版本；没有变化时不发布，版本号保持不变
+    bool changed = false;
+    uint32_t dirty = 0;
+    for (size_t i = 0; i < STATUS_FIELD_COUNT; i++) {
+        const status_field_t *field = &g_status_fields[i];
+        if (memcmp((const uint8_t *)&cur->status + field->offset,
+                   (const uint8_t *)&next->status + field->offset, field->size) != 0) {
+            next->field_version[i] = cur->version + 1;
+            changed = true;
+            if (field->nvs_key) {
+                dirty |= 1UL << i;
+            }
+        }
+    }
+    if (memcmp(&cur->devices, &next->devices, sizeof(device_registry_t)) != 0) {
+        next->devices_version = cur->version + 1;
+        changed = true;
+    }
+    if (changed) {
+        next->version = cur->version + 1;
+        __atomic_store_n(&g_status.seq, seq + 1, __ATOMIC_RELEASE);
+    }
+    xSemaphoreGive(g_status.writer_lock);
+    return dirty;
+}
+
+static void status_write_commit(void) {
+    mcp_persist_mark_dirty(status_write_publish());
+}
+
+// 持久化任务回调：写入修改过的字段（bool/int 统一存为 i32）
+static esp_err_t status_persist_flush(nvs_handle_t handle, uint32_t dirty_mask) {
+    status_snapshot_t snapshot;
+    status_read(&snapshot);
+    
+    for (size_t i = 0; i < STATUS_FIELD_COUNT; i++) {
+        const status_field_t *field = &g_status_fields[i];
+        if (!(dirty_mask & (1UL << i)) || !field->nvs_key) {
+            continue;
+        }
+        const void *value = (const uint8_t *)&snapshot.status + field->offset;
+        int32_t stored = field->type == STATUS_FIELD_BOOL ? *(const bool *)value : *(const int *)value;
+        esp_err_t ret = nvs_set_i32(handle, field->nvs_key, stored);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+// 启动时从 NVS 恢复持久化的字段，并把恢复后的状态下发给执行器。
+// 所有实例以默认状态启动，持久化的字段只覆盖 light0/fan0
+static void status_restore(void) {
+    int restored = 0;
+    mcp_device_status_t *status = status_write_begin();
+    device_registry_t *devices = status_write_devices();
+    devices->lights.count = CONFIG_MCP_LIGHT_COUNT;
+    devices->fans.count = CONFIG_MCP_FAN_COUNT;
+    for (int i = 0; i < devices->lights.count; i++) {
+        light_from_status(&devices->lights, i, status);
+    }
+    for (int i = 0; i < devices->fans.count; i++) {
+        fan_from_status(&devices->fans, i, status);
+    }
+    
+    for (size_t i = 0; i < STATUS_FIELD_COUNT; i++) {
+        const status_field_t *field = &g_status_fields[i];
+        int32_t stored;
+        if (!field->nvs_key || mcp_persist_get_i32(field->nvs_key, &stored) != 0) {
+            continue;
+        }
+        void *value = (uint8_t *)status + field->offset;
+        if (field->type == STATUS_FIELD_BOOL) {
+            *(bool *)value = stored != 0;
+        } else {
+            *(int *)value = stored;
+        }
+        restored++;
+    }
+    
+    // NVS 中的值可能来自旧固件或已损坏，超出范围时恢复默认值
+    const mcp_device_status_t *defaults = &g_status.buf[g_status.seq & 1].status;
+    mcp_light_update_t light = {
+        .enabled = status->light_enabled,
+        .brightness = status->light_brightness,
+        .red = status->light_red,
+        .green = status->light_green,
+        .blue = status->light_blue,
+    };
+    if (!light_update_valid(&light)) {
+        ESP_LOGW(TAG, "Invalid persisted light state %d%% RGB(%d, %d, %d), using defaults",
+                 light.brightness, light.red, light.green, light.blue);
+        status->light_enabled = defaults->light_enabled;
+        status->light_brightness = defaults->light_brightness;
+        status->light_red = defaults->light_red;
+        status->light_green = defaults->light_green;
+        status->light_blue = defaults->light_blue;
+    }
+    if (status->fan_speed < 1 || status->fan_speed > 5) {
+        ESP_LOGW(TAG, "Invalid persisted fan speed %d, using default", status->fan_speed);
+        status->fan_speed = defaults->fan_speed;
+    }
+    
+    light_from_status(&devices->lights, 0, status);
+    fan_from_status(&devices->fans, 0, status);
+    post_device_state(devices, UINT32_MAX, UINT32_MAX);
+    // 恢复的值本来就在 NVS 中，不标记为待持久化
+    status_write_publish();
+    
+    ESP_LOGI(TAG, "Restored %d persisted state fields, %d lights, %d fans",
+             restored, devices->lights.count, devices->fans.count);
+}
+
+static void status_field_to_json(cJSON *object, const status_field_t *field, const mcp_device_status_t *status) {
+    const void *value = (const uint8_t *)status + field->offset;
+    switch (field->type) {
+        case STATUS_FIELD_BOOL:
+            cJSON_AddBoolToObject(object, field->name, *(const bool *)value);
+            break;
+        case STATUS_FIELD_INT:
+            cJSON_AddNumberToObject(object, field->name, *(const int *)value);
+            break;
+        case STATUS_FIELD_UINT32:
+            cJSON_AddNumberToObject(object, field->name, *(const uint32_t *)value);
+            break;
+        case STATUS_FIELD_FLOAT:
+            cJSON_AddNumberToObject(object, field->name, *(const float *)value);
+            break;
+    }
+}
+
+static void devices_to_json(cJSON *object, const device_registry_t *devices) {
+    cJSON *lights = cJSON_CreateArray();
+    for (int i = 0; i < devices->lights.count; i++) {
+        cJSON *light = cJSON_CreateObject();
+        cJSON_AddStringToObject(light, "id", g_light_ids[i]);
+        cJSON_AddBoolToObject(light, "enabled", devices->lights.enabled[i]);
+        cJSON_AddNumberToObject(light, "brightness", devices->lights.brightness[i]);
+        cJSON_AddNumberToObject(light, "red", devices->lights.red[i]);
+        cJSON_AddNumberToObject(light, "green", devices->lights.green[i]);
+        cJSON_AddNumberToObject(light, "blue", devices->lights.blue[i]);
+        cJSON_AddItemToArray(lights, light);
+    }
+    cJSON_AddItemToObject(object, "lights", lights);
+    
+    cJSON *fans = cJSON_CreateArray();
+    for (int i = 0; i < devices->fans.count; i++) {
+        cJSON *fan = cJSON_CreateObject();
+        cJSON_AddStringToObject(fan, "id", g_fan_ids[i]);
+        cJSON_AddBoolToObject(fan, "enabled", devices->fans.enabled[i]);
+        cJSON_AddNumberToObject(fan, "speed", devices->fans.speed[i]);
+        cJSON_AddItemToArray(fans, fan);
+    }
+    cJSON_AddItemToObject(object, "fans", fans);
+}
+
+// 把相对当前时间的秒数范围转换为历史时间
+// 之前启动的历史时间为负，年龄按累计运行时间计算（不含断电时间）；未指定起点表示全部历史
+static void history_range(int64_t now_ms, double start_s, double end_s, int64_t *from_ms, int64_t *to_ms) {
+    *from_ms = start_s >= 0 && start_s < 1e12 ? now_ms - (int64_t)(start_s * 1000) : INT64_MIN;
+    *to_ms = end_s < 1e12 ? now_ms - (int64_t)(end_s * 1000) : INT64_MIN;
+}
+
+// 历史查询结果：按列输出样本年龄 (s) 和读数，年龄为相对当前时间的秒数；
+// 条目是汇总值时同时输出样本数和最小/最大值
+static cJSON *history_to_json(double start_s, double end_s, double resolution_s, int max_samples) {
+    static mcp_history_sample_t samples[MCP_HISTORY_MAX_QUERY];
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    int64_t from_ms, to_ms;
+    history_range(now_ms, start_s, end_s, &from_ms, &to_ms);
+    uint32_t resolution_ms = resolution_s > 0 && resolution_s < UINT32_MAX / 1000 ? (uint32_t)(resolution_s * 1000) : 0;
+    if (max_samples < 1 || max_samples > MCP_HISTORY_MAX_QUERY) {
+        max_samples = MCP_HISTORY_MAX_QUERY;
+    }
+
+    // 只在请求任务中调用，静态缓冲区避免占用任务栈
+    uint32_t total = 0;
+    mcp_history_tier_t tier;
+    int count = mcp_history_query(from_ms, to_ms, resolution_ms, samples, max_samples, &total, &tier);
+    bool aggregated = false;
+    for (int i = 0; i < count; i++) {
+        aggregated |= samples[i].count > 1;
+    }
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "tier", mcp_history_tier_name_at(tier));
+    cJSON_AddNumberToObject(json, "total", total);
+    cJSON_AddNumberToObject(json, "returned", count);
+    cJSON *ages = cJSON_AddArrayToObject(json, "age_s");
+    cJSON *temperatures = cJSON_AddArrayToObject(json, "temperature");
+    cJSON *humidities = cJSON_AddArrayToObject(json, "humidity");
+    cJSON *counts = aggregated ? cJSON_AddArrayToObject(json, "count") : NULL;
+    cJSON *temperature_min = aggregated ? cJSON_AddArrayToObject(json, "temperature_min") : NULL;
+    cJSON *temperature_max = aggregated ? cJSON_AddArrayToObject(json, "temperature_max") : NULL;
+    cJSON *humidity_min = aggregated ? cJSON_AddArrayToObject(json, "humidity_min") : NULL;
+    cJSON *humidity_max = aggregated ? cJSON_AddArrayToObject(json, "humidity_max") : NULL;
+    for (int i = 0; i < count; i++) {
+        const mcp_history_sample_t *sample = &samples[i];
+        cJSON_AddItemToArray(ages, cJSON_CreateNumber((double)((now_ms - sample->time_ms) / 1000)));
+        cJSON_AddItemToArray(temperatures, cJSON_CreateNumber(round(sample->temperature * 100.0) / 100.0));
+        cJSON_AddItemToArray(humidities, cJSON_CreateNumber(round(sample->humidity * 100.0) / 100.0));
+        if (aggregated) {
+            cJSON_AddItemToArray(counts, cJSON_CreateNumber(sample->count));
+            cJSON_AddItemToArray(temperature_min, cJSON_CreateNumber(round(sample->temperature_min * 100.0) / 100.0));
+            cJSON_AddItemToArray(temperature_max, cJSON_CreateNumber(round(sample->temperature_max * 100.0) / 100.0));
+            cJSON_AddItemToArray(humidity_min, cJSON_CreateNumber(round(sample->humidity_min * 100.0) / 100.0));
+            cJSON_AddItemToArray(humidity_max, cJSON_CreateNumber(round(sample->humidity_max * 100.0) / 100.0));
+        }
+    }
+    return json;
+}
+
+// 历史导出 (device://sensor/history)：样本逐条格式化到帧缓冲区，帧满时作为一个分片发送，
+// 整个响应不在内存中生成
+#define HISTORY_EXPORT_URI "device://sensor/history"
+
+typedef enum {
+    HISTORY_EXPORT_CSV = 0,
+    HISTORY_EXPORT_BINARY,      // base64 编码的 8 字节记录
+} history_export_format_t;
+
+typedef struct {
+    int64_t from_ms;
+    int64_t to_ms;
+    uint32_t downsample;
+    history_export_format_t format;
+    const char *error;          // 参数错误时发送的错误信息
+} history_export_request_t;
+
+static struct {
+    char frame[MCP_SERVER_EXPORT_FRAME_SIZE];
+    size_t len;
+    int64_t now_ms;
+    history_export_format_t format;
+    bool aggregated;
+    uint8_t pending[3];         // base64 未满 3 字节的输入
+    int pending_len;
+    esp_err_t error;
+} g_export_stream;
+
+static void export_put(const char *data, size_t len) {
+    while (len > 0 && g_export_stream.error == ESP_OK) {
+        size_t n = sizeof(g_export_stream.frame) - g_export_stream.len;
+        n = n < len ? n : len;
+        memcpy(g_export_stream.frame + g_export_stream.len, data, n);
+        g_export_stream.len += n;
+        data += n;
+        len -= n;
+        if (g_export_stream.len == sizeof(g_export_stream.frame)) {
+            g_export_stream.error = mcp_websocket_stream_write(g_export_stream.frame, g_export_stream.len);
+            g_export_stream.len = 0;
+        }
+    }
+}
+
+// 流式 base64 编码，flush 时输出剩余字节和填充
+static void export_put_base64(const uint8_t *data, size_t len, bool flush) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (size_t i = 0; i < len || (flush && g_export_stream.pending_len); i++) {
+        if (i < len) {
+            g_export_stream.pending[g_export_stream.pending_len++] = data[i];
+            if (g_export_stream.pending_len < 3) {
+                continue;
+            }
+        }
+        const uint8_t *in = g_export_stream.pending;
+        int n = g_export_stream.pending_len;
+        uint32_t bits = (uint32_t)in[0] << 16 | (n > 1 ? (uint32_t)in[1] << 8 : 0) | (n > 2 ? in[2] : 0);
+        char out[4] = {
+            alphabet[(bits >> 18) & 0x3F],
+            alphabet[(bits >> 12) & 0x3F],
+            n > 1 ? alphabet[(bits >> 6) & 0x3F] : '=',
+            n > 2 ? alphabet[bits & 0x3F] : '=',
+        };
+        export_put(out, sizeof(out));
+        g_export_stream.pending_len = 0;
+    }
+}
+
+static bool export_visit(const mcp_history_sample_t *sample, void *ctx) {
+    uint32_t age_s = (uint32_t)((g_export_stream.now_ms - sample->time_ms) / 1000);
+    if (g_export_stream.format == HISTORY_EXPORT_BINARY) {
+        int16_t temperature = (int16_t)lroundf(sample->temperature * 100);
+        int16_t humidity = (int16_t)lroundf(sample->humidity * 100);
+        const uint8_t record[8] = {
+            age_s & 0xFF, (age_s >> 8) & 0xFF, (age_s >> 16) & 0xFF, age_s >> 24,
+            (uint16_t)temperature & 0xFF, (uint16_t)temperature >> 8,
+            (uint16_t)humidity & 0xFF, (uint16_t)humidity >> 8,
+        };
+        export_put_base64(record, sizeof(record), false);
+    } else {
+        // CSV 在 JSON 字符串中，换行写作 \n
+        char line[96];
+        int len;
+        if (g_export_stream.aggregated) {
+            len = snprintf(line, sizeof(line), "%lu,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\\n", (unsigned long)age_s,
+                           sample->temperature, sample->humidity, sample->temperature_min,
+                           sample->temperature_max, sample->humidity_min, sample->humidity_max);
+        } else {
+            len = snprintf(line, sizeof(line), "%lu,%.2f,%.2f\\n", (unsigned long)age_s,
+                           sample->temperature, sample->humidity);
+        }
+        export_put(line, len);
+    }
+    return g_export_stream.error == ESP_OK;
+}
+
+// resources/read 的导出请求在请求任务中流式发送，不生成 cJSON 响应
+static bool parse_history_export(cJSON *request, history_export_request_t *export) {
+    cJSON *method_item = cJSON_GetObjectItem(request, "method");
+    cJSON *params = cJSON_GetObjectItem(request, "params");
+    cJSON *uri_item = cJSON_GetObjectItem(params, "uri");
+    if (!cJSON_IsString(method_item) || strcmp(method_item->valuestring, "resources/read") != 0 ||
+        !cJSON_IsString(uri_item) || strcmp(uri_item->valuestring, HISTORY_EXPORT_URI) != 0) {
+        return false;
+    }
+
+    cJSON *start_item = cJSON_GetObjectItem(params, "startSeconds");
+    cJSON *end_item = cJSON_GetObjectItem(params, "endSeconds");
+    cJSON *downsample_item = cJSON_GetObjectItem(params, "downsample");
+    cJSON *format_item = cJSON_GetObjectItem(params, "format");
+    double start_s = start_item && cJSON_IsNumber(start_item) ? start_item->valuedouble : -1;
+    double end_s = end_item && cJSON_IsNumber(end_item) && end_item->valuedouble > 0 ? end_item->valuedouble : 0;
+    double downsample = downsample_item && cJSON_IsNumber(downsample_item) ? downsample_item->valuedouble : 1;
+
+    memset(export, 0, sizeof(*export));
+    history_range(esp_timer_get_time() / 1000, start_s, end_s, &export->from_ms, &export->to_ms);
+    export->downsample = downsample >= 1 && downsample <= UINT16_MAX ? (uint32_t)downsample : 0;
+    if (!export->downsample) {
+        export->error = "downsample must be between 1 and 65535";
+    }
+    if (format_item && (!cJSON_IsString(format_item) || (strcmp(format_item->valuestring, "csv") != 0 &&
+                                                          strcmp(format_item->valuestring, "binary") != 0))) {
+        export->error = "format must be csv or binary";
+    }
+    if (format_item && cJSON_IsString(format_item) && strcmp(format_item->valuestring, "binary") == 0) {
+        export->format = HISTORY_EXPORT_BINARY;
+    }
+    return true;
+}
+
+// 导出的错误响应，id_json 是序列化的请求 id，原样回显；id 只用于日志和发送回调
+static void send_export_error(int id, const char *id_json, int code, const char *message) {
+    cJSON *response = create_error_response(id, code, message);
+    cJSON *id_item = id_json ? cJSON_CreateRaw(id_json) : NULL;
+    if (id_item) {
+        cJSON_ReplaceItemInObject(response, "id", id_item);
+    }
+    char *response_str = cJSON_PrintUnformatted(response);
+    if (response_str) {
+        mcp_websocket_send_text_ex(response_str, mcp_response_sent_cb, (void *)(intptr_t)id);
+        cJSON_free(response_str);
+    }
+    cJSON_Delete(response);
+}
+
+static void stream_history_export(int id, const char *id_json, const history_export_request_t *export) {
+    if (export->error) {
+        send_export_error(id, id_json, -32602, export->error);
+        return;
+    }
+
+    if (mcp_websocket_stream_begin() != ESP_OK) {
+        return;
+    }
+
+    // 只在请求任务中调用，帧缓冲区是静态的
+    memset(&g_export_stream, 0, sizeof(g_export_stream));
+    g_export_stream.now_ms = esp_timer_get_time() / 1000;
+    g_export_stream.format = export->format;
+    g_export_stream.aggregated = export->downsample > 1;
+
+    bool binary = export->format == HISTORY_EXPORT_BINARY;
+    // 请求的 id 原样回显（数字或字符串），长度不定，单独写入
+    export_put("{\"jsonrpc\":\"2.0\",\"id\":", 22);
+    export_put(id_json, strlen(id_json));
+    char header[160];
+    int len = snprintf(header, sizeof(header),
+                       ",\"result\":{\"contents\":[{\"uri\":\"%s\","
+                       "\"mimeType\":\"%s\",\"%s\":\"", HISTORY_EXPORT_URI,
+                       binary ? "application/octet-stream" : "text/csv", binary ? "blob" : "text");
+    export_put(header, len);
+    if (!binary) {
+        const char *columns = g_export_stream.aggregated
+            ? "age_s,temperature,humidity,temperature_min,temperature_max,humidity_min,humidity_max\\n"
+            : "age_s,temperature,humidity\\n";
+        export_put(columns, strlen(columns));
+    }
+
+    int entries = mcp_history_export(export->from_ms, export->to_ms, export->downsample, export_visit, NULL);
+    if (binary) {
+        export_put_base64(NULL, 0, true);
+    }
+    export_put("\"}]}}", 5);
+
+    // 某一帧发送失败后数据有缺口，不能作为成功的结果结束：放弃流（已有分片时断开连接），
+    // 还没有分片发出时改为发送错误响应
+    if (g_export_stream.error != ESP_OK) {
+        ESP_LOGW(TAG, "History export id=%d aborted: %s", id, esp_err_to_name(g_export_stream.error));
+        if (mcp_websocket_stream_abort() == ESP_OK) {
+            send_export_error(id, id_json, -32603, "History export failed");
+        }
+        return;
+    }
+
+    esp_err_t ret = mcp_websocket_stream_end(g_export_stream.frame, g_export_stream.len,
+                                             mcp_response_sent_cb, (void *)(intptr_t)id);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "History export id=%d incomplete: %s", id, esp_err_to_name(ret));
+    } else {
+        ESP_LOGI(TAG, "History export id=%d: %d entries", id, entries);
+    }
+}
+
+// 解析 device_id：NULL/"" 为实例 0，"all" 为全部实例。返回实例位掩码，未知的 id 返回 0
+static uint32_t device_select(const char *device_id, const char *const ids[], int count) {
+    if (!device_id || device_id[0] == '\0') {
+        return 1;
+    }
+    if (strcmp(device_id, MCP_DEVICE_SELECT_ALL) == 0) {
+        return (1UL << count) - 1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (strcmp(device_id, ids[i]) == 0) {
+            return 1UL << i;
+        }
+    }
+    return 0;
+}
+
+// 工具回复中的设备名称
+static const char *device_label(const char *device_id, const char *single, const char *all) {
+    if (!device_id || device_id[0] == '\0') {
+        return single;
+    }
+    return strcmp(device_id, MCP_DEVICE_SELECT_ALL) == 0 ? all : device_id;
+}
+
+// 等待执行器完成一批命令。post_device_state() 只在写者锁内调用，同一时刻只有一个等待者；
+// 每批命令一个新的代号，超时批次迟到的完成回调带着旧代号，被忽略
+typedef struct {
+    uint32_t generation;
+    esp_err_t result;
+} actuator_batch_done_t;
+
+static struct {
+    QueueHandle_t done_queue;
+    uint32_t generation;
+    int pending;                // 本批次未完成的命令数
+    esp_err_t result;           // 本批次第一个驱动错误
+    portMUX_TYPE lock;
+} g_actuator_wait = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static void actuator_cmd_done(const mcp_actuator_cmd_t *cmd, esp_err_t result, void *cookie) {
+    uint32_t generation = (uint32_t)(uintptr_t)cookie;
+    actuator_batch_done_t done = { .generation = generation };
+    bool finished = false;
+    
+    portENTER_CRITICAL(&g_actuator_wait.lock);
+    if (generation == g_actuator_wait.generation && g_actuator_wait.pending > 0) {
+        // 被后一条命令替换 (ESP_ERR_NOT_FINISHED) 时硬件由后一条命令写入，不算失败
+        if (result != ESP_OK && result != ESP_ERR_NOT_FINISHED && g_actuator_wait.result == ESP_OK) {
+            g_actuator_wait.result = result;
+        }
+        finished = --g_actuator_wait.pending == 0;
+        done.result = g_actuator_wait.result;
+    }
+    portEXIT_CRITICAL(&g_actuator_wait.lock);
+    
+    if (finished) {
+        xQueueSend(g_actuator_wait.done_queue, &done, 0);
+    }
+}
+
 // Public API implementations
+// 状态更新和命令提交在同一次写入中完成，并发的控制调用不会丢失彼此的修改。
+// 每个选中的实例一条命令，一次批量提交，等待驱动写入硬件（最多 MCP_SERVER_ACTUATOR_TIMEOUT_MS）
+static esp_err_t post_device_state(const device_registry_t *devices, uint32_t light_mask, uint32_t fan_mask) {
+    mcp_actuator_cmd_t cmds[MCP_MAX_LIGHTS + MCP_MAX_FANS];
+    int count = 0;
+    
+    // 直接控制灯光时停止其上的效果，取消返回后效果不会再提交帧，下面的命令不会被覆盖
+    mcp_effect_cancel(light_mask);
+    
+    for (int i = 0; i < devices->lights.count; i++) {
+        if (light_mask & (1UL << i)) {
+            cmds[count++] = (mcp_actuator_cmd_t) {
+                .actuator = MCP_ACTUATOR_LIGHT,
+                .index = i,
+                .light = {
+                    .enabled = devices->lights.enabled[i],
+                    .brightness = devices->lights.brightness[i],
+                    .red = devices->lights.red[i],
+                    .green = devices->lights.green[i],
+                    .blue = devices->lights.blue[i],
+                },
+            };
+        }
+    }
+    for (int i = 0; i < devices->fans.count; i++) {
+        if (fan_mask & (1UL << i)) {
+            cmds[count++] = (mcp_actuator_cmd_t) {
+                .actuator = MCP_ACTUATOR_FAN,
+                .index = i,
+                .fan = {
+                    .enabled = devices->fans.enabled[i],
+                    .speed = devices->fans.speed[i],
+                },
+            };
+        }
+    }
+    
+    if (count == 0) {
+        return ESP_OK;
+    }
+    if (!g_actuator_wait.done_queue) {
+        return mcp_actuator_post_batch(cmds, count, NULL, NULL) == 0 ? ESP_OK : ESP_FAIL;
+    }
+    
+    portENTER_CRITICAL(&g_actuator_wait.lock);
+    uint32_t generation = ++g_actuator_wait.generation;
+    g_actuator_wait.pending = count;
+    g_actuator_wait.result = ESP_OK;
+    portEXIT_CRITICAL(&g_actuator_wait.lock);
+    xQueueReset(g_actuator_wait.done_queue);
+    
+    if (mcp_actuator_post_batch(cmds, count, actuator_cmd_done, (void *)(uintptr_t)generation) != 0) {
+        return ESP_FAIL;
+    }
+    
+    esp_err_t ret = ESP_ERR_TIMEOUT;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(MCP_SERVER_ACTUATOR_TIMEOUT_MS);
+    actuator_batch_done_t done;
+    for (;;) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout || xQueueReceive(g_actuator_wait.done_queue, &done, timeout - elapsed) != pdTRUE) {
+            break;
+        }
+        if (done.generation == generation) {
+            ret = done.result;
+            break;
+        }
+    }
+    if (ret == ESP_ERR_TIMEOUT) {
+        ESP_LOGW(TAG, "Actuator commands still pending after %d ms", MCP_SERVER_ACTUATOR_TIMEOUT_MS);
+    } else if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Actuator commands not applied: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+// 超时的命令仍在执行器槽位中，稍后会写入硬件，状态也必须提交，否则硬件与状态不一致；
+// 只有命令没有提交或驱动执行失败时才放弃本次更新
+static bool device_state_posted(esp_err_t err) {
+    return err == ESP_OK || err == ESP_ERR_TIMEOUT;
+}
+
+static bool light_update_valid(const mcp_light_update_t *update) {
+    return update->enabled >= -1 && update->enabled <= 1 &&
+           update->brightness >= -1 && update->brightness <= 100 &&
+           update->red >= -1 && update->red <= 255 &&
+           update->green >= -1 && update->green <= 255 &&
+           update->blue >= -1 && update->blue <= 255;
+}
+
+// 把部分更新应用到 mask 选中的灯光实例
+static int lights_apply(uint32_t mask, const mcp_light_update_t *update, mcp_light_table_t *result) {
+    if (!g_status.writer_lock) {
+        return -1;
+    }
+    
+    status_write_begin();
+    device_registry_t *devices = status_write_devices();
+    mcp_light_table_t *lights = &devices->lights;
+    for (int i = 0; i < lights->count; i++) {
+        if (!(mask & (1UL << i))) {
+            continue;
+        }
+        if (update->enabled >= 0) lights->enabled[i] = update->enabled;
+        if (update->brightness >= 0) lights->brightness[i] = update->brightness;
+        if (update->red >= 0) lights->red[i] = update->red;
+        if (update->green >= 0) lights->green[i] = update->green;
+        if (update->blue >= 0) lights->blue[i] = update->blue;
+    }
+    esp_err_t err = post_device_state(devices, mask, 0);
+    int ret = err == ESP_OK ? 0 : -1;
+    if (ret == 0 && result) {
+        *result = *lights;
+    }
+    if (device_state_posted(err)) {
+        status_write_commit();
+    } else {
+        status_write_abort();
+    }
+    return ret;
+}
+
+// 把部分更新应用到 mask 选中的风扇实例，关闭 fan0 时取消定时关闭
+static int fans_apply(uint32_t mask, const mcp_fan_update_t *update, mcp_fan_table_t *result) {
+    if (!g_status.writer_lock) {
+        return -1;
+    }
+    
+    bool fan0_off = (mask & 1) && update->enabled == 0;
+    mcp_device_status_t *status = status_write_begin();
+    device_registry_t *devices = status_write_devices();
+    mcp_fan_table_t *fans = &devices->fans;
+    for (int i = 0; i < fans->count; i++) {
+        if (!(mask & (1UL << i))) {
+            continue;
+        }
+        if (update->enabled >= 0) fans->enabled[i] = update->enabled;
+        if (update->speed >= 0) fans->speed[i] = update->speed;
+    }
+    if (fan0_off) {
+        status->fan_timer_minutes = 0;
+        status->fan_timer_start = 0;
+    }
+    esp_err_t err = post_device_state(devices, 0, mask);
+    int ret = err == ESP_OK ? 0 : -1;
+    if (ret == 0 && result) {
+        *result = *fans;
+    }
+    if (device_state_posted(err)) {
+        status_write_commit();
+        // 提交之后才取消定时；放弃更新时风扇仍在运行，定时和恢复的定时字段都保留
+        if (fan0_off) {
+            mcp_timer_cancel(&g_fan_off_timer);
+        }
+    } else {
+        status_write_abort();
+    }
+    return ret;
+}
+
+// 效果自然结束：渐变提交终点状态，呼吸/色轮恢复设备状态。在控制任务中执行。
+// 完成事件排队期间启动的新效果或直接控制都会更新实例的代号。效果的启动和取消都在
+// 写者锁内，这里在写者锁内比较代号，过时的完成既不覆盖新的状态，也不会取消新的效果
+static void light_effect_finish(uint8_t index, const mcp_effect_frame_t *final, uint32_t generation) {
+    status_write_begin();
+    if (mcp_effect_generation(index) != generation) {
+        status_write_abort();
+        ESP_LOGD(TAG, "light%d: stale effect completion ignored", index);
+        return;
+    }
+    
+    mcp_light_table_t *lights = &status_write_devices()->lights;
+    if (final) {
+        lights->enabled[index] = true;
+        lights->brightness[index] = final->brightness;
+        lights->red[index] = final->red;
+        lights->green[index] = final->green;
+        lights->blue[index] = final->blue;
+    }
+    if (device_state_posted(post_device_state(status_write_devices(), 1UL << index, 0))) {
+        status_write_commit();
+    } else {
+        status_write_abort();
+    }
+}
+
+// 效果完成回调在 esp_timer 任务中执行，只把完成事件交给控制任务
+static void light_effect_done(uint8_t index, const mcp_effect_frame_t *final, uint32_t generation) {
+    control_event_t event = {
+        .type = CONTROL_EVT_EFFECT_DONE,
+        .index = index,
+        .has_final = final != NULL,
+        .generation = generation,
+    };
+    if (final) {
+        event.final = *final;
+    }
+    if (!g_control_queue || xQueueSend(g_control_queue, &event, 0) != pdTRUE) {
+        // 灯光停在效果的最后一帧，状态保持效果开始前的值，下一次控制会重新同步
+        ESP_LOGW(TAG, "Control queue full, light%d effect completion dropped", index);
+    }
+}
+
+// 规则动作，与工具调用走相同的控制路径
+static int rule_execute(const mcp_rule_t *rule) {
+    const char *device_id = rule->device_id[0] ? rule->device_id : NULL;
+    mcp_light_update_t light = MCP_LIGHT_UPDATE_INIT;
+    mcp_fan_update_t fan = MCP_FAN_UPDATE_INIT;
+    
+    switch (rule->action) {
+        case MCP_RULE_LIGHT_ON:
+        case MCP_RULE_LIGHT_OFF:
+            light.enabled = rule->action == MCP_RULE_LIGHT_ON;
+            return mcp_server_control_lights(device_id, &light, NULL);
+        case MCP_RULE_FAN_ON:
+        case MCP_RULE_FAN_OFF:
+            fan.enabled = rule->action == MCP_RULE_FAN_ON;
+            return mcp_server_control_fans(device_id, &fan, NULL);
+        case MCP_RULE_FAN_SPEED:
+            fan.speed = rule->value;
+            return mcp_server_control_fans(device_id, &fan, NULL);
+        default:
+            return -1;
+    }
+}
+
+// 规则的目标设备必须与动作的设备类型匹配
+static bool rule_target_valid(const mcp_rule_t *rule) {
+    bool light = rule->action == MCP_RULE_LIGHT_ON || rule->action == MCP_RULE_LIGHT_OFF;
+    const char *device_id = rule->device_id[0] ? rule->device_id : NULL;
+    return light ? device_select(device_id, g_light_ids, CONFIG_MCP_LIGHT_COUNT) != 0
+                 : device_select(device_id, g_fan_ids, CONFIG_MCP_FAN_COUNT) != 0;
+}
+
+static void fan_off_timer_expired(void *arg) {
+    control_event_t event = { .type = CONTROL_EVT_FAN_OFF };
+    if (!g_control_queue || xQueueSend(g_control_queue, &event, 0) != pdTRUE) {
+        // 控制任务积压时下一个刻度再试，不在 esp_timer 任务中等待
+        ESP_LOGW(TAG, "Control queue full, retrying fan timer");
+        mcp_timer_arm(&g_fan_off_timer, MCP_TIMER_TICK_MS);
+    }
+}
+
+static void mcp_control_task(void *pvParameters) {
+    control_event_t event;
+    
+    while (1) {
+        if (xQueueReceive(g_control_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        switch (event.type) {
+            case CONTROL_EVT_FAN_OFF:
+                // 到期后事件排队期间又设置了新的定时，以新的定时为准
+                if (mcp_timer_remaining_ms(&g_fan_off_timer) > 0) {
+                    ESP_LOGD(TAG, "Fan timer re-armed, expiry ignored");
+                    break;
+                }
+                ESP_LOGI(TAG, "Fan timer expired, turning fan off");
+                mcp_server_control_fan_power(false);
+                break;
+            case CONTROL_EVT_EFFECT_DONE:
+                light_effect_finish(event.index, event.has_final ? &event.final : NULL, event.generation);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
 int mcp_server_init(void) {
-    if (g_status_mutex == NULL) {
-        g_status_mutex = xSemaphoreCreateMutex();
-        if (g_status_mutex == NULL) {
-            ESP_LOGE(TAG, "Failed to create status mutex");
+    if (g_status.writer_lock == NULL) {
+        g_status.writer_lock = xSemaphoreCreateMutex();
+        if (g_status.writer_lock == NULL) {
+            ESP_LOGE(TAG, "Failed to create status writer lock");
+            return -1;
+        }
+    }
+    
+    if (mcp_timer_service_init() != 0 || mcp_actuator_init() != 0) {
+        return -1;
+    }
+    if (g_actuator_wait.done_queue == NULL) {
+        // 每批命令最多一个完成结果，多出的一个位置留给超时批次迟到的结果
+        g_actuator_wait.done_queue = xQueueCreate(2, sizeof(actuator_batch_done_t));
+        if (g_actuator_wait.done_queue == NULL) {
+            ESP_LOGW(TAG, "Failed to create actuator completion queue, commands are not awaited");
+        }
+    }
+    if (mcp_effect_init(light_effect_done) != 0) {
+        ESP_LOGW(TAG, "Light effects unavailable");
+    }
+    
+    // 在 WebSocket 连接之前恢复上次的设置，之后的修改才开始持久化
+    status_restore();
+    if (mcp_persist_init(status_persist_flush) != 0) {
+        ESP_LOGW(TAG, "State persistence unavailable");
+    }
+    if (mcp_scene_init() != 0) {
+        ESP_LOGW(TAG, "Saved scenes unavailable, built-in scenes only");
+    }
+    if (mcp_rule_init(rule_execute) != 0) {
+        ESP_LOGW(TAG, "Automation rules unavailable");
+    }
+    if (mcp_fan_auto_init() != 0) {
+        ESP_LOGW(TAG, "Fan auto mode unavailable");
+    }
+    mcp_timer_init(&g_fan_off_timer, fan_off_timer_expired, NULL);
+    
+    if (g_control_queue == NULL) {
+        g_control_queue = xQueueCreate(MCP_SERVER_CONTROL_QUEUE_LEN, sizeof(control_event_t));
+        if (g_control_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create control queue");
+            return -1;
+        }
+        if (xTaskCreate(mcp_control_task, "mcp_control", MCP_SERVER_CONTROL_TASK_STACK, NULL,
+                        MCP_SERVER_TASK_PRIORITY, &g_control_task) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create control task");
+            vQueueDelete(g_control_queue);
+            g_control_queue = NULL;
+            return -1;
+        }
+    }
+    
+    if (g_request_queue == NULL) {
+        g_request_queue = xQueueCreate(MCP_WS_RX_BUFFER_COUNT, sizeof(mcp_ws_rx_buffer_t*));
+        if (g_request_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create request queue");
+            return -1;
+        }
+        if (xTaskCreate(mcp_request_task, "mcp_request", MCP_SERVER_TASK_STACK, NULL,
+                        MCP_SERVER_TASK_PRIORITY, &g_request_task) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create request task");
+            vQueueDelete(g_request_queue);
+            g_request_queue = NULL;
             return -1;
         }
     }
@@ -185,144 +1327,290 @@ int mcp_server_init(void) {
 
 
 int mcp_server_get_status(mcp_device_status_t *status) {
-    if (!status || !g_status_mutex) {
+    if (!status) {
         return -1;
     }
     
-    if (xSemaphoreTake(g_status_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+    status_snapshot_t snapshot;
+    status_read(&snapshot);
+    *status = snapshot.status;
+    return 0;
+}
+
+int mcp_server_update_sensors(float temperature, float humidity) {
+    if (!g_status.writer_lock) {
         return -1;
     }
     
-    *status = g_device_status;
-    xSemaphoreGive(g_status_mutex);
+    mcp_device_status_t *status = status_write_begin();
+    status->temperature = temperature;
+    status->humidity = humidity;
+    status->last_sensor_update = esp_timer_get_time() / 1000;
+    status_write_commit();
+    
+    // 本地规则在新读数发布后立即评估，动作在当前（传感器）任务中执行
+    mcp_rule_evaluate(temperature, humidity);
     
+    // ESP_LOGI(TAG, "Sensors updated: T=%.1f°C, H=%.1f%%", temperature, humidity);
     return 0;
 }
 
-int mcp_server_update_sensors(float temperature, float humidity) {
-    if (!g_status_mutex) {
+int mcp_server_control_light_power(bool enabled) {
+    mcp_light_update_t update = MCP_LIGHT_UPDATE_INIT;
+    update.enabled = enabled;
+    int ret = lights_apply(1, &update, NULL);
+    
+    ESP_LOGI(TAG, "Light power control: %s (ret=%d)", enabled ? "enabled" : "disabled", ret);
+    return ret;
+}
+
+int mcp_server_control_light_brightness(int brightness) {
+    if (brightness < 0 || brightness > 100) {
+        ESP_LOGE(TAG, "Invalid brightness: %d%% (range: 0-100)", brightness);
         return -1;
     }
     
-    if (xSemaphoreTake(g_status_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+    mcp_light_update_t update = MCP_LIGHT_UPDATE_INIT;
+    update.brightness = brightness;
+    int ret = lights_apply(1, &update, NULL);
+    
+    ESP_LOGI(TAG, "Light brightness control: %d%% (ret=%d)", brightness, ret);
+    return ret;
+}
+
+int mcp_server_control_light_color(int red, int green, int blue) {
+    if (red < 0 || red > 255 || green < 0 || green > 255 || blue < 0 || blue > 255) {
+        ESP_LOGE(TAG, "Invalid RGB values: (%d, %d, %d) (range: 0-255)", red, green, blue);
         return -1;
     }
     
-    g_device_status.temperature = temperature;
-    g_device_status.humidity = humidity;
-    g_device_status.last_sensor_update = esp_timer_get_time() / 1000;
+    mcp_light_update_t update = MCP_LIGHT_UPDATE_INIT;
+    update.red = red;
+    update.green = green;
+    update.blue = blue;
+    int ret = lights_apply(1, &update, NULL);
     
-    xSemaphoreGive(g_status_mutex);
-    
-    // ESP_LOGI(TAG, "Sensors updated: T=%.1f°C, H=%.1f%%", temperature, humidity);
-    return 0;
+    ESP_LOGI(TAG, "Light color control: RGB(%d, %d, %d) (ret=%d)", red, green, blue, ret);
+    return ret;
 }
 
-int mcp_server_control_light_power(bool enabled) {
-    if (!g_status_mutex) {
+int mcp_server_control_lights(const char *device_id, const mcp_light_update_t *update, mcp_light_table_t *result) {
+    if (!update) {
+        return -1;
+    }
+    
+    if (!light_update_valid(update)) {
+        ESP_LOGE(TAG, "Invalid light state: enabled=%d brightness=%d RGB(%d, %d, %d)",
+                 update->enabled, update->brightness, update->red, update->green, update->blue);
+        return -1;
+    }
+    
+    uint32_t mask = device_select(device_id, g_light_ids, CONFIG_MCP_LIGHT_COUNT);
+    if (!mask) {
+        ESP_LOGE(TAG, "Unknown light: %s", device_id);
         return -1;
     }
     
-    // Send MQTT command
-    cJSON *payload = cJSON_CreateObject();
-    cJSON_AddStringToObject(payload, "command", "light_power_control");
-    cJSON_AddBoolToObject(payload, "enabled", enabled);
+    int ret = lights_apply(mask, update, result);
+    
+    ESP_LOGI(TAG, "Lights control %s: enabled=%d brightness=%d RGB(%d, %d, %d) (ret=%d)",
+             device_label(device_id, g_light_ids[0], MCP_DEVICE_SELECT_ALL),
+             update->enabled, update->brightness, update->red, update->green, update->blue, ret);
+    return ret;
+}
 
-    int ret = 0;
-    cJSON_Delete(payload);
+int mcp_server_control_fans(const char *device_id, const mcp_fan_update_t *update, mcp_fan_table_t *result) {
+    if (!update) {
+        return -1;
+    }
     
-    if (ret == 0) {
-        if (xSemaphoreTake(g_status_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            g_device_status.light_enabled = enabled;
-            xSemaphoreGive(g_status_mutex);
-        }
+    if (update->enabled < -1 || update->enabled > 1 || update->speed == 0 || update->speed < -1 || update->speed > 5) {
+        ESP_LOGE(TAG, "Invalid fan state: enabled=%d speed=%d", update->enabled, update->speed);
+        return -1;
+    }
+    
+    uint32_t mask = device_select(device_id, g_fan_ids, CONFIG_MCP_FAN_COUNT);
+    if (!mask) {
+        ESP_LOGE(TAG, "Unknown fan: %s", device_id);
+        return -1;
     }
     
-    ESP_LOGI(TAG, "Light power control: %s (ret=%d)", enabled ? "enabled" : "disabled", ret);
+    int ret = fans_apply(mask, update, result);
+    
+    ESP_LOGI(TAG, "Fans control %s: enabled=%d speed=%d (ret=%d)",
+             device_label(device_id, g_fan_ids[0], MCP_DEVICE_SELECT_ALL), update->enabled, update->speed, ret);
     return ret;
 }
 
-int mcp_server_control_light_brightness(int brightness) {
-    if (brightness < 0 || brightness > 100) {
-        ESP_LOGE(TAG, "Invalid brightness: %d%% (range: 0-100)", brightness);
+int mcp_server_light_effect(const char *device_id, const mcp_light_effect_t *effect) {
+    mcp_effect_type_t type;
+    if (!effect || mcp_effect_type_from_name(effect->effect, &type) != 0) {
+        ESP_LOGE(TAG, "Unknown light effect: %s", effect && effect->effect ? effect->effect : "NULL");
         return -1;
     }
     
-    if (!g_status_mutex) {
+    int duration_ms = effect->duration_ms >= 0 ? effect->duration_ms : MCP_EFFECT_DEFAULT_DURATION_MS;
+    int repeat = effect->repeat >= 0 ? effect->repeat : 0;
+    if (duration_ms < MCP_EFFECT_MIN_DURATION_MS || duration_ms > MCP_EFFECT_MAX_DURATION_MS ||
+        repeat > MCP_EFFECT_MAX_REPEAT ||
+        effect->brightness < -1 || effect->brightness > 100 ||
+        effect->red < -1 || effect->red > 255 || effect->green < -1 || effect->green > 255 ||
+        effect->blue < -1 || effect->blue > 255) {
+        ESP_LOGE(TAG, "Invalid light effect: %s %d ms, repeat %d, %d%% RGB(%d, %d, %d)", effect->effect,
+                 duration_ms, repeat, effect->brightness, effect->red, effect->green, effect->blue);
         return -1;
     }
     
-    // Send MQTT command
-    cJSON *payload = cJSON_CreateObject();
-    cJSON_AddStringToObject(payload, "command", "light_brightness_control");
-    cJSON_AddNumberToObject(payload, "brightness", brightness);
-
-    int ret = 0;
-    cJSON_Delete(payload);
+    uint32_t mask = device_select(device_id, g_light_ids, CONFIG_MCP_LIGHT_COUNT);
+    if (!mask) {
+        ESP_LOGE(TAG, "Unknown light: %s", device_id);
+        return -1;
+    }
     
-    if (ret == 0) {
-        if (xSemaphoreTake(g_status_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            g_device_status.light_brightness = brightness;
-            xSemaphoreGive(g_status_mutex);
+    if (!g_status.writer_lock) {
+        return -1;
+    }
+    
+    int ret = 0;
+    if (type == MCP_EFFECT_NONE) {
+        // 重新下发设备状态，同时取消效果
+        mcp_light_update_t update = MCP_LIGHT_UPDATE_INIT;
+        ret = lights_apply(mask, &update, NULL);
+    } else {
+        // 在写者锁内启动，与直接控制和效果完成的处理互斥（见 light_effect_finish）
+        status_write_begin();
+        const mcp_light_table_t *lights = &status_write_devices()->lights;
+        
+        mcp_effect_params_t params = {
+            .type = type,
+            .duration_ms = duration_ms,
+            .repeat = repeat,
+        };
+        for (int i = 0; i < lights->count && ret == 0; i++) {
+            if (!(mask & (1UL << i))) {
+                continue;
+            }
+            // 关闭的灯从 0 亮度开始
+            mcp_effect_frame_t from = {
+                .brightness = lights->enabled[i] ? lights->brightness[i] : 0,
+                .red = lights->red[i],
+                .green = lights->green[i],
+                .blue = lights->blue[i],
+            };
+            params.target.brightness = effect->brightness >= 0 ? effect->brightness : lights->brightness[i];
+            params.target.red = effect->red >= 0 ? effect->red : lights->red[i];
+            params.target.green = effect->green >= 0 ? effect->green : lights->green[i];
+            params.target.blue = effect->blue >= 0 ? effect->blue : lights->blue[i];
+            ret = mcp_effect_start(i, &params, &from);
         }
+        status_write_abort();
     }
     
-    ESP_LOGI(TAG, "Light brightness control: %d%% (ret=%d)", brightness, ret);
+    ESP_LOGI(TAG, "Light effect %s: %s %d ms, repeat %d (ret=%d)",
+             device_label(device_id, g_light_ids[0], MCP_DEVICE_SELECT_ALL), effect->effect, duration_ms, repeat, ret);
     return ret;
 }
 
-int mcp_server_control_light_color(int red, int green, int blue) {
-    if (red < 0 || red > 255 || green < 0 || green > 255 || blue < 0 || blue > 255) {
-        ESP_LOGE(TAG, "Invalid RGB values: (%d, %d, %d) (range: 0-255)", red, green, blue);
+int mcp_server_get_devices(mcp_light_table_t *lights, mcp_fan_table_t *fans) {
+    status_snapshot_t snapshot;
+    status_read(&snapshot);
+    if (lights) {
+        *lights = snapshot.devices.lights;
+    }
+    if (fans) {
+        *fans = snapshot.devices.fans;
+    }
+    return 0;
+}
+
+const char *mcp_server_light_id_at(int index) {
+    if (index >= 0 && index < CONFIG_MCP_LIGHT_COUNT) {
+        return g_light_ids[index];
+    }
+    return index == CONFIG_MCP_LIGHT_COUNT ? MCP_DEVICE_SELECT_ALL : NULL;
+}
+
+const char *mcp_server_fan_id_at(int index) {
+    if (index >= 0 && index < CONFIG_MCP_FAN_COUNT) {
+        return g_fan_ids[index];
+    }
+    return index == CONFIG_MCP_FAN_COUNT ? MCP_DEVICE_SELECT_ALL : NULL;
+}
+
+int mcp_server_apply_scene(const char *name, mcp_device_status_t *result) {
+    mcp_scene_t scene;
+    if (!name || mcp_scene_find(name, &scene) != 0) {
+        ESP_LOGE(TAG, "Unknown scene: %s", name ? name : "NULL");
         return -1;
     }
     
-    if (!g_status_mutex) {
+    if (!g_status.writer_lock) {
         return -1;
     }
     
-    // Send MQTT command
-    cJSON *payload = cJSON_CreateObject();
-    cJSON_AddStringToObject(payload, "command", "light_color_control");
-    cJSON_AddNumberToObject(payload, "red", red);
-    cJSON_AddNumberToObject(payload, "green", green);
-    cJSON_AddNumberToObject(payload, "blue", blue);
-
-    int ret = 0;
-    cJSON_Delete(payload);
+    mcp_device_status_t *status = status_write_begin();
+    device_registry_t *devices = status_write_devices();
+    devices->lights.enabled[0] = scene.light_enabled;
+    devices->lights.brightness[0] = scene.light_brightness;
+    devices->lights.red[0] = scene.light_red;
+    devices->lights.green[0] = scene.light_green;
+    devices->lights.blue[0] = scene.light_blue;
+    devices->fans.enabled[0] = scene.fan_enabled;
+    devices->fans.speed[0] = scene.fan_speed;
+    if (!scene.fan_enabled) {
+        status->fan_timer_minutes = 0;
+        status->fan_timer_start = 0;
+    }
     
-    if (ret == 0) {
-        if (xSemaphoreTake(g_status_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            g_device_status.light_red = red;
-            g_device_status.light_green = green;
-            g_device_status.light_blue = blue;
-            xSemaphoreGive(g_status_mutex);
+    esp_err_t err = post_device_state(devices, 1, 1);
+    int ret = err == ESP_OK ? 0 : -1;
+    if (ret == 0 && result) {
+        devices_to_status(devices, status);
+        *result = *status;
+    }
+    if (device_state_posted(err)) {
+        status_write_commit();
+        // 与 fans_apply 相同，放弃更新时保留风扇定时
+        if (!scene.fan_enabled) {
+            mcp_timer_cancel(&g_fan_off_timer);
         }
+    } else {
+        status_write_abort();
     }
     
-    ESP_LOGI(TAG, "Light color control: RGB(%d, %d, %d) (ret=%d)", red, green, blue, ret);
+    ESP_LOGI(TAG, "Scene apply: %s (ret=%d)", name, ret);
     return ret;
 }
 
-int mcp_server_control_fan_power(bool enabled) {
-    if (!g_status_mutex) {
+int mcp_server_save_scene(const char *name) {
+    if (!name || name[0] == '\0' || strlen(name) >= MCP_SCENE_NAME_LEN) {
+        ESP_LOGE(TAG, "Invalid scene name");
         return -1;
     }
     
-    // Send MQTT command
-    cJSON *payload = cJSON_CreateObject();
-    cJSON_AddStringToObject(payload, "command", "fan_power_control");
-    cJSON_AddBoolToObject(payload, "enabled", enabled);
-
-    int ret = 0;
-    cJSON_Delete(payload);
+    mcp_device_status_t status;
+    mcp_server_get_status(&status);
     
-    if (ret == 0) {
-        if (xSemaphoreTake(g_status_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            g_device_status.fan_enabled = enabled;
-            xSemaphoreGive(g_status_mutex);
-        }
-    }
+    mcp_scene_t scene = {
+        .light_enabled = status.light_enabled,
+        .light_brightness = status.light_brightness,
+        .light_red = status.light_red,
+        .light_green = status.light_green,
+        .light_blue = status.light_blue,
+        .fan_enabled = status.fan_enabled,
+        .fan_speed = status.fan_speed,
+    };
+    strlcpy(scene.name, name, sizeof(scene.name));
+    
+    int ret = mcp_scene_save(&scene);
+    ESP_LOGI(TAG, "Scene save: %s (ret=%d)", name, ret);
+    return ret;
+}
+
+int mcp_server_control_fan_power(bool enabled) {
+    mcp_fan_update_t update = MCP_FAN_UPDATE_INIT;
+    update.enabled = enabled;
+    int ret = fans_apply(1, &update, NULL);
     
     ESP_LOGI(TAG, "Fan power control: %s (ret=%d)", enabled ? "enabled" : "disabled", ret);
     return ret;
@@ -334,63 +1622,228 @@ int mcp_server_control_fan_speed(int speed) {
         return -1;
     }
     
-    if (!g_status_mutex) {
-        return -1;
-    }
-    
-    // Send MQTT command
-    cJSON *payload = cJSON_CreateObject();
-    cJSON_AddStringToObject(payload, "command", "fan_speed_control");
-    cJSON_AddNumberToObject(payload, "speed", speed);
-
-    int ret = 0;
-    cJSON_Delete(payload);
-    
-    if (ret == 0) {
-        if (xSemaphoreTake(g_status_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            g_device_status.fan_speed = speed;
-            xSemaphoreGive(g_status_mutex);
-        }
-    }
+    mcp_fan_update_t update = MCP_FAN_UPDATE_INIT;
+    update.speed = speed;
+    int ret = fans_apply(1, &update, NULL);
     
     ESP_LOGI(TAG, "Fan speed control: %d (ret=%d)", speed, ret);
     return ret;
 }
 
 int mcp_server_control_fan_timer(int minutes) {
-    if (minutes < 0) {
-        ESP_LOGE(TAG, "Invalid fan timer: %d minutes (must be >= 0)", minutes);
+    if (minutes < 0 || minutes > MCP_FAN_TIMER_MAX_MINUTES) {
+        ESP_LOGE(TAG, "Invalid fan timer: %d minutes (range: 0-%d)", minutes, MCP_FAN_TIMER_MAX_MINUTES);
         return -1;
     }
     
-    if (!g_status_mutex) {
+    if (!g_status.writer_lock) {
         return -1;
     }
     
-    // Send MQTT command
-    cJSON *payload = cJSON_CreateObject();
-    cJSON_AddStringToObject(payload, "command", "fan_timer_control");
-    cJSON_AddNumberToObject(payload, "minutes", minutes);
-
     int ret = 0;
-    cJSON_Delete(payload);
+    if (minutes > 0) {
+        ret = mcp_timer_arm(&g_fan_off_timer, (uint32_t)minutes * 60 * 1000);
+    } else {
+        mcp_timer_cancel(&g_fan_off_timer);
+    }
     
     if (ret == 0) {
-        if (xSemaphoreTake(g_status_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            g_device_status.fan_timer_minutes = minutes;
-            if (minutes > 0) {
-                g_device_status.fan_timer_start = esp_timer_get_time() / 1000; // ms
-            } else {
-                g_device_status.fan_timer_start = 0;
-            }
-            xSemaphoreGive(g_status_mutex);
+        mcp_device_status_t *status = status_write_begin();
+        status->fan_timer_minutes = minutes;
+        if (minutes > 0) {
+            status->fan_timer_start = esp_timer_get_time() / 1000; // ms
+        } else {
+            status->fan_timer_start = 0;
         }
+        status_write_commit();
     }
     
     ESP_LOGI(TAG, "Fan timer control: %d minutes (ret=%d)", minutes, ret);
     return ret;
 }
 
+// MCP 日志级别 (RFC 5424) 与 ESP 日志级别的映射
+static esp_log_level_t mcp_log_level_from_string(const char *level) {
+    if (strcmp(level, "debug") == 0) {
+        return ESP_LOG_DEBUG;
+    } else if (strcmp(level, "info") == 0 || strcmp(level, "notice") == 0) {
+        return ESP_LOG_INFO;
+    } else if (strcmp(level, "warning") == 0) {
+        return ESP_LOG_WARN;
+    }
+    return ESP_LOG_ERROR;
+}
+
+static const char *mcp_log_level_to_string(esp_log_level_t level) {
+    switch (level) {
+        case ESP_LOG_ERROR: return "error";
+        case ESP_LOG_WARN:  return "warning";
+        case ESP_LOG_INFO:  return "info";
+        default:            return "debug";
+    }
+}
+
+// 延迟日志输出：在 mcp_log drain 任务中调用，转发为 notifications/message
+static void mcp_log_notification_sink(esp_log_level_t level, const char *tag, const char *message) {
+    // 传输层的调试日志每次发送都会产生，不转发，避免通知自我放大
+    if (level >= ESP_LOG_DEBUG && strcmp(tag, "mcp_websocket") == 0) {
+        return;
+    }
+    if (!mcp_server_websocket_is_connected()) {
+        return;
+    }
+
+    cJSON *notification = cJSON_CreateObject();
+    cJSON_AddStringToObject(notification, "jsonrpc", "2.0");
+    cJSON_AddStringToObject(notification, "method", "notifications/message");
+
+    cJSON *params = cJSON_CreateObject();
+    cJSON_AddStringToObject(params, "level", mcp_log_level_to_string(level));
+    cJSON_AddStringToObject(params, "logger", tag);
+    cJSON_AddStringToObject(params, "data", message);
+    cJSON_AddItemToObject(notification, "params", params);
+
+    char *notification_str = cJSON_PrintUnformatted(notification);
+    if (notification_str) {
+        mcp_websocket_send_text(notification_str);
+        cJSON_free(notification_str);
+    }
+    cJSON_Delete(notification);
+}
+
+// 响应发送完成回调：记录排队时间和写入时间。在发送任务或状态机任务中调用，统计用自旋锁保护
+static void mcp_response_sent_cb(const mcp_ws_send_result_t *result, void *cookie) {
+    int id = (int)(intptr_t)cookie;
+
+    if (result->result != ESP_OK) {
+        portENTER_CRITICAL(&g_response_latency.lock);
+        g_response_latency.failed++;
+        portEXIT_CRITICAL(&g_response_latency.lock);
+        ESP_LOGW(TAG, "Response id=%d not sent: %s", id, esp_err_to_name(result->result));
+        return;
+    }
+
+    uint32_t queue_us = (uint32_t)(result->dequeue_time_us - result->enqueue_time_us);
+    uint32_t wire_us = (uint32_t)(result->complete_time_us - result->dequeue_time_us);
+
+    portENTER_CRITICAL(&g_response_latency.lock);
+    g_response_latency.sent++;
+    g_response_latency.queue_total_us += queue_us;
+    g_response_latency.wire_total_us += wire_us;
+    if (queue_us > g_response_latency.queue_max_us) {
+        g_response_latency.queue_max_us = queue_us;
+    }
+    if (wire_us > g_response_latency.wire_max_us) {
+        g_response_latency.wire_max_us = wire_us;
+    }
+    portEXIT_CRITICAL(&g_response_latency.lock);
+
+    ESP_LOGD(TAG, "Response id=%d: queued %lu us, wire %lu us",
+             id, (unsigned long)queue_us, (unsigned long)wire_us);
+}
+
+// 处理一条来自 MCP Client 的消息，响应生成后归还接收缓冲区
+// tools/call 的去重键：参数（工具名和 arguments）的哈希，与请求 id 一起查找幂等缓存
+static bool tool_call_hash(cJSON *request, uint32_t *hash) {
+    cJSON *method_item = cJSON_GetObjectItem(request, "method");
+    if (!cJSON_IsString(method_item) || strcmp(method_item->valuestring, "tools/call") != 0) {
+        return false;
+    }
+    
+    char *params_str = cJSON_PrintUnformatted(cJSON_GetObjectItem(request, "params"));
+    if (!params_str) {
+        return false;
+    }
+    *hash = mcp_idem_hash(MCP_IDEM_HASH_INIT, params_str, strlen(params_str));
+    cJSON_free(params_str);
+    return true;
+}
+
+static void handle_mcp_message(mcp_ws_rx_buffer_t *buffer) {
+    char *response_str = NULL;
+    const char *cached_str = NULL;
+    char *id_str = NULL;
+    int response_id = 0;
+    history_export_request_t export;
+    bool streaming = false;
+
+    ESP_LOGD(TAG, "WebSocket received message: %.*s", (int)buffer->len, buffer->data);
+    
+    // 解析并处理来自MCP Client的消息
+    cJSON *request = buffer->len > 0 ? cJSON_ParseWithLength(buffer->data, buffer->len) : NULL;
+    if (request) {
+        // 检查消息类型
+        cJSON *method_item = cJSON_GetObjectItem(request, "method");
+        
+        if (method_item && cJSON_IsString(method_item)) {
+            const char *method = method_item->valuestring;
+            ESP_LOGD(TAG, "Received MCP method from client: %s", method);
+        }
+        
+        // 处理 MCP 请求并生成响应（只对请求发送响应，通知不需要响应）
+        cJSON *id_item = cJSON_GetObjectItem(request, "id");
+        if (id_item) {
+            // 这是一个请求，需要响应。重发的 tools/call 直接返回缓存的响应，不再执行
+            uint32_t call_hash;
+            bool is_tool_call = tool_call_hash(request, &call_hash);
+            // 幂等缓存按序列化的 id 查找，字符串 id 不会与数字 id 混淆；流式导出也用它回显 id
+            id_str = cJSON_PrintUnformatted(id_item);
+            response_id = id_item->valueint;    // 只用于日志
+            if (id_str && is_tool_call) {
+                cached_str = mcp_idem_lookup(id_str, call_hash);
+            }
+            streaming = id_str && parse_history_export(request, &export);
+            
+            cJSON *response = cached_str || streaming ? NULL : process_mcp_request(request);
+            if (response) {
+                // 响应回显请求的原始 id（数字或字符串），缓存的响应重放时也一样
+                cJSON *id_copy = cJSON_Duplicate(id_item, true);
+                if (id_copy) {
+                    cJSON_ReplaceItemInObject(response, "id", id_copy);
+                }
+                response_str = cJSON_PrintUnformatted(response);
+                // 只缓存成功的调用，失败的调用（错误响应或 isError 结果）重试时重新执行
+                cJSON *result_item = cJSON_GetObjectItem(response, "result");
+                if (response_str && id_str && is_tool_call && result_item &&
+                    !cJSON_IsTrue(cJSON_GetObjectItem(result_item, "isError"))) {
+                    mcp_idem_store(id_str, call_hash, response_str);
+                }
+                cJSON_Delete(response);
+            }
+        } else {
+            // 这是一个通知，不需要响应
+            ESP_LOGD(TAG, "Received MCP notification from client, no response needed");
+        }
+        
+        cJSON_Delete(request);
+    } else {
+        ESP_LOGE(TAG, "Failed to parse WebSocket message as JSON");
+    }
+
+    mcp_websocket_release_rx_buffer(buffer);
+
+    if (response_str || cached_str) {
+        const char *send_str = response_str ? response_str : cached_str;
+        ESP_LOGD(TAG, "Sending MCP response to client: %s", send_str);
+        mcp_websocket_send_text_ex(send_str, mcp_response_sent_cb, (void *)(intptr_t)response_id);
+        cJSON_free(response_str);
+    } else if (streaming) {
+        stream_history_export(response_id, id_str, &export);
+    }
+    cJSON_free(id_str);
+}
+
+// 请求处理任务：解析、执行并响应，与 WebSocket 接收流水线并行
+static void mcp_request_task(void *pvParameters) {
+    mcp_ws_rx_buffer_t *buffer = NULL;
+
+    while (1) {
+        if (xQueueReceive(g_request_queue, &buffer, portMAX_DELAY) == pdTRUE) {
+            handle_mcp_message(buffer);
+        }
+    }
+}
+
 // WebSocket 事件处理函数
 // 角色说明：
 // - WebSocket层面：ESP32是WebSocket Client，连接到远程WebSocket Server (api.xiaozhi.me)
@@ -412,47 +1865,20 @@ static void mcp_websocket_event_handler(mcp_ws_event_t *event) {
             g_mcp_ws_state.connected = false;
             break;
             
-        case MCP_WS_EVENT_MESSAGE_RECEIVED:
-            ESP_LOGI(TAG, "WebSocket received message: %.*s", (int)event->data_len, event->data);
-            
-            // 解析并处理来自MCP Client的消息
-            if (event->data && event->data_len > 0) {
-                ESP_LOGI(TAG, "Parsing MCP Client message:%s", event->data);
-                cJSON *request = cJSON_ParseWithLength(event->data, event->data_len);
-                if (request) {
-                    // 检查消息类型
-                    cJSON *method_item = cJSON_GetObjectItem(request, "method");
-                    
-                    if (method_item && cJSON_IsString(method_item)) {
-                        const char *method = method_item->valuestring;
-                        ESP_LOGI(TAG, "Received MCP method from client: %s", method);
-                    }
-                    
-                    // 处理 MCP 请求并发送响应（只对请求发送响应，通知不需要响应）
-                    cJSON *id_item = cJSON_GetObjectItem(request, "id");
-                    if (id_item) {
-                        // 这是一个请求，需要响应
-                        cJSON *response = process_mcp_request(request);
-                        if (response) {
-                            char *response_str = cJSON_PrintUnformatted(response);
-                            if (response_str) {
-                                ESP_LOGI(TAG, "Sending MCP response to client: %s", response_str);
-                                mcp_websocket_send_text(response_str);
-                                cJSON_free(response_str);
-                            }
-                            cJSON_Delete(response);
-                        }
-                    } else {
-                        // 这是一个通知，不需要响应
-                        ESP_LOGI(TAG, "Received MCP notification from client, no response needed");
-                    }
-                    
-                    cJSON_Delete(request);
-                } else {
-                    ESP_LOGE(TAG, "Failed to parse WebSocket message as JSON");
-                }
+        case MCP_WS_EVENT_MESSAGE_RECEIVED: {
+            // 认领接收缓冲区交给请求处理任务，接收任务立即继续读取下一条消息
+            mcp_ws_rx_buffer_t *buffer = mcp_websocket_claim_rx_buffer(event);
+            if (!buffer) {
+                break;
+            }
+            if (!g_request_queue) {
+                handle_mcp_message(buffer);
+            } else if (xQueueSend(g_request_queue, &buffer, 0) != pdTRUE) {
+                ESP_LOGW(TAG, "Request queue full, dropping message");
+                mcp_websocket_release_rx_buffer(buffer);
             }
             break;
+        }
             
         case MCP_WS_EVENT_ERROR:
             ESP_LOGE(TAG, "WebSocket error occurred");
@@ -498,8 +1924,14 @@ static cJSON* process_mcp_request(cJSON *request) {
         ESP_LOGI(TAG, "Processing prompts/get request from client");
         return create_error_response(id, -32601, "Prompts not supported");
     } else if (strcmp(method, "logging/setLevel") == 0) {
-        // 处理日志级别设置请求
+        // 处理日志级别设置请求，之后延迟日志会以 notifications/message 转发给客户端
         ESP_LOGI(TAG, "Processing logging/setLevel request from client");
+        cJSON *params = cJSON_GetObjectItem(request, "params");
+        cJSON *level_item = params ? cJSON_GetObjectItem(params, "level") : NULL;
+        if (!level_item || !cJSON_IsString(level_item)) {
+            return create_error_response(id, -32602, "Log level required");
+        }
+        mcp_log_set_sink(mcp_log_notification_sink, mcp_log_level_from_string(level_item->valuestring));
         cJSON *empty_result = cJSON_CreateObject();
         return create_success_response(id, empty_result);
     } else if (strcmp(method, "completion/complete") == 0) {
@@ -542,6 +1974,7 @@ static cJSON* process_initialize_request(cJSON *request, int id) {
     cJSON *resources = cJSON_CreateObject();
     cJSON *prompts = cJSON_CreateObject();
     cJSON *experimental = cJSON_CreateObject();
+    cJSON *logging = cJSON_CreateObject();
     
     cJSON_AddBoolToObject(tools, "listChanged", false);
     cJSON_AddBoolToObject(resources, "subscribe", false);
@@ -552,6 +1985,7 @@ static cJSON* process_initialize_request(cJSON *request, int id) {
     cJSON_AddItemToObject(capabilities, "resources", resources);
     cJSON_AddItemToObject(capabilities, "prompts", prompts);
     cJSON_AddItemToObject(capabilities, "experimental", experimental);
+    cJSON_AddItemToObject(capabilities, "logging", logging);
     
     cJSON_AddItemToObject(result, "protocolVersion", protocol_version);
     cJSON_AddItemToObject(result, "capabilities", capabilities);
@@ -584,6 +2018,14 @@ static cJSON* process_list_tools_request(cJSON *request, int id) {
             cJSON *param = cJSON_CreateObject();
             cJSON_AddStringToObject(param, "type", g_tools[i].params[j].type);
             cJSON_AddStringToObject(param, "description", g_tools[i].params[j].description);
+            if (g_tools[i].params[j].enum_source) {
+                cJSON *values = cJSON_CreateArray();
+                const char *value;
+                for (int k = 0; (value = g_tools[i].params[j].enum_source(k)) != NULL; k++) {
+                    cJSON_AddItemToArray(values, cJSON_CreateString(value));
+                }
+                cJSON_AddItemToObject(param, "enum", values);
+            }
             cJSON_AddItemToObject(properties, g_tools[i].params[j].name, param);
             
             if (g_tools[i].params[j].required) {
@@ -622,24 +2064,33 @@ static cJSON* process_call_tool_request(cJSON *request, int id) {
     const char *tool_name = name_item->valuestring;
     cJSON *result = cJSON_CreateObject();
     cJSON *content = cJSON_CreateArray();
+    bool failed = false;    // 工具执行失败：结果标记 isError，不进入幂等缓存
     
     ESP_LOGI(TAG, "Calling tool via WebSocket: %s", tool_name);
     
+    // 设备工具共用的可选实例选择器
+    cJSON *device_id_item = cJSON_GetObjectItem(arguments, "device_id");
+    const char *device_id = cJSON_IsString(device_id_item) ? device_id_item->valuestring : NULL;
+    
     // 处理所有工具调用逻辑
     if (strcmp(tool_name, "light_power_control") == 0) {
         cJSON *enabled_item = cJSON_GetObjectItem(arguments, "enabled");
         if (enabled_item && cJSON_IsBool(enabled_item)) {
             bool enabled = cJSON_IsTrue(enabled_item);
-            int ret = mcp_server_control_light_power(enabled);
+            mcp_light_update_t update = MCP_LIGHT_UPDATE_INIT;
+            update.enabled = enabled;
+            int ret = mcp_server_control_lights(device_id, &update, NULL);
             
             cJSON *response_content = cJSON_CreateObject();
             cJSON_AddStringToObject(response_content, "type", "text");
             if (ret == 0) {
                 char text[128];
-                snprintf(text, sizeof(text), "Light %s successfully", enabled ? "enabled" : "disabled");
+                snprintf(text, sizeof(text), "%s %s successfully",
+                         device_label(device_id, "Light", "All lights"), enabled ? "enabled" : "disabled");
                 cJSON_AddStringToObject(response_content, "text", text);
             } else {
                 cJSON_AddStringToObject(response_content, "text", "Failed to control light power");
+                failed = true;
             }
             cJSON_AddItemToArray(content, response_content);
         }
@@ -647,16 +2098,20 @@ static cJSON* process_call_tool_request(cJSON *request, int id) {
         cJSON *brightness_item = cJSON_GetObjectItem(arguments, "brightness");
         if (brightness_item && cJSON_IsNumber(brightness_item)) {
             int brightness = brightness_item->valueint;
-            int ret = mcp_server_control_light_brightness(brightness);
+            mcp_light_update_t update = MCP_LIGHT_UPDATE_INIT;
+            update.brightness = brightness;
+            int ret = mcp_server_control_lights(device_id, &update, NULL);
             
             cJSON *response_content = cJSON_CreateObject();
             cJSON_AddStringToObject(response_content, "type", "text");
             if (ret == 0) {
                 char text[128];
-                snprintf(text, sizeof(text), "Light brightness set to %d%%", brightness);
+                snprintf(text, sizeof(text), "%s brightness set to %d%%",
+                         device_label(device_id, "Light", "All lights"), brightness);
                 cJSON_AddStringToObject(response_content, "text", text);
             } else {
                 cJSON_AddStringToObject(response_content, "text", "Failed to set light brightness");
+                failed = true;
             }
             cJSON_AddItemToArray(content, response_content);
         }
@@ -670,16 +2125,225 @@ static cJSON* process_call_tool_request(cJSON *request, int id) {
             int red = red_item->valueint;
             int green = green_item->valueint;
             int blue = blue_item->valueint;
-            int ret = mcp_server_control_light_color(red, green, blue);
+            mcp_light_update_t update = MCP_LIGHT_UPDATE_INIT;
+            update.red = red;
+            update.green = green;
+            update.blue = blue;
+            int ret = mcp_server_control_lights(device_id, &update, NULL);
             
             cJSON *response_content = cJSON_CreateObject();
             cJSON_AddStringToObject(response_content, "type", "text");
             if (ret == 0) {
                 char text[128];
-                snprintf(text, sizeof(text), "Light color set to RGB(%d, %d, %d)", red, green, blue);
+                snprintf(text, sizeof(text), "%s color set to RGB(%d, %d, %d)",
+                         device_label(device_id, "Light", "All lights"), red, green, blue);
                 cJSON_AddStringToObject(response_content, "text", text);
             } else {
                 cJSON_AddStringToObject(response_content, "text", "Failed to set light color");
+                failed = true;
+            }
+            cJSON_AddItemToArray(content, response_content);
+        }
+    } else if (strcmp(tool_name, "light_set_state") == 0) {
+        mcp_light_update_t update = MCP_LIGHT_UPDATE_INIT;
+        cJSON *enabled_item = cJSON_GetObjectItem(arguments, "enabled");
+        cJSON *brightness_item = cJSON_GetObjectItem(arguments, "brightness");
+        cJSON *red_item = cJSON_GetObjectItem(arguments, "red");
+        cJSON *green_item = cJSON_GetObjectItem(arguments, "green");
+        cJSON *blue_item = cJSON_GetObjectItem(arguments, "blue");
+        
+        if (enabled_item && cJSON_IsBool(enabled_item)) update.enabled = cJSON_IsTrue(enabled_item);
+        if (brightness_item && cJSON_IsNumber(brightness_item)) update.brightness = brightness_item->valueint;
+        if (red_item && cJSON_IsNumber(red_item)) update.red = red_item->valueint;
+        if (green_item && cJSON_IsNumber(green_item)) update.green = green_item->valueint;
+        if (blue_item && cJSON_IsNumber(blue_item)) update.blue = blue_item->valueint;
+        
+        mcp_light_table_t lights;
+        int ret = mcp_server_control_lights(device_id, &update, &lights);
+        
+        cJSON *response_content = cJSON_CreateObject();
+        cJSON_AddStringToObject(response_content, "type", "text");
+        if (ret == 0) {
+            char text[128 * MCP_MAX_LIGHTS];
+            size_t len = 0;
+            uint32_t mask = device_select(device_id, g_light_ids, lights.count);
+            for (int i = 0; i < lights.count; i++) {
+                if (mask & (1UL << i)) {
+                    len += snprintf(text + len, sizeof(text) - len, "%s%s is %s, brightness %d%%, color RGB(%d, %d, %d)",
+                                    len ? "; " : "", device_id ? g_light_ids[i] : "Light",
+                                    lights.enabled[i] ? "on" : "off", lights.brightness[i],
+                                    lights.red[i], lights.green[i], lights.blue[i]);
+                }
+            }
+            cJSON_AddStringToObject(response_content, "text", text);
+        } else {
+            cJSON_AddStringToObject(response_content, "text", "Failed to set light state");
+            failed = true;
+        }
+        cJSON_AddItemToArray(content, response_content);
+    } else if (strcmp(tool_name, "light_effect") == 0) {
+        cJSON *effect_item = cJSON_GetObjectItem(arguments, "effect");
+        if (effect_item && cJSON_IsString(effect_item)) {
+            mcp_light_effect_t effect = MCP_LIGHT_EFFECT_INIT;
+            cJSON *duration_item = cJSON_GetObjectItem(arguments, "duration_ms");
+            cJSON *repeat_item = cJSON_GetObjectItem(arguments, "repeat");
+            cJSON *brightness_item = cJSON_GetObjectItem(arguments, "brightness");
+            cJSON *red_item = cJSON_GetObjectItem(arguments, "red");
+            cJSON *green_item = cJSON_GetObjectItem(arguments, "green");
+            cJSON *blue_item = cJSON_GetObjectItem(arguments, "blue");
+            
+            effect.effect = effect_item->valuestring;
+            if (duration_item && cJSON_IsNumber(duration_item)) effect.duration_ms = duration_item->valueint;
+            if (repeat_item && cJSON_IsNumber(repeat_item)) effect.repeat = repeat_item->valueint;
+            if (brightness_item && cJSON_IsNumber(brightness_item)) effect.brightness = brightness_item->valueint;
+            if (red_item && cJSON_IsNumber(red_item)) effect.red = red_item->valueint;
+            if (green_item && cJSON_IsNumber(green_item)) effect.green = green_item->valueint;
+            if (blue_item && cJSON_IsNumber(blue_item)) effect.blue = blue_item->valueint;
+            
+            int ret = mcp_server_light_effect(device_id, &effect);
+            
+            cJSON *response_content = cJSON_CreateObject();
+            cJSON_AddStringToObject(response_content, "type", "text");
+            if (ret == 0) {
+                char text[128];
+                if (strcmp(effect.effect, "stop") == 0) {
+                    snprintf(text, sizeof(text), "%s effect stopped", device_label(device_id, "Light", "All lights"));
+                } else {
+                    snprintf(text, sizeof(text), "%s effect '%s' started", device_label(device_id, "Light", "All lights"),
+                             effect.effect);
+                }
+                cJSON_AddStringToObject(response_content, "text", text);
+            } else {
+                cJSON_AddStringToObject(response_content, "text", "Failed to start light effect");
+                failed = true;
+            }
+            cJSON_AddItemToArray(content, response_content);
+        }
+    } else if (strcmp(tool_name, "scene_apply") == 0) {
+        cJSON *name_item = cJSON_GetObjectItem(arguments, "name");
+        if (name_item && cJSON_IsString(name_item)) {
+            mcp_device_status_t status;
+            int ret = mcp_server_apply_scene(name_item->valuestring, &status);
+            
+            cJSON *response_content = cJSON_CreateObject();
+            cJSON_AddStringToObject(response_content, "type", "text");
+            if (ret == 0) {
+                char text[192];
+                snprintf(text, sizeof(text), "Scene '%s' applied: light %s, brightness %d%%, color RGB(%d, %d, %d), fan %s, speed %d",
+                         name_item->valuestring, status.light_enabled ? "on" : "off", status.light_brightness,
+                         status.light_red, status.light_green, status.light_blue,
+                         status.fan_enabled ? "on" : "off", status.fan_speed);
+                cJSON_AddStringToObject(response_content, "text", text);
+            } else {
+                cJSON_AddStringToObject(response_content, "text", "Failed to apply scene");
+                failed = true;
+            }
+            cJSON_AddItemToArray(content, response_content);
+        }
+    } else if (strcmp(tool_name, "scene_save") == 0) {
+        cJSON *name_item = cJSON_GetObjectItem(arguments, "name");
+        if (name_item && cJSON_IsString(name_item)) {
+            int ret = mcp_server_save_scene(name_item->valuestring);
+            
+            cJSON *response_content = cJSON_CreateObject();
+            cJSON_AddStringToObject(response_content, "type", "text");
+            if (ret == 0) {
+                char text[128];
+                snprintf(text, sizeof(text), "Scene '%s' saved", name_item->valuestring);
+                cJSON_AddStringToObject(response_content, "text", text);
+            } else {
+                cJSON_AddStringToObject(response_content, "text", "Failed to save scene");
+                failed = true;
+            }
+            cJSON_AddItemToArray(content, response_content);
+        }
+    } else if (strcmp(tool_name, "rule_add") == 0) {
+        cJSON *sensor_item = cJSON_GetObjectItem(arguments, "sensor");
+        cJSON *condition_item = cJSON_GetObjectItem(arguments, "condition");
+        cJSON *threshold_item = cJSON_GetObjectItem(arguments, "threshold");
+        cJSON *action_item = cJSON_GetObjectItem(arguments, "action");
+        cJSON *value_item = cJSON_GetObjectItem(arguments, "value");
+        cJSON *hysteresis_item = cJSON_GetObjectItem(arguments, "hysteresis");
+        cJSON *cooldown_item = cJSON_GetObjectItem(arguments, "cooldown_s");
+        
+        if (cJSON_IsString(sensor_item) && cJSON_IsString(condition_item) &&
+            cJSON_IsNumber(threshold_item) && cJSON_IsString(action_item)) {
+            int sensor = mcp_rule_sensor_from_name(sensor_item->valuestring);
+            int condition = mcp_rule_condition_from_name(condition_item->valuestring);
+            int action = mcp_rule_action_from_name(action_item->valuestring);
+            int cooldown_s = cJSON_IsNumber(cooldown_item) ? cooldown_item->valueint : MCP_RULE_DEFAULT_COOLDOWN_S;
+            int value = cJSON_IsNumber(value_item) ? value_item->valueint : 0;
+            mcp_rule_t rule = {
+                .sensor = sensor,
+                .condition = condition,
+                .action = action,
+                .value = value >= INT8_MIN && value <= INT8_MAX ? value : 0,
+                .cooldown_s = cooldown_s >= 0 && cooldown_s <= MCP_RULE_MAX_COOLDOWN_S ? cooldown_s : 0,
+                .threshold = threshold_item->valuedouble,
+                .hysteresis = cJSON_IsNumber(hysteresis_item) ? hysteresis_item->valuedouble : MCP_RULE_DEFAULT_HYSTERESIS,
+            };
+            if (device_id && strlen(device_id) < sizeof(rule.device_id)) {
+                strlcpy(rule.device_id, device_id, sizeof(rule.device_id));
+            }
+            
+            int ret = -1;
+            if (sensor >= 0 && condition >= 0 && action >= 0 &&
+                cooldown_s >= 0 && cooldown_s <= MCP_RULE_MAX_COOLDOWN_S &&
+                (!device_id || rule.device_id[0]) && rule_target_valid(&rule)) {
+                ret = mcp_rule_add(&rule);
+            }
+            
+            cJSON *response_content = cJSON_CreateObject();
+            cJSON_AddStringToObject(response_content, "type", "text");
+            if (ret == 0) {
+                char text[128];
+                snprintf(text, sizeof(text), "Rule %d added: when %s is %s %.1f, %s",
+                         rule.id, sensor_item->valuestring, condition_item->valuestring,
+                         rule.threshold, action_item->valuestring);
+                cJSON_AddStringToObject(response_content, "text", text);
+            } else {
+                cJSON_AddStringToObject(response_content, "text", "Failed to add rule");
+                failed = true;
+            }
+            cJSON_AddItemToArray(content, response_content);
+        }
+    } else if (strcmp(tool_name, "rule_list") == 0) {
+        mcp_rule_t rules[MCP_RULE_MAX];
+        int count = mcp_rule_list(rules, MCP_RULE_MAX);
+        
+        char text[96 * MCP_RULE_MAX + 32];
+        size_t len = snprintf(text, sizeof(text), count ? "%d rules:" : "No rules", count);
+        for (int i = 0; i < count; i++) {
+            const mcp_rule_t *rule = &rules[i];
+            len += snprintf(text + len, sizeof(text) - len, "\n#%d: %s %s %.1f (hysteresis %.1f) -> %s",
+                            rule->id, mcp_rule_sensor_name_at(rule->sensor), mcp_rule_condition_name_at(rule->condition),
+                            rule->threshold, rule->hysteresis, mcp_rule_action_name_at(rule->action));
+            if (rule->action == MCP_RULE_FAN_SPEED) {
+                len += snprintf(text + len, sizeof(text) - len, " %d", rule->value);
+            }
+            len += snprintf(text + len, sizeof(text) - len, " %s, cooldown %u s",
+                            rule->device_id[0] ? rule->device_id : "default", rule->cooldown_s);
+        }
+        
+        cJSON *response_content = cJSON_CreateObject();
+        cJSON_AddStringToObject(response_content, "type", "text");
+        cJSON_AddStringToObject(response_content, "text", text);
+        cJSON_AddItemToArray(content, response_content);
+    } else if (strcmp(tool_name, "rule_remove") == 0) {
+        cJSON *id_item = cJSON_GetObjectItem(arguments, "id");
+        if (id_item && cJSON_IsNumber(id_item)) {
+            int rule_id = id_item->valueint;
+            int ret = rule_id > 0 && rule_id <= UINT8_MAX ? mcp_rule_remove(rule_id) : -1;
+            
+            cJSON *response_content = cJSON_CreateObject();
+            cJSON_AddStringToObject(response_content, "type", "text");
+            if (ret == 0) {
+                char text[64];
+                snprintf(text, sizeof(text), "Rule %d removed", rule_id);
+                cJSON_AddStringToObject(response_content, "text", text);
+            } else {
+                cJSON_AddStringToObject(response_content, "text", "Failed to remove rule");
+                failed = true;
             }
             cJSON_AddItemToArray(content, response_content);
         }
@@ -687,16 +2351,20 @@ static cJSON* process_call_tool_request(cJSON *request, int id) {
         cJSON *enabled_item = cJSON_GetObjectItem(arguments, "enabled");
         if (enabled_item && cJSON_IsBool(enabled_item)) {
             bool enabled = cJSON_IsTrue(enabled_item);
-            int ret = mcp_server_control_fan_power(enabled);
+            mcp_fan_update_t update = MCP_FAN_UPDATE_INIT;
+            update.enabled = enabled;
+            int ret = mcp_server_control_fans(device_id, &update, NULL);
             
             cJSON *response_content = cJSON_CreateObject();
             cJSON_AddStringToObject(response_content, "type", "text");
             if (ret == 0) {
                 char text[128];
-                snprintf(text, sizeof(text), "Fan %s successfully", enabled ? "enabled" : "disabled");
+                snprintf(text, sizeof(text), "%s %s successfully",
+                         device_label(device_id, "Fan", "All fans"), enabled ? "enabled" : "disabled");
                 cJSON_AddStringToObject(response_content, "text", text);
             } else {
                 cJSON_AddStringToObject(response_content, "text", "Failed to control fan power");
+                failed = true;
             }
             cJSON_AddItemToArray(content, response_content);
         }
@@ -704,16 +2372,68 @@ static cJSON* process_call_tool_request(cJSON *request, int id) {
         cJSON *speed_item = cJSON_GetObjectItem(arguments, "speed");
         if (speed_item && cJSON_IsNumber(speed_item)) {
             int speed = speed_item->valueint;
-            int ret = mcp_server_control_fan_speed(speed);
+            mcp_fan_update_t update = MCP_FAN_UPDATE_INIT;
+            update.speed = speed;
+            int ret = mcp_server_control_fans(device_id, &update, NULL);
             
             cJSON *response_content = cJSON_CreateObject();
             cJSON_AddStringToObject(response_content, "type", "text");
             if (ret == 0) {
                 char text[128];
-                snprintf(text, sizeof(text), "Fan speed set to level %d", speed);
+                snprintf(text, sizeof(text), "%s speed set to level %d",
+                         device_label(device_id, "Fan", "All fans"), speed);
                 cJSON_AddStringToObject(response_content, "text", text);
             } else {
                 cJSON_AddStringToObject(response_content, "text", "Failed to set fan speed");
+                failed = true;
+            }
+            cJSON_AddItemToArray(content, response_content);
+        }
+    } else if (strcmp(tool_name, "fan_auto_mode") == 0) {
+        cJSON *enabled_item = cJSON_GetObjectItem(arguments, "enabled");
+        if (enabled_item && cJSON_IsBool(enabled_item)) {
+            // 未提供的参数沿用当前配置
+            mcp_fan_auto_config_t config;
+            mcp_fan_auto_get(&config, NULL);
+            config.enabled = cJSON_IsTrue(enabled_item);
+            cJSON *item = cJSON_GetObjectItem(arguments, "setpoint");
+            if (item && cJSON_IsNumber(item)) {
+                config.setpoint = (float)item->valuedouble;
+            }
+            item = cJSON_GetObjectItem(arguments, "kp");
+            if (item && cJSON_IsNumber(item)) {
+                config.kp = (float)item->valuedouble;
+            }
+            item = cJSON_GetObjectItem(arguments, "ki");
+            if (item && cJSON_IsNumber(item)) {
+                config.ki = (float)item->valuedouble;
+            }
+            item = cJSON_GetObjectItem(arguments, "dwell_s");
+            bool dwell_valid = true;
+            if (item && cJSON_IsNumber(item)) {
+                // 先在 double 上检查范围再转换，超出 uint32_t 的值转换是未定义行为
+                dwell_valid = item->valuedouble >= 0 && item->valuedouble <= MCP_FAN_AUTO_MAX_DWELL_S;
+                config.dwell_s = dwell_valid ? (uint32_t)item->valuedouble : 0;
+            }
+            int ret = dwell_valid ? mcp_fan_auto_configure(&config) : -1;
+            
+            cJSON *response_content = cJSON_CreateObject();
+            cJSON_AddStringToObject(response_content, "type", "text");
+            if (ret == 0) {
+                int level = 0;
+                mcp_fan_auto_get(NULL, &level);
+                char text[160];
+                if (config.enabled) {
+                    snprintf(text, sizeof(text), "Fan auto mode enabled: setpoint %.1f°C, kp %.2f, ki %.3f, "
+                             "dwell %lu s, current level %d", config.setpoint, config.kp, config.ki,
+                             (unsigned long)config.dwell_s, level);
+                } else {
+                    snprintf(text, sizeof(text), "Fan auto mode disabled");
+                }
+                cJSON_AddStringToObject(response_content, "text", text);
+            } else {
+                cJSON_AddStringToObject(response_content, "text", "Failed to configure fan auto mode");
+                failed = true;
             }
             cJSON_AddItemToArray(content, response_content);
         }
@@ -735,6 +2455,7 @@ static cJSON* process_call_tool_request(cJSON *request, int id) {
                 cJSON_AddStringToObject(response_content, "text", text);
             } else {
                 cJSON_AddStringToObject(response_content, "text", "Failed to set fan timer");
+                failed = true;
             }
             cJSON_AddItemToArray(content, response_content);
         }
@@ -748,6 +2469,62 @@ static cJSON* process_call_tool_request(cJSON *request, int id) {
             cJSON_AddStringToObject(response_content, "text", text);
             cJSON_AddItemToArray(content, response_content);
         }
+    } else if (strcmp(tool_name, "get_sensor_history") == 0) {
+        cJSON *start_item = cJSON_GetObjectItem(arguments, "start_s");
+        cJSON *end_item = cJSON_GetObjectItem(arguments, "end_s");
+        cJSON *resolution_item = cJSON_GetObjectItem(arguments, "resolution_s");
+        cJSON *max_item = cJSON_GetObjectItem(arguments, "max_samples");
+        double start_s = start_item && cJSON_IsNumber(start_item) ? start_item->valuedouble : -1;
+        double end_s = end_item && cJSON_IsNumber(end_item) && end_item->valuedouble > 0 ? end_item->valuedouble : 0;
+        double resolution_s = resolution_item && cJSON_IsNumber(resolution_item) ? resolution_item->valuedouble : 0;
+        int max_samples = max_item && cJSON_IsNumber(max_item) ? max_item->valueint : 60;
+        
+        cJSON *history_json = history_to_json(start_s, end_s, resolution_s, max_samples);
+        char *history_str = cJSON_PrintUnformatted(history_json);
+        cJSON_Delete(history_json);
+        
+        cJSON *response_content = cJSON_CreateObject();
+        cJSON_AddStringToObject(response_content, "type", "text");
+        cJSON_AddStringToObject(response_content, "text", history_str ? history_str : "{}");
+        cJSON_AddItemToArray(content, response_content);
+        cJSON_free(history_str);
+    } else if (strcmp(tool_name, "get_sensor_stats") == 0) {
+        cJSON *window_item = cJSON_GetObjectItem(arguments, "window");
+        int window = -1;
+        if (window_item && cJSON_IsString(window_item)) {
+            window = mcp_stats_window_from_name(window_item->valuestring);
+        }
+        
+        cJSON *response_content = cJSON_CreateObject();
+        cJSON_AddStringToObject(response_content, "type", "text");
+        if (window_item && window < 0) {
+            cJSON_AddStringToObject(response_content, "text", "Unknown window");
+            failed = true;
+        } else {
+            int64_t now_ms = esp_timer_get_time() / 1000;
+            char text[512];
+            size_t len = 0;
+            for (int w = 0; w < MCP_STATS_WINDOW_COUNT && len < sizeof(text); w++) {
+                if (window >= 0 && w != window) {
+                    continue;
+                }
+                mcp_stats_result_t temperature, humidity;
+                mcp_stats_get(w, now_ms, &temperature, &humidity);
+                if (!temperature.count) {
+                    len += snprintf(text + len, sizeof(text) - len, "%sLast %s: no samples",
+                                    len ? "\n" : "", mcp_stats_window_name_at(w));
+                    continue;
+                }
+                len += snprintf(text + len, sizeof(text) - len,
+                                "%sLast %s (%lu samples): temperature min %.1f max %.1f mean %.1f sd %.2f°C; "
+                                "humidity min %.1f max %.1f mean %.1f sd %.2f%%",
+                                len ? "\n" : "", mcp_stats_window_name_at(w), (unsigned long)temperature.count,
+                                temperature.min, temperature.max, temperature.mean, temperature.stddev,
+                                humidity.min, humidity.max, humidity.mean, humidity.stddev);
+            }
+            cJSON_AddStringToObject(response_content, "text", text);
+        }
+        cJSON_AddItemToArray(content, response_content);
     } else if (strcmp(tool_name, "get_humidity") == 0) {
         mcp_device_status_t status;
         if (mcp_server_get_status(&status) == 0) {
@@ -763,6 +2540,9 @@ static cJSON* process_call_tool_request(cJSON *request, int id) {
     }
     
     cJSON_AddItemToObject(result, "content", content);
+    if (failed) {
+        cJSON_AddBoolToObject(result, "isError", true);
+    }
     return create_success_response(id, result);
 }
 
@@ -795,8 +2575,8 @@ static cJSON* process_read_resource_request(cJSON *request, int id) {
     }
     
     const char *uri = uri_item->valuestring;
-    mcp_device_status_t status;
-    mcp_server_get_status(&status);
+    status_snapshot_t snapshot;
+    status_read(&snapshot);
     
     cJSON *result = cJSON_CreateObject();
     cJSON *contents = cJSON_CreateArray();
@@ -806,24 +2586,67 @@ static cJSON* process_read_resource_request(cJSON *request, int id) {
         cJSON_AddStringToObject(content, "uri", uri);
         cJSON_AddStringToObject(content, "mimeType", "application/json");
         
+        // sinceVersion: 只返回该版本之后变化的字段，没有变化时返回 notModified
+        cJSON *since_item = cJSON_GetObjectItem(params, "sinceVersion");
+        // 比当前版本还新的 sinceVersion 来自重启之前，按完整读取处理
+        bool delta = since_item && cJSON_IsNumber(since_item) && since_item->valuedouble >= 0 &&
+                     since_item->valuedouble <= snapshot.version;
+        uint32_t since = delta ? (uint32_t)since_item->valuedouble : 0;
+        
         cJSON *status_json = cJSON_CreateObject();
-        cJSON_AddBoolToObject(status_json, "light_enabled", status.light_enabled);
-        cJSON_AddNumberToObject(status_json, "light_brightness", status.light_brightness);
-        cJSON_AddNumberToObject(status_json, "light_red", status.light_red);
-        cJSON_AddNumberToObject(status_json, "light_green", status.light_green);
-        cJSON_AddNumberToObject(status_json, "light_blue", status.light_blue);
-        cJSON_AddBoolToObject(status_json, "fan_enabled", status.fan_enabled);
-        cJSON_AddNumberToObject(status_json, "fan_speed", status.fan_speed);
-        cJSON_AddNumberToObject(status_json, "fan_timer_minutes", status.fan_timer_minutes);
-        cJSON_AddNumberToObject(status_json, "fan_timer_start", status.fan_timer_start);
-        cJSON_AddNumberToObject(status_json, "temperature", status.temperature);
-        cJSON_AddNumberToObject(status_json, "humidity", status.humidity);
-        cJSON_AddNumberToObject(status_json, "last_sensor_update", status.last_sensor_update);
+        cJSON_AddNumberToObject(status_json, "version", snapshot.version);
+        if (delta && since == snapshot.version) {
+            cJSON_AddBoolToObject(status_json, "notModified", true);
+        } else {
+            for (size_t i = 0; i < STATUS_FIELD_COUNT; i++) {
+                if (!delta || snapshot.field_version[i] > since) {
+                    status_field_to_json(status_json, &g_status_fields[i], &snapshot.status);
+                }
+            }
+            if (!delta || snapshot.devices_version > since) {
+                devices_to_json(status_json, &snapshot.devices);
+            }
+            // 剩余时间随时间变化，不参与版本比较，定时器运行时总是返回
+            uint32_t remaining_ms = mcp_timer_remaining_ms(&g_fan_off_timer);
+            if (!delta || remaining_ms > 0) {
+                cJSON_AddNumberToObject(status_json, "fan_timer_remaining_s", (remaining_ms + 999) / 1000);
+            }
+            // 响应延迟统计同样不参与版本比较，只在完整读取时返回
+            mcp_response_latency_t latency;
+            if (!delta && mcp_server_get_response_latency(&latency) == 0) {
+                cJSON *latency_json = cJSON_CreateObject();
+                cJSON_AddNumberToObject(latency_json, "sent", latency.sent);
+                cJSON_AddNumberToObject(latency_json, "failed", latency.failed);
+                cJSON_AddNumberToObject(latency_json, "queue_avg_us", latency.queue_avg_us);
+                cJSON_AddNumberToObject(latency_json, "queue_max_us", latency.queue_max_us);
+                cJSON_AddNumberToObject(latency_json, "wire_avg_us", latency.wire_avg_us);
+                cJSON_AddNumberToObject(latency_json, "wire_max_us", latency.wire_max_us);
+                cJSON_AddItemToObject(status_json, "response_latency", latency_json);
+            }
+        }
         
         char *status_str = cJSON_PrintUnformatted(status_json);
         cJSON_AddStringToObject(content, "text", status_str);
         cJSON_free(status_str);
         cJSON_Delete(status_json);
+    } else if (strcmp(uri, "device://history") == 0) {
+        cJSON_AddStringToObject(content, "uri", uri);
+        cJSON_AddStringToObject(content, "mimeType", "application/json");
+        
+        cJSON *start_item = cJSON_GetObjectItem(params, "startSeconds");
+        cJSON *end_item = cJSON_GetObjectItem(params, "endSeconds");
+        cJSON *resolution_item = cJSON_GetObjectItem(params, "resolutionSeconds");
+        cJSON *max_item = cJSON_GetObjectItem(params, "maxSamples");
+        double start_s = start_item && cJSON_IsNumber(start_item) ? start_item->valuedouble : 3600;
+        double end_s = end_item && cJSON_IsNumber(end_item) && end_item->valuedouble > 0 ? end_item->valuedouble : 0;
+        double resolution_s = resolution_item && cJSON_IsNumber(resolution_item) ? resolution_item->valuedouble : 0;
+        int max_samples = max_item && cJSON_IsNumber(max_item) ? max_item->valueint : 60;
+        
+        cJSON *history_json = history_to_json(start_s, end_s, resolution_s, max_samples);
+        char *history_str = cJSON_PrintUnformatted(history_json);
+        cJSON_AddStringToObject(content, "text", history_str ? history_str : "{}");
+        cJSON_free(history_str);
+        cJSON_Delete(history_json);
     } else {
         cJSON_Delete(result);
         cJSON_Delete(contents);
@@ -929,3 +2752,21 @@ int mcp_server_websocket_send_response(const char *response) {
 void mcp_server_get_websocket_stats(uint32_t *sent_messages, uint32_t *received_messages, uint32_t *reconnect_count) {
     mcp_websocket_get_stats(sent_messages, received_messages, reconnect_count);
 }
+
+int mcp_server_get_response_latency(mcp_response_latency_t *stats) {
+    if (!stats) {
+        return -1;
+    }
+    
+    portENTER_CRITICAL(&g_response_latency.lock);
+    uint32_t sent = g_response_latency.sent;
+    stats->sent = sent;
+    stats->failed = g_response_latency.failed;
+    stats->queue_avg_us = sent ? (uint32_t)(g_response_latency.queue_total_us / sent) : 0;
+    stats->queue_max_us = g_response_latency.queue_max_us;
+    stats->wire_avg_us = sent ? (uint32_t)(g_response_latency.wire_total_us / sent) : 0;
+    stats->wire_max_us = g_response_latency.wire_max_us;
+    portEXIT_CRITICAL(&g_response_latency.lock);
+    
+    return 0;
+}
@@ -12,6 +12,16 @@ extern "C" {
 #define MCP_SERVER_PORT 3001
 #define MCP_SERVER_MAX_CONNECTIONS 5
 #define MCP_SERVER_BUFFER_SIZE 4096
+#define MCP_SERVER_TASK_STACK 6144      // Request task: JSON parse, tool execution, response
+#define MCP_SERVER_EXPORT_FRAME_SIZE 1024   // WebSocket fragment size for streamed history exports
+#define MCP_SERVER_TASK_PRIORITY 5
+#define MCP_SERVER_CONTROL_TASK_STACK 4096  // Control task: fan timer expiry and effect completions
+#define MCP_SERVER_CONTROL_QUEUE_LEN 8      // Pending control events from timer callbacks
+#define MCP_SERVER_ACTUATOR_TIMEOUT_MS 1000 // Max wait for the drivers to apply a control command
+#define MCP_FAN_TIMER_MAX_MINUTES 1440   // Fan auto-off timer limit (24 h)
+#define MCP_MAX_LIGHTS 4                 // Light instances in the device registry (CONFIG_MCP_LIGHT_COUNT <= this)
+#define MCP_MAX_FANS 2                   // Fan instances in the device registry (CONFIG_MCP_FAN_COUNT <= this)
+#define MCP_DEVICE_SELECT_ALL "all"      // device_id selector matching every instance of a type
 
 
 // MCP 传输模式
@@ -60,12 +70,75 @@ typedef struct {
     uint32_t last_sensor_update; // Timestamp of last sensor reading
 } mcp_device_status_t;
 
+// JSON-RPC response latency, split into time queued and time on the wire
+typedef struct {
+    uint32_t sent;              // Responses written to the transport
+    uint32_t failed;            // Responses dropped or failed to send
+    uint32_t queue_avg_us;      // Enqueue -> dequeue by the TX task
+    uint32_t queue_max_us;
+    uint32_t wire_avg_us;       // Dequeue -> write completed
+    uint32_t wire_max_us;
+} mcp_response_latency_t;
+
+// Partial light update, fields set to -1 are left unchanged
+typedef struct {
+    int enabled;             // 0/1, -1 = unchanged
+    int brightness;          // 0-100%, -1 = unchanged
+    int red;                 // 0-255, -1 = unchanged
+    int green;
+    int blue;
+} mcp_light_update_t;
+
+#define MCP_LIGHT_UPDATE_INIT { .enabled = -1, .brightness = -1, .red = -1, .green = -1, .blue = -1 }
+
+// Partial fan update, fields set to -1 are left unchanged
+typedef struct {
+    int enabled;             // 0/1, -1 = unchanged
+    int speed;               // 1-5, -1 = unchanged
+} mcp_fan_update_t;
+
+#define MCP_FAN_UPDATE_INIT { .enabled = -1, .speed = -1 }
+
+// Light effect request, numeric fields set to -1 use the default
+typedef struct {
+    const char *effect;      // "fade", "breathe", "cycle" or "stop"
+    int duration_ms;         // Fade time or breathe/cycle period, -1 = MCP_EFFECT_DEFAULT_DURATION_MS
+    int repeat;              // Breathe/cycle periods, 0 or -1 = until stopped
+    int brightness;          // Fade target / breathe peak / cycle brightness 0-100%, -1 = current
+    int red;                 // Fade target / breathe color 0-255, -1 = current
+    int green;
+    int blue;
+} mcp_light_effect_t;
+
+#define MCP_LIGHT_EFFECT_INIT { .effect = NULL, .duration_ms = -1, .repeat = -1, \
+                                .brightness = -1, .red = -1, .green = -1, .blue = -1 }
+
+// Light instances stored struct-of-arrays: instance i is "light<i>".
+// Instance 0 is mirrored into the light_* fields of mcp_device_status_t.
+typedef struct {
+    uint8_t count;
+    bool enabled[MCP_MAX_LIGHTS];
+    uint8_t brightness[MCP_MAX_LIGHTS];
+    uint8_t red[MCP_MAX_LIGHTS];
+    uint8_t green[MCP_MAX_LIGHTS];
+    uint8_t blue[MCP_MAX_LIGHTS];
+} mcp_light_table_t;
+
+// Fan instances stored struct-of-arrays: instance i is "fan<i>".
+// Instance 0 is mirrored into the fan_* fields of mcp_device_status_t.
+typedef struct {
+    uint8_t count;
+    bool enabled[MCP_MAX_FANS];
+    uint8_t speed[MCP_MAX_FANS];
+} mcp_fan_table_t;
+
 // Tool parameter structure
 typedef struct {
     char name[64];
     char type[32];           // "string", "number", "boolean"
     char description[256];
     bool required;
+    const char *(*enum_source)(int index);  // Allowed values for tools/list, NULL-terminated (optional)
 } mcp_tool_param_t;
 
 // Tool definition structure
@@ -106,21 +179,21 @@ int mcp_server_get_status(mcp_device_status_t *status);
 int mcp_server_update_sensors(float temperature, float humidity);
 
 /**
- * @brief Control light power
+ * @brief Control light0 power
  * @param enabled True to enable, false to disable
  * @return 0 on success, -1 on error
  */
 int mcp_server_control_light_power(bool enabled);
 
 /**
- * @brief Control light brightness
+ * @brief Control light0 brightness
  * @param brightness Brightness level 0-100%
  * @return 0 on success, -1 on error
  */
 int mcp_server_control_light_brightness(int brightness);
 
 /**
- * @brief Control light color
+ * @brief Control light0 color
  * @param red Red component 0-255
  * @param green Green component 0-255  
  * @param blue Blue component 0-255
@@ -129,21 +202,92 @@ int mcp_server_control_light_brightness(int brightness);
 int mcp_server_control_light_color(int red, int green, int blue);
 
 /**
- * @brief Control fan power
+ * @brief Update one light instance or all of them in one state update and one batched driver write
+ * @param device_id "light<N>", MCP_DEVICE_SELECT_ALL, or NULL/"" for light0
+ * @param update Fields to change (-1 = unchanged)
+ * @param result Resulting light table (may be NULL)
+ * @return 0 on success, -1 on error or unknown device_id
+ */
+int mcp_server_control_lights(const char *device_id, const mcp_light_update_t *update, mcp_light_table_t *result);
+
+/**
+ * @brief Update one fan instance or all of them in one state update and one batched driver write
+ * 
+ * Turning fan0 off also cancels the fan timer.
+ * 
+ * @param device_id "fan<N>", MCP_DEVICE_SELECT_ALL, or NULL/"" for fan0
+ * @param update Fields to change (-1 = unchanged)
+ * @param result Resulting fan table (may be NULL)
+ * @return 0 on success, -1 on error or unknown device_id
+ */
+int mcp_server_control_fans(const char *device_id, const mcp_fan_update_t *update, mcp_fan_table_t *result);
+
+/**
+ * @brief Run a light effect on one light instance or all of them
+ * 
+ * Effects are an overlay: frames go straight to the light driver and the device status keeps
+ * the underlying state. A finished fade commits its target; a finished or stopped breathe/cycle
+ * returns the light to its status. Any other light control on the instance stops the effect.
+ * 
+ * @param device_id "light<N>", MCP_DEVICE_SELECT_ALL, or NULL/"" for light0
+ * @param effect Effect request
+ * @return 0 on success, -1 on error or unknown device_id/effect
+ */
+int mcp_server_light_effect(const char *device_id, const mcp_light_effect_t *effect);
+
+/**
+ * @brief Get the state of every light and fan instance
+ * @param lights Light table (may be NULL)
+ * @param fans Fan table (may be NULL)
+ * @return 0 on success, -1 on error
+ */
+int mcp_server_get_devices(mcp_light_table_t *lights, mcp_fan_table_t *fans);
+
+/**
+ * @brief Light device_id selectors, usable as a tool parameter enum_source
+ * @param index 0..count-1 for "light<N>", count for MCP_DEVICE_SELECT_ALL
+ * @return Selector string, NULL past the end
+ */
+const char *mcp_server_light_id_at(int index);
+
+/**
+ * @brief Fan device_id selectors, usable as a tool parameter enum_source
+ * @param index 0..count-1 for "fan<N>", count for MCP_DEVICE_SELECT_ALL
+ * @return Selector string, NULL past the end
+ */
+const char *mcp_server_fan_id_at(int index);
+
+/**
+ * @brief Apply a scene to light0 and fan0 in one state update and one batched driver write
+ * @param name Scene name (built-in or saved)
+ * @param result Resulting device status (may be NULL)
+ * @return 0 on success, -1 on error or unknown scene
+ */
+int mcp_server_apply_scene(const char *name, mcp_device_status_t *result);
+
+/**
+ * @brief Save the current light0 and fan0 state as a named scene
+ * @param name Scene name (max MCP_SCENE_NAME_LEN - 1 characters)
+ * @return 0 on success, -1 on error
+ */
+int mcp_server_save_scene(const char *name);
+
+/**
+ * @brief Control fan0 power
  * @param enabled True to enable, false to disable
  * @return 0 on success, -1 on error
  */
 int mcp_server_control_fan_power(bool enabled);
 
 /**
- * @brief Control fan speed
+ * @brief Control fan0 speed
  * @param speed Fan speed level 1-5
  * @return 0 on success, -1 on error
  */
 int mcp_server_control_fan_speed(int speed);
 
 /**
- * @brief Set fan timer
+ * @brief Set fan0 auto-off timer
  * @param minutes Timer in minutes (0 to disable timer)
  * @return 0 on success, -1 on error
  */
@@ -199,6 +343,13 @@ int mcp_server_websocket_send_response(const char *response);
  */
 void mcp_server_get_websocket_stats(uint32_t *sent_messages, uint32_t *received_messages, uint32_t *reconnect_count);
 
+/**
+ * @brief 获取 JSON-RPC 响应的发送延迟统计
+ * @param stats 输出统计信息
+ * @return 0 on success, -1 on error
+ */
+int mcp_server_get_response_latency(mcp_response_latency_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,182 @@
+/**
+ * @file mcp_stats.c
+ * @brief 滑动窗口统计 - 每个窗口分为固定数量的时间桶，桶内用 Welford 算法累计矩
+ *
+ * 每个样本只更新各窗口的当前桶 (O(1))；查询时用 Chan 的合并公式合并窗口内的桶。
+ * 桶记录自己的编号，过期的桶在被复用或查询时识别，采样中断后不需要清理。
+ */
+
+#include "mcp_stats.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "mcp_stats";
+
+#define SENSOR_COUNT 2      // 温度、湿度
+
+typedef struct {
+    float mean;
+    float m2;               // 与均值差的平方和
+    float min;
+    float max;
+} stats_moments_t;
+
+typedef struct {
+    uint32_t id;            // 桶编号 (time / bucket_ms + 1)，0 为空桶
+    uint16_t count;
+    stats_moments_t sensor[SENSOR_COUNT];
+} stats_bucket_t;
+
+static const char *const g_window_names[MCP_STATS_WINDOW_COUNT] = {
+    [MCP_STATS_WINDOW_1M] = "1m",
+    [MCP_STATS_WINDOW_1H] = "1h",
+    [MCP_STATS_WINDOW_24H] = "24h",
+};
+
+static const uint32_t g_window_ms[MCP_STATS_WINDOW_COUNT] = {
+    [MCP_STATS_WINDOW_1M] = MCP_STATS_WINDOW_1M_MS,
+    [MCP_STATS_WINDOW_1H] = MCP_STATS_WINDOW_1H_MS,
+    [MCP_STATS_WINDOW_24H] = MCP_STATS_WINDOW_24H_MS,
+};
+
+static struct {
+    stats_bucket_t buckets[MCP_STATS_WINDOW_COUNT][MCP_STATS_BUCKETS];
+    SemaphoreHandle_t lock;
+} g_stats;
+
+static inline uint32_t bucket_id(mcp_stats_window_t window, int64_t time_ms) {
+    return (uint32_t)(time_ms / (g_window_ms[window] / MCP_STATS_BUCKETS)) + 1;
+}
+
+static void moments_add(stats_moments_t *m, uint16_t count, float value) {
+    if (count == 1) {
+        m->mean = value;
+        m->m2 = 0;
+        m->min = value;
+        m->max = value;
+        return;
+    }
+
+    float delta = value - m->mean;
+    m->mean += delta / count;
+    m->m2 += delta * (value - m->mean);
+    if (value < m->min) {
+        m->min = value;
+    }
+    if (value > m->max) {
+        m->max = value;
+    }
+}
+
+int mcp_stats_init(void) {
+    if (g_stats.lock) {
+        return 0;
+    }
+
+    g_stats.lock = xSemaphoreCreateMutex();
+    if (!g_stats.lock) {
+        ESP_LOGE(TAG, "Failed to create stats lock");
+        return -1;
+    }
+    return 0;
+}
+
+void mcp_stats_add(int64_t time_ms, float temperature, float humidity) {
+    if (!g_stats.lock || time_ms < 0 || !isfinite(temperature) || !isfinite(humidity)) {
+        return;
+    }
+
+    const float values[SENSOR_COUNT] = {temperature, humidity};
+    xSemaphoreTake(g_stats.lock, portMAX_DELAY);
+    for (int w = 0; w < MCP_STATS_WINDOW_COUNT; w++) {
+        uint32_t id = bucket_id(w, time_ms);
+        stats_bucket_t *bucket = &g_stats.buckets[w][id % MCP_STATS_BUCKETS];
+        if (bucket->id != id) {
+            // 复用过期的桶
+            bucket->id = id;
+            bucket->count = 0;
+        }
+        if (bucket->count == UINT16_MAX) {
+            continue;
+        }
+        bucket->count++;
+        for (int s = 0; s < SENSOR_COUNT; s++) {
+            moments_add(&bucket->sensor[s], bucket->count, values[s]);
+        }
+    }
+    xSemaphoreGive(g_stats.lock);
+}
+
+int mcp_stats_get(mcp_stats_window_t window, int64_t now_ms,
+                  mcp_stats_result_t *temperature, mcp_stats_result_t *humidity) {
+    if ((unsigned)window >= MCP_STATS_WINDOW_COUNT || now_ms < 0) {
+        return -1;
+    }
+
+    // 合并在 double 中进行，24 小时窗口的样本数较多
+    double count = 0;
+    double mean[SENSOR_COUNT] = {0};
+    double m2[SENSOR_COUNT] = {0};
+    float min[SENSOR_COUNT] = {0};
+    float max[SENSOR_COUNT] = {0};
+    uint32_t current = bucket_id(window, now_ms);
+
+    if (g_stats.lock) {
+        xSemaphoreTake(g_stats.lock, portMAX_DELAY);
+        for (int i = 0; i < MCP_STATS_BUCKETS; i++) {
+            const stats_bucket_t *bucket = &g_stats.buckets[window][i];
+            if (!bucket->count || bucket->id > current || current - bucket->id >= MCP_STATS_BUCKETS) {
+                continue;
+            }
+
+            double n = bucket->count;
+            double total = count + n;
+            for (int s = 0; s < SENSOR_COUNT; s++) {
+                const stats_moments_t *m = &bucket->sensor[s];
+                double delta = m->mean - mean[s];
+                mean[s] += delta * n / total;
+                m2[s] += m->m2 + delta * delta * count * n / total;
+                if (count == 0 || m->min < min[s]) {
+                    min[s] = m->min;
+                }
+                if (count == 0 || m->max > max[s]) {
+                    max[s] = m->max;
+                }
+            }
+            count = total;
+        }
+        xSemaphoreGive(g_stats.lock);
+    }
+
+    mcp_stats_result_t *results[SENSOR_COUNT] = {temperature, humidity};
+    for (int s = 0; s < SENSOR_COUNT; s++) {
+        if (!results[s]) {
+            continue;
+        }
+        memset(results[s], 0, sizeof(*results[s]));
+        if (count > 0) {
+            results[s]->count = (uint32_t)count;
+            results[s]->min = min[s];
+            results[s]->max = max[s];
+            results[s]->mean = (float)mean[s];
+            results[s]->stddev = (float)sqrt(m2[s] > 0 ? m2[s] / count : 0);
+        }
+    }
+    return 0;
+}
+
+const char *mcp_stats_window_name_at(int index) {
+    return index >= 0 && index < MCP_STATS_WINDOW_COUNT ? g_window_names[index] : NULL;
+}
+
+int mcp_stats_window_from_name(const char *name) {
+    for (int i = 0; name && i < MCP_STATS_WINDOW_COUNT; i++) {
+        if (strcmp(g_window_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
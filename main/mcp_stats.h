@@ -0,0 +1,84 @@
+#ifndef _MCP_STATS_H_
+#define _MCP_STATS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 滑动窗口统计配置
+#define MCP_STATS_BUCKETS           60          // 每个窗口的桶数
+#define MCP_STATS_WINDOW_1M_MS      60000
+#define MCP_STATS_WINDOW_1H_MS      3600000
+#define MCP_STATS_WINDOW_24H_MS     86400000
+
+/**
+ * @brief 统计窗口
+ */
+typedef enum {
+    MCP_STATS_WINDOW_1M = 0,
+    MCP_STATS_WINDOW_1H,
+    MCP_STATS_WINDOW_24H,
+    MCP_STATS_WINDOW_COUNT
+} mcp_stats_window_t;
+
+/**
+ * @brief 一个传感器在窗口内的统计
+ */
+typedef struct {
+    uint32_t count;         ///< 样本数，为 0 时其余字段无效
+    float min;
+    float max;
+    float mean;
+    float stddev;           ///< 总体标准差
+} mcp_stats_result_t;
+
+/**
+ * @brief 初始化统计模块
+ * @return 0 on success, -1 on failure
+ */
+int mcp_stats_init(void);
+
+/**
+ * @brief 加入一个样本，O(1)，在传感器任务中每次采样调用
+ * @param time_ms 启动后的时间 (ms)
+ * @param temperature 温度 °C
+ * @param humidity 湿度 %
+ */
+void mcp_stats_add(int64_t time_ms, float temperature, float humidity);
+
+/**
+ * @brief 获取窗口统计
+ *
+ * 窗口按桶对齐：包含当前桶和之前 MCP_STATS_BUCKETS-1 个桶，
+ * 覆盖时长在窗口长度的 (BUCKETS-1)/BUCKETS 到 1 倍之间。
+ *
+ * @param window 窗口
+ * @param now_ms 当前时间 (ms)
+ * @param temperature 输出温度统计 (可为 NULL)
+ * @param humidity 输出湿度统计 (可为 NULL)
+ * @return 0 on success, -1 on invalid window
+ */
+int mcp_stats_get(mcp_stats_window_t window, int64_t now_ms,
+                  mcp_stats_result_t *temperature, mcp_stats_result_t *humidity);
+
+/**
+ * @brief 窗口名称表 ("1m", "1h", "24h")，可作为工具参数的 enum_source
+ * @param index 下标
+ * @return 名称，超出范围时为 NULL
+ */
+const char *mcp_stats_window_name_at(int index);
+
+/**
+ * @brief 按名称查找窗口
+ * @param name 名称
+ * @return 窗口，未知名称时为 -1
+ */
+int mcp_stats_window_from_name(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_STATS_H_ */
@@ -0,0 +1,183 @@
+/**
+ * @file mcp_timer.c
+ * @brief 定时器服务 - 哈希定时器轮，由单个 esp_timer 驱动
+ *
+ * 定时器按到期刻度挂到 expires % MCP_TIMER_WHEEL_SLOTS 槽的双向链表上，启动和取消都是 O(1)。
+ * 每个刻度只检查当前槽，超过一圈的定时器留在槽里等下一圈。
+ * 没有待触发的定时器时停止 esp_timer，空闲时没有开销。
+ */
+
+#include "mcp_timer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "mcp_timer";
+
+#define WHEEL_MASK (MCP_TIMER_WHEEL_SLOTS - 1)
+
+_Static_assert((MCP_TIMER_WHEEL_SLOTS & WHEEL_MASK) == 0, "MCP_TIMER_WHEEL_SLOTS must be a power of two");
+
+// 定时器服务状态
+static struct {
+    mcp_timer_t *slots[MCP_TIMER_WHEEL_SLOTS];
+    uint32_t now;                   // 当前刻度
+    int64_t last_tick_us;           // 上次刻度的时间
+    uint32_t armed_count;
+    bool running;
+    esp_timer_handle_t tick_timer;
+    SemaphoreHandle_t lock;         // 回调在锁外执行，可以在回调中启动/取消定时器
+} g_timer;
+
+static void wheel_unlink(mcp_timer_t *timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        g_timer.slots[timer->expires & WHEEL_MASK] = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->next = timer->prev = NULL;
+    timer->armed = false;
+    g_timer.armed_count--;
+}
+
+static void tick_timer_callback(void *arg) {
+    mcp_timer_t *expired = NULL;
+
+    xSemaphoreTake(g_timer.lock, portMAX_DELAY);
+    g_timer.now++;
+    g_timer.last_tick_us = esp_timer_get_time();
+
+    // 从当前槽取出到期的定时器，放到本地链表
+    mcp_timer_t *timer = g_timer.slots[g_timer.now & WHEEL_MASK];
+    while (timer) {
+        mcp_timer_t *next = timer->next;
+        if ((int32_t)(timer->expires - g_timer.now) <= 0) {
+            wheel_unlink(timer);
+            timer->next = expired;
+            expired = timer;
+        }
+        timer = next;
+    }
+
+    if (g_timer.armed_count == 0 && g_timer.running) {
+        esp_timer_stop(g_timer.tick_timer);
+        g_timer.running = false;
+    }
+    xSemaphoreGive(g_timer.lock);
+
+    while (expired) {
+        mcp_timer_t *next = expired->next;
+        expired->next = NULL;
+        expired->callback(expired->arg);
+        expired = next;
+    }
+}
+
+int mcp_timer_service_init(void) {
+    if (g_timer.lock) {
+        return 0;
+    }
+
+    g_timer.lock = xSemaphoreCreateMutex();
+    if (!g_timer.lock) {
+        ESP_LOGE(TAG, "Failed to create timer lock");
+        return -1;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = tick_timer_callback,
+        .name = "mcp_timer"
+    };
+    if (esp_timer_create(&timer_args, &g_timer.tick_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create tick timer");
+        vSemaphoreDelete(g_timer.lock);
+        g_timer.lock = NULL;
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Timer service initialized, tick: %d ms, slots: %d", MCP_TIMER_TICK_MS, MCP_TIMER_WHEEL_SLOTS);
+    return 0;
+}
+
+void mcp_timer_init(mcp_timer_t *timer, mcp_timer_cb_t callback, void *arg) {
+    memset(timer, 0, sizeof(*timer));
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+int mcp_timer_arm(mcp_timer_t *timer, uint32_t delay_ms) {
+    if (!timer || !timer->callback || !g_timer.lock) {
+        return -1;
+    }
+
+    uint32_t ticks = (delay_ms + MCP_TIMER_TICK_MS - 1) / MCP_TIMER_TICK_MS;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+
+    xSemaphoreTake(g_timer.lock, portMAX_DELAY);
+    if (timer->armed) {
+        wheel_unlink(timer);
+    }
+
+    timer->expires = g_timer.now + ticks;
+    mcp_timer_t **slot = &g_timer.slots[timer->expires & WHEEL_MASK];
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+    timer->armed = true;
+    g_timer.armed_count++;
+
+    int ret = 0;
+    if (!g_timer.running) {
+        g_timer.last_tick_us = esp_timer_get_time();
+        if (esp_timer_start_periodic(g_timer.tick_timer, MCP_TIMER_TICK_MS * 1000) == ESP_OK) {
+            g_timer.running = true;
+        } else {
+            ESP_LOGE(TAG, "Failed to start tick timer");
+            wheel_unlink(timer);
+            ret = -1;
+        }
+    }
+    xSemaphoreGive(g_timer.lock);
+
+    return ret;
+}
+
+void mcp_timer_cancel(mcp_timer_t *timer) {
+    if (!timer || !g_timer.lock) {
+        return;
+    }
+
+    xSemaphoreTake(g_timer.lock, portMAX_DELAY);
+    if (timer->armed) {
+        wheel_unlink(timer);
+    }
+    // 空闲时的 esp_timer 由下一个刻度停止
+    xSemaphoreGive(g_timer.lock);
+}
+
+uint32_t mcp_timer_remaining_ms(const mcp_timer_t *timer) {
+    if (!timer || !g_timer.lock) {
+        return 0;
+    }
+
+    uint32_t remaining = 0;
+    xSemaphoreTake(g_timer.lock, portMAX_DELAY);
+    if (timer->armed) {
+        int64_t ms = (int64_t)(timer->expires - g_timer.now) * MCP_TIMER_TICK_MS -
+                     (esp_timer_get_time() - g_timer.last_tick_us) / 1000;
+        remaining = ms > 0 ? (uint32_t)ms : 0;
+    }
+    xSemaphoreGive(g_timer.lock);
+
+    return remaining;
+}
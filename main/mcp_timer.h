@@ -0,0 +1,72 @@
+#ifndef _MCP_TIMER_H_
+#define _MCP_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 定时器轮配置
+#define MCP_TIMER_TICK_MS           1000    // 轮的刻度（定时精度）
+#define MCP_TIMER_WHEEL_SLOTS       64      // 槽数，必须是 2 的幂
+
+/**
+ * @brief 定时器到期回调，在 esp_timer 任务中执行，不能长时间阻塞
+ */
+typedef void (*mcp_timer_cb_t)(void *arg);
+
+/**
+ * @brief 定时器（由调用者分配，侵入式链表节点）
+ * 字段由定时器服务维护，调用者不要直接修改
+ */
+typedef struct mcp_timer {
+    struct mcp_timer *next;
+    struct mcp_timer *prev;
+    uint32_t expires;               ///< 到期刻度
+    mcp_timer_cb_t callback;
+    void *arg;
+    bool armed;
+} mcp_timer_t;
+
+/**
+ * @brief 初始化定时器服务（没有待触发的定时器时底层 esp_timer 不运行）
+ * @return 0 on success, -1 on failure
+ */
+int mcp_timer_service_init(void);
+
+/**
+ * @brief 初始化定时器
+ * @param timer 定时器
+ * @param callback 到期回调
+ * @param arg 回调参数
+ */
+void mcp_timer_init(mcp_timer_t *timer, mcp_timer_cb_t callback, void *arg);
+
+/**
+ * @brief 启动定时器，O(1)；已启动的定时器会重新计时
+ * @param timer 定时器
+ * @param delay_ms 延迟，向上取整到 MCP_TIMER_TICK_MS
+ * @return 0 on success, -1 on failure
+ */
+int mcp_timer_arm(mcp_timer_t *timer, uint32_t delay_ms);
+
+/**
+ * @brief 取消定时器，O(1)；未启动的定时器直接返回
+ * @param timer 定时器
+ */
+void mcp_timer_cancel(mcp_timer_t *timer);
+
+/**
+ * @brief 获取定时器剩余时间
+ * @param timer 定时器
+ * @return 剩余毫秒数，未启动时返回 0
+ */
+uint32_t mcp_timer_remaining_ms(const mcp_timer_t *timer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MCP_TIMER_H_ */
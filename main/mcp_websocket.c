@@ -1,9 +1,16 @@
 /**
  * @file mcp_websocket.c
- * @brief MCP WebSocket客户端实现 - 单任务状态机架构
+ * @brief MCP WebSocket客户端实现 - 状态机任务 + RX/TX 任务架构
+ *
+ * - ws_main: 状态机，负责建立连接、断线重连和资源清理
+ * - ws_rx:   连接阶段负责读取和帧重组，并分发 MESSAGE_RECEIVED 事件
+ * - ws_tx:   连接阶段负责发送队列
+ * RX/TX 任务在链路断开时置位 WS_EVT_LINK_DOWN，由状态机统一处理重连。
+ * 停止时由状态机驱动：排空发送队列、完成关闭握手后任务自行退出。
  */
 
 #include "mcp_websocket.h"
+#include "mcp_log.h"
 #include "esp_log.h"
 #include "esp_transport.h"
 #include "esp_transport_tcp.h"
@@ -12,6 +19,8 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "freertos/timers.h"
 #include "esp_timer.h"
 #include "cJSON.h"
@@ -21,6 +30,16 @@
 
 static const char *TAG = "mcp_websocket";
 
+// 任务间协调事件位
+#define WS_EVT_LINK_UP      BIT0    // 连接阶段，RX/TX 任务运行中
+#define WS_EVT_LINK_DOWN    BIT1    // RX/TX 检测到链路断开
+#define WS_EVT_RX_EXITED    BIT2
+#define WS_EVT_TX_EXITED    BIT3
+#define WS_EVT_STOP         BIT4    // 请求停止
+#define WS_EVT_TX_DRAINED   BIT5    // 发送队列已排空，关闭帧已发送
+#define WS_EVT_CLOSE_RCVD   BIT6    // 收到对端关闭帧
+#define WS_EVT_TASK_EXITED  BIT7    // 状态机任务已退出
+
 // WebSocket客户端状态机
 typedef struct {
     // 基本配置
@@ -43,7 +62,17 @@ typedef struct {
     
     // 任务和队列
     TaskHandle_t main_task;
+    TaskHandle_t rx_task;
+    TaskHandle_t tx_task;
     QueueHandle_t send_queue;
+    EventGroupHandle_t events;
+    SemaphoreHandle_t transport_lock;   // 串行化 RX/TX 对传输层的实际读写
+    SemaphoreHandle_t stream_lock;      // 分片消息期间独占文本消息的入队
+    uint32_t stream_frames;             // 当前流已入队的帧数
+    
+    // 接收缓冲区池
+    mcp_ws_rx_buffer_t rx_buffers[MCP_WS_RX_BUFFER_COUNT];
+    QueueHandle_t rx_free_queue;        // 空闲缓冲区
     
     // 定时器
     esp_timer_handle_t ping_timer;
@@ -58,6 +87,7 @@ typedef struct {
     // 控制标志
     bool initialized;
     bool should_stop;
+    int64_t stop_deadline_us;           // 停止期限
     bool auto_reconnect_enabled;
     
 } mcp_websocket_client_t;
@@ -65,6 +95,8 @@ typedef struct {
 static mcp_websocket_client_t g_ws_client = {0};
 
 static void websocket_main_task(void *pvParameters);
+static void websocket_rx_task(void *pvParameters);
+static void websocket_tx_task(void *pvParameters);
 static void ping_timer_callback(void *arg);
 
 static esp_err_t parse_url(const char *url);
@@ -73,11 +105,17 @@ static void cleanup_transport(void);
 static void set_state(mcp_ws_state_t new_state);
 static void trigger_event(mcp_ws_event_type_t event_type, const char *data, size_t data_len, esp_err_t error_code);
 static esp_err_t enqueue_send_message(mcp_ws_msg_type_t type, const char *data, size_t data_len);
+static esp_err_t enqueue_send_message_ex(mcp_ws_msg_type_t type, const char *data, size_t data_len,
+                                         mcp_ws_send_done_cb_t done_cb, void *cookie);
+static esp_err_t enqueue_message(mcp_ws_msg_type_t type, const char *data, size_t data_len,
+                                 mcp_ws_send_done_cb_t done_cb, void *cookie, bool stream);
+static void complete_send_message(mcp_ws_send_msg_t *msg, esp_err_t result);
 static void free_send_message(mcp_ws_send_msg_t *msg);
+static void free_rx_buffers(void);
 
 static void set_state(mcp_ws_state_t new_state) {
     if (g_ws_client.state != new_state) {
-        ESP_LOGD(TAG, "State change: %d -> %d", g_ws_client.state, new_state);
+        MCP_LOGD_DEFER(MCP_LOG_WS_STATE_CHANGE, g_ws_client.state, new_state);
         g_ws_client.state = new_state;
         g_ws_client.state_start_time = esp_timer_get_time() / 1000; // ms
     }
@@ -96,6 +134,18 @@ static void trigger_event(mcp_ws_event_type_t event_type, const char *data, size
 }
 
 static esp_err_t enqueue_send_message(mcp_ws_msg_type_t type, const char *data, size_t data_len) {
+    return enqueue_send_message_ex(type, data, data_len, NULL, NULL);
+}
+
+static esp_err_t enqueue_send_message_ex(mcp_ws_msg_type_t type, const char *data, size_t data_len,
+                                         mcp_ws_send_done_cb_t done_cb, void *cookie) {
+    return enqueue_message(type, data, data_len, done_cb, cookie, false);
+}
+
+// 流的帧等待队列空间直到链路断开或请求停止，慢速链路上形成背压而不是超时丢帧；
+// 其他消息最多等待 MCP_WS_SEND_TIMEOUT_MS
+static esp_err_t enqueue_message(mcp_ws_msg_type_t type, const char *data, size_t data_len,
+                                 mcp_ws_send_done_cb_t done_cb, void *cookie, bool stream) {
     if (!g_ws_client.send_queue) {
         ESP_LOGE(TAG, "Send queue not initialized");
         return ESP_ERR_INVALID_STATE;
@@ -110,6 +160,10 @@ static esp_err_t enqueue_send_message(mcp_ws_msg_type_t type, const char *data,
     
     msg->type = type;
     msg->data_len = data_len;
+    msg->done_cb = done_cb;
+    msg->cookie = cookie;
+    msg->enqueue_time_us = esp_timer_get_time();
+    msg->dequeue_time_us = 0;
     
     if (data && data_len > 0) {
         msg->data = malloc(data_len + 1);
@@ -125,16 +179,43 @@ static esp_err_t enqueue_send_message(mcp_ws_msg_type_t type, const char *data,
     }
     
     // 入队
-    if (xQueueSend(g_ws_client.send_queue, &msg, pdMS_TO_TICKS(MCP_WS_SEND_TIMEOUT_MS)) != pdTRUE) {
+    if (stream) {
+        while (xQueueSend(g_ws_client.send_queue, &msg, pdMS_TO_TICKS(MCP_WS_TX_POLL_TIMEOUT_MS)) != pdTRUE) {
+            EventBits_t bits = xEventGroupGetBits(g_ws_client.events);
+            if (!(bits & WS_EVT_LINK_UP) || (bits & (WS_EVT_LINK_DOWN | WS_EVT_STOP))) {
+                ESP_LOGW(TAG, "Link down, dropping stream frame");
+                free_send_message(msg);
+                return ESP_ERR_INVALID_STATE;
+            }
+        }
+    } else if (xQueueSend(g_ws_client.send_queue, &msg, pdMS_TO_TICKS(MCP_WS_SEND_TIMEOUT_MS)) != pdTRUE) {
         ESP_LOGW(TAG, "Send queue full, dropping message");
         free_send_message(msg);
         return ESP_ERR_TIMEOUT;
     }
     
-    ESP_LOGD(TAG, "Message enqueued, type: %d, size: %d", type, (int)data_len);
+    MCP_LOGD_DEFER(MCP_LOG_WS_ENQUEUED, type, (int)data_len);
     return ESP_OK;
 }
 
+// 通知发送方结果并释放消息
+static void complete_send_message(mcp_ws_send_msg_t *msg, esp_err_t result) {
+    if (!msg) {
+        return;
+    }
+    if (msg->done_cb) {
+        mcp_ws_send_result_t send_result = {
+            .result = result,
+            .data_len = msg->data_len,
+            .enqueue_time_us = msg->enqueue_time_us,
+            .dequeue_time_us = msg->dequeue_time_us,
+            .complete_time_us = esp_timer_get_time()
+        };
+        msg->done_cb(&send_result, msg->cookie);
+    }
+    free_send_message(msg);
+}
+
 static void free_send_message(mcp_ws_send_msg_t *msg) {
     if (msg) {
         if (msg->data) {
@@ -333,7 +414,7 @@ static void cleanup_transport(void) {
 
     if (g_ws_client.send_queue) {
         while(xQueueReceive(g_ws_client.send_queue, &send_msg, 0) == pdTRUE) {
-            free_send_message(send_msg);
+            complete_send_message(send_msg, ESP_ERR_INVALID_STATE);
         }
     }
 
@@ -349,25 +430,414 @@ static void cleanup_transport(void) {
 }
 
 static void ping_timer_callback(void *arg) {
-    ESP_LOGD(TAG, "Ping timer triggered - sending WebSocket PING frame");
+    MCP_LOGD_DEFER(MCP_LOG_WS_PING_TIMER);
     // 发送WebSocket层面的PING帧 (4字节随机数据)
     uint8_t ping_data[4] = {0x12, 0x34, 0x56, 0x78};
     enqueue_send_message(MCP_WS_MSG_TYPE_PING, (char*)ping_data, 4);
     esp_timer_start_once(g_ws_client.ping_timer, g_ws_client.config.ping_interval_ms * 1000);
 }
 
+static void link_down(void) {
+    xEventGroupSetBits(g_ws_client.events, WS_EVT_LINK_DOWN);
+}
+
+// 距离停止期限的剩余时间 (ms)
+static uint32_t stop_remaining_ms(void) {
+    int64_t remaining = (g_ws_client.stop_deadline_us - esp_timer_get_time()) / 1000;
+    return remaining > 0 ? (uint32_t)remaining : 0;
+}
+
+// 单次写超时，停止过程中不超过剩余期限
+static int send_timeout_ms(void) {
+    if (!g_ws_client.should_stop) {
+        return 1000;
+    }
+    uint32_t remaining = stop_remaining_ms();
+    return remaining < 10 ? 10 : (remaining > 1000 ? 1000 : (int)remaining);
+}
+
+// 等待指定时间，收到停止请求时提前返回
+static void wait_or_stop(uint32_t ms) {
+    xEventGroupWaitBits(g_ws_client.events, WS_EVT_STOP, pdFALSE, pdFALSE, pdMS_TO_TICKS(ms));
+}
+
+// 从池中取一个空闲接收缓冲区，链路断开时返回 NULL
+static mcp_ws_rx_buffer_t *acquire_rx_buffer(void) {
+    mcp_ws_rx_buffer_t *buffer = NULL;
+
+    while (xEventGroupGetBits(g_ws_client.events) & WS_EVT_LINK_UP) {
+        if (xQueueReceive(g_ws_client.rx_free_queue, &buffer, pdMS_TO_TICKS(MCP_WS_RX_POLL_TIMEOUT_MS)) == pdTRUE) {
+            buffer->claimed = false;
+            buffer->len = 0;
+            return buffer;
+        }
+    }
+    return NULL;
+}
+
+static void trigger_receive_event(mcp_ws_rx_buffer_t *buffer) {
+    if (g_ws_client.event_callback) {
+        mcp_ws_event_t event = {
+            .event_type = MCP_WS_EVENT_MESSAGE_RECEIVED,
+            .data = buffer->data,
+            .data_len = buffer->len,
+            .error_code = ESP_OK,
+            .rx_buffer = buffer
+        };
+        g_ws_client.event_callback(&event);
+    }
+}
+
+// 帧的操作码和 FIN 位
+static int ws_opcode_for(mcp_ws_msg_type_t type) {
+    switch (type) {
+        case MCP_WS_MSG_TYPE_TEXT:
+            return WS_TRANSPORT_OPCODES_TEXT | WS_TRANSPORT_OPCODES_FIN;
+        case MCP_WS_MSG_TYPE_PING:
+            return WS_TRANSPORT_OPCODES_PING | WS_TRANSPORT_OPCODES_FIN;
+        case MCP_WS_MSG_TYPE_PONG:
+            return WS_TRANSPORT_OPCODES_PONG | WS_TRANSPORT_OPCODES_FIN;
+        case MCP_WS_MSG_TYPE_CLOSE:
+            return WS_TRANSPORT_OPCODES_CLOSE | WS_TRANSPORT_OPCODES_FIN;
+        case MCP_WS_MSG_TYPE_TEXT_PART:
+            return WS_TRANSPORT_OPCODES_TEXT;
+        case MCP_WS_MSG_TYPE_CONT:
+            return WS_TRANSPORT_OPCODES_CONT;
+        case MCP_WS_MSG_TYPE_CONT_FIN:
+            return WS_TRANSPORT_OPCODES_CONT | WS_TRANSPORT_OPCODES_FIN;
+        default:
+            return WS_TRANSPORT_OPCODES_TEXT | WS_TRANSPORT_OPCODES_FIN;
+    }
+}
+
+// 发送任务：连接阶段独占发送队列
+static void websocket_tx_task(void *pvParameters) {
+    mcp_ws_send_msg_t *send_msg = NULL;
+    bool in_fragment = false;       // 本连接上已发送分片消息的第一帧
+
+    while (xEventGroupGetBits(g_ws_client.events) & WS_EVT_LINK_UP) {
+        if (xQueueReceive(g_ws_client.send_queue, &send_msg, pdMS_TO_TICKS(MCP_WS_TX_POLL_TIMEOUT_MS)) != pdTRUE) {
+            continue;
+        }
+        send_msg->dequeue_time_us = esp_timer_get_time();
+
+        if (send_msg->type == MCP_WS_MSG_TYPE_SHUTDOWN) {
+            // 之前入队的消息都已发送，发送关闭帧 (1000 正常关闭) 后不再发送任何数据帧
+            static const char close_payload[2] = {0x03, (char)0xE8};
+            xSemaphoreTake(g_ws_client.transport_lock, portMAX_DELAY);
+            esp_transport_ws_send_raw(g_ws_client.transport, WS_TRANSPORT_OPCODES_CLOSE | WS_TRANSPORT_OPCODES_FIN,
+                                      close_payload, sizeof(close_payload), send_timeout_ms());
+            xSemaphoreGive(g_ws_client.transport_lock);
+            complete_send_message(send_msg, ESP_OK);
+            xEventGroupSetBits(g_ws_client.events, WS_EVT_TX_DRAINED);
+            break;
+        }
+
+        // 第一帧在之前的连接上发送的分片消息无法续传，丢弃剩余的帧
+        bool continuation = send_msg->type == MCP_WS_MSG_TYPE_CONT || send_msg->type == MCP_WS_MSG_TYPE_CONT_FIN;
+        if (continuation && !in_fragment) {
+            complete_send_message(send_msg, ESP_ERR_INVALID_STATE);
+            continue;
+        }
+        if (send_msg->type == MCP_WS_MSG_TYPE_TEXT_PART) {
+            in_fragment = true;
+        } else if (send_msg->type == MCP_WS_MSG_TYPE_CONT_FIN) {
+            in_fragment = false;
+        }
+
+        MCP_LOGD_DEFER(MCP_LOG_WS_SENDING, send_msg->type, (int)send_msg->data_len);
+
+        xSemaphoreTake(g_ws_client.transport_lock, portMAX_DELAY);
+        int sent = esp_transport_ws_send_raw(g_ws_client.transport, ws_opcode_for(send_msg->type),
+                                             send_msg->data, send_msg->data_len, send_timeout_ms());
+        xSemaphoreGive(g_ws_client.transport_lock);
+
+        if (sent < 0) {
+            MCP_LOGW_DEFER(MCP_LOG_WS_SEND_FAILED, sent);
+            complete_send_message(send_msg, ESP_FAIL);
+            link_down();
+            break;
+        }
+
+        g_ws_client.sent_messages++;
+        if (send_msg->type == MCP_WS_MSG_TYPE_TEXT) {
+            trigger_event(MCP_WS_EVENT_MESSAGE_SENT, send_msg->data, send_msg->data_len, ESP_OK);
+        }
+        complete_send_message(send_msg, ESP_OK);
+    }
+
+    g_ws_client.tx_task = NULL;
+    xEventGroupSetBits(g_ws_client.events, WS_EVT_TX_EXITED);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 读取一个完整的帧载荷
+ *
+ * 每次读取时才持有 transport_lock，等待剩余载荷时释放，发送不会被整帧阻塞。
+ * 帧开始后剩余载荷在 MCP_WS_RX_FRAME_TIMEOUT_MS 内没有到达时流已无法对齐，按链路错误返回，
+ * 不把不完整的载荷当作完整的帧交给上层。
+ *
+ * @param truncated 载荷超出缓冲区时置 true，超出部分被读出丢弃
+ * @param opcode 输出帧的操作码
+ * @param fin 输出帧的 FIN 标志
+ * @return 读取的字节数，<0 表示链路错误
+ */
+static int read_frame_payload(char *buffer, int offset, int capacity, bool *truncated,
+                              ws_transport_opcodes_t *opcode, bool *fin) {
+    *truncated = false;
+    xSemaphoreTake(g_ws_client.transport_lock, portMAX_DELAY);
+    int len = esp_transport_read(g_ws_client.transport, buffer + offset, capacity - offset,
+                                 MCP_WS_RX_POLL_TIMEOUT_MS);
+    *opcode = esp_transport_ws_get_read_opcode(g_ws_client.transport);
+    *fin = esp_transport_ws_get_fin_flag(g_ws_client.transport);
+    int payload_len = esp_transport_ws_get_read_payload_len(g_ws_client.transport);
+    xSemaphoreGive(g_ws_client.transport_lock);
+    if (len <= 0) {
+        return len;
+    }
+
+    // 帧载荷大于单次读取时继续读取剩余部分
+    int64_t deadline = esp_timer_get_time() + (int64_t)MCP_WS_RX_FRAME_TIMEOUT_MS * 1000;
+    int total = len;
+    while (total < payload_len) {
+        if (esp_timer_get_time() >= deadline) {
+            ESP_LOGW(TAG, "Frame incomplete after %d ms: %d of %d bytes",
+                     MCP_WS_RX_FRAME_TIMEOUT_MS, total, payload_len);
+            return -1;
+        }
+        int ready = esp_transport_poll_read(g_ws_client.transport, MCP_WS_RX_POLL_TIMEOUT_MS);
+        if (ready < 0) {
+            return ready;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        char discard[64];
+        bool room = offset + len < capacity;
+        xSemaphoreTake(g_ws_client.transport_lock, portMAX_DELAY);
+        int r = room ? esp_transport_read(g_ws_client.transport, buffer + offset + len, capacity - offset - len,
+                                          MCP_WS_RX_POLL_TIMEOUT_MS)
+                     : esp_transport_read(g_ws_client.transport, discard, sizeof(discard), MCP_WS_RX_POLL_TIMEOUT_MS);
+        xSemaphoreGive(g_ws_client.transport_lock);
+        if (r < 0) {
+            return r;
+        }
+        total += r;
+        if (room) {
+            len += r;
+        } else if (r > 0) {
+            *truncated = true;
+        }
+    }
+    return len;
+}
+
+// 接收任务：连接阶段负责读取、帧重组和事件分发
+static void websocket_rx_task(void *pvParameters) {
+    mcp_ws_rx_buffer_t *rx_buffer = acquire_rx_buffer();
+    if (!rx_buffer) {
+        goto exit;
+    }
+    char *recv_buffer = rx_buffer->data;
+
+    // 分片消息的重组状态
+    int message_len = 0;
+    ws_transport_opcodes_t message_opcode = WS_TRANSPORT_OPCODES_NONE;
+    bool message_overflow = false;
+
+    while (xEventGroupGetBits(g_ws_client.events) & WS_EVT_LINK_UP) {
+        // 等待数据时不持有锁，发送不受阻塞读影响
+        int ready = esp_transport_poll_read(g_ws_client.transport, MCP_WS_RX_POLL_TIMEOUT_MS);
+        if (ready < 0) {
+            MCP_LOGW_DEFER(MCP_LOG_WS_READ_ERROR, ready);
+            link_down();
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        bool continuation = message_opcode != WS_TRANSPORT_OPCODES_NONE;
+        if (continuation && message_len >= MCP_WS_MAX_MESSAGE_LEN - 1) {
+            // 分片消息已占满缓冲区，剩余分片只读出丢弃
+            message_overflow = true;
+            message_len = 0;
+        }
+
+        int offset = continuation ? message_len : 0;
+        bool truncated = false;
+        ws_transport_opcodes_t opcode = WS_TRANSPORT_OPCODES_NONE;
+        bool fin = false;
+        int len = read_frame_payload(recv_buffer, offset, MCP_WS_MAX_MESSAGE_LEN - 1, &truncated, &opcode, &fin);
+
+        if (len < 0 && len != ESP_ERR_TIMEOUT) {
+            MCP_LOGW_DEFER(MCP_LOG_WS_READ_ERROR, len);
+            link_down();
+            break;
+        }
+        if (len <= 0) {
+            // 无载荷的关闭帧也要结束连接
+            if (len == 0 && opcode == WS_TRANSPORT_OPCODES_CLOSE) {
+                ESP_LOGI(TAG, "Received close frame");
+                xEventGroupSetBits(g_ws_client.events, WS_EVT_CLOSE_RCVD);
+                link_down();
+            }
+            continue;
+        }
+
+        switch (opcode) {
+            case WS_TRANSPORT_OPCODES_TEXT:
+            case WS_TRANSPORT_OPCODES_BINARY:
+            case WS_TRANSPORT_OPCODES_CONT:
+                if (opcode != WS_TRANSPORT_OPCODES_CONT) {
+                    if (continuation) {
+                        // 未完成的分片消息被新消息打断，丢弃旧分片
+                        ESP_LOGW(TAG, "Fragmented message interrupted, dropped");
+                        memmove(recv_buffer, recv_buffer + offset, len);
+                        offset = 0;
+                    }
+                    message_opcode = opcode;
+                    message_overflow = false;
+                } else if (!continuation) {
+                    ESP_LOGW(TAG, "Unexpected continuation frame");
+                    break;
+                }
+                message_len = offset + len;
+                if (truncated) {
+                    // 超出缓冲区的消息丢弃，直到收到 FIN
+                    message_overflow = true;
+                    message_len = 0;
+                }
+                if (!fin) {
+                    break;
+                }
+
+                if (message_overflow) {
+                    ESP_LOGW(TAG, "Message exceeds %d bytes, dropped", MCP_WS_MAX_MESSAGE_LEN);
+                } else {
+                    recv_buffer[message_len] = '\0';
+                    if (message_opcode == WS_TRANSPORT_OPCODES_TEXT) {
+                        MCP_LOGI_DEFER(MCP_LOG_WS_RECV_TEXT, message_len);
+                    } else {
+                        MCP_LOGI_DEFER(MCP_LOG_WS_RECV_BINARY, message_len);
+                    }
+                    g_ws_client.received_messages++;
+                    rx_buffer->len = message_len;
+                    trigger_receive_event(rx_buffer);
+
+                    // 缓冲区被认领后换用池中的下一个缓冲区，读取不必等待处理完成
+                    if (rx_buffer->claimed) {
+                        rx_buffer = acquire_rx_buffer();
+                        if (!rx_buffer) {
+                            goto exit;
+                        }
+                        recv_buffer = rx_buffer->data;
+                    }
+                }
+                message_opcode = WS_TRANSPORT_OPCODES_NONE;
+                message_len = 0;
+                message_overflow = false;
+                break;
+
+            case WS_TRANSPORT_OPCODES_CLOSE:
+                ESP_LOGI(TAG, "Received close frame");
+                if (len >= 2) {
+                    uint16_t close_code = ((uint8_t)recv_buffer[offset] << 8) | (uint8_t)recv_buffer[offset + 1];
+                    ESP_LOGW(TAG, "WebSocket close code: %d", close_code);
+                }
+                xEventGroupSetBits(g_ws_client.events, WS_EVT_CLOSE_RCVD);
+                link_down();
+                break;
+
+            case WS_TRANSPORT_OPCODES_PING:
+                MCP_LOGD_DEFER(MCP_LOG_WS_RECV_PING);
+                enqueue_send_message(MCP_WS_MSG_TYPE_PONG, recv_buffer + offset, len);
+                break;
+
+            case WS_TRANSPORT_OPCODES_PONG:
+                MCP_LOGD_DEFER(MCP_LOG_WS_RECV_PONG);
+                break;
+
+            default:
+                ESP_LOGW(TAG, "Unknown opcode: 0x%02X", opcode);
+                break;
+        }
+    }
+
+    xQueueSend(g_ws_client.rx_free_queue, &rx_buffer, 0);
+exit:
+    g_ws_client.rx_task = NULL;
+    xEventGroupSetBits(g_ws_client.events, WS_EVT_RX_EXITED);
+    vTaskDelete(NULL);
+}
+
+// 进入连接阶段：启动 RX/TX 任务
+static void start_io_tasks(void) {
+    xEventGroupClearBits(g_ws_client.events, WS_EVT_LINK_DOWN | WS_EVT_RX_EXITED | WS_EVT_TX_EXITED |
+                                             WS_EVT_TX_DRAINED | WS_EVT_CLOSE_RCVD);
+    xEventGroupSetBits(g_ws_client.events, WS_EVT_LINK_UP);
+
+    if (xTaskCreate(websocket_rx_task, "ws_rx", g_ws_client.config.rx_task_stack, NULL,
+                    MCP_WS_TASK_PRIORITY, &g_ws_client.rx_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create WebSocket RX task");
+        g_ws_client.rx_task = NULL;
+        xEventGroupSetBits(g_ws_client.events, WS_EVT_RX_EXITED | WS_EVT_LINK_DOWN);
+    }
+    if (xTaskCreate(websocket_tx_task, "ws_tx", g_ws_client.config.tx_task_stack, NULL,
+                    MCP_WS_TASK_PRIORITY, &g_ws_client.tx_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create WebSocket TX task");
+        g_ws_client.tx_task = NULL;
+        xEventGroupSetBits(g_ws_client.events, WS_EVT_TX_EXITED | WS_EVT_LINK_DOWN);
+    }
+}
+
+// 离开连接阶段：等待 RX/TX 任务退出后才能清理传输层
+static void stop_io_tasks(void) {
+    xEventGroupClearBits(g_ws_client.events, WS_EVT_LINK_UP);
+    xEventGroupWaitBits(g_ws_client.events, WS_EVT_RX_EXITED | WS_EVT_TX_EXITED,
+                        pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+/**
+ * @brief 优雅关闭：排空发送队列、发送关闭帧并等待对端关闭帧，均受停止期限约束
+ */
+static void graceful_close(void) {
+    // 控制消息排在队尾，TX 任务处理到它时之前的消息都已发送
+    mcp_ws_send_msg_t *shutdown_msg = calloc(1, sizeof(mcp_ws_send_msg_t));
+    if (!shutdown_msg) {
+        return;
+    }
+    shutdown_msg->type = MCP_WS_MSG_TYPE_SHUTDOWN;
+    shutdown_msg->enqueue_time_us = esp_timer_get_time();
+    if (xQueueSend(g_ws_client.send_queue, &shutdown_msg, pdMS_TO_TICKS(stop_remaining_ms())) != pdTRUE) {
+        ESP_LOGW(TAG, "Stop deadline reached before send queue drained");
+        free_send_message(shutdown_msg);
+        return;
+    }
+
+    EventBits_t bits = xEventGroupWaitBits(g_ws_client.events, WS_EVT_TX_DRAINED | WS_EVT_LINK_DOWN,
+                                           pdFALSE, pdFALSE, pdMS_TO_TICKS(stop_remaining_ms()));
+    if (!(bits & WS_EVT_TX_DRAINED)) {
+        ESP_LOGW(TAG, "Send queue not drained before stop deadline");
+        return;
+    }
+
+    // 关闭握手：等待对端回复关闭帧
+    bits = xEventGroupWaitBits(g_ws_client.events, WS_EVT_CLOSE_RCVD,
+                               pdFALSE, pdFALSE, pdMS_TO_TICKS(stop_remaining_ms()));
+    if (bits & WS_EVT_CLOSE_RCVD) {
+        ESP_LOGI(TAG, "Close handshake completed");
+    } else {
+        ESP_LOGW(TAG, "No close frame from peer before stop deadline");
+    }
+}
+
 // 主状态机任务
 static void websocket_main_task(void *pvParameters) {
     ESP_LOGI(TAG, "WebSocket main task started");
     
-    char *recv_buffer = malloc(MCP_WS_MAX_MESSAGE_LEN);
-    if (!recv_buffer) {
-        ESP_LOGE(TAG, "Failed to allocate receive buffer");
-        set_state(MCP_WS_STATE_ERROR);
-        vTaskDelete(NULL);
-        return;
-    }
-    
     mcp_ws_send_msg_t *send_msg = NULL;
     
     while (!g_ws_client.should_stop) {
@@ -376,7 +846,7 @@ static void websocket_main_task(void *pvParameters) {
         switch (g_ws_client.state) {
             
             case MCP_WS_STATE_IDLE:
-                vTaskDelay(pdMS_TO_TICKS(100));
+                wait_or_stop(100);
                 break;
                 
             case MCP_WS_STATE_INITIALIZING:
@@ -428,10 +898,15 @@ static void websocket_main_task(void *pvParameters) {
                     esp_log_level_set("transport_ws", ESP_LOG_INFO);
                     esp_log_level_set("transport", ESP_LOG_INFO);
                     
-                    if (status == 101) {
+                    if (status == 101 && g_ws_client.should_stop) {
+                        // 握手期间收到停止请求，不再启动 RX/TX 任务
+                        ESP_LOGI(TAG, "Stop requested during handshake");
+                        set_state(MCP_WS_STATE_DISCONNECTED);
+                    } else if (status == 101) {
                         ESP_LOGI(TAG, "WebSocket connected successfully");
                         set_state(MCP_WS_STATE_CONNECTED);
                         g_ws_client.reconnect_count = 0;
+                        start_io_tasks();
                         trigger_event(MCP_WS_EVENT_CONNECTED, NULL, 0, ESP_OK);
                         
                         
@@ -458,99 +933,14 @@ static void websocket_main_task(void *pvParameters) {
                 break;
                 
             case MCP_WS_STATE_CONNECTED:
-                // 处理发送队列
-                while (xQueueReceive(g_ws_client.send_queue, &send_msg, 0) == pdTRUE) {
-                    if (g_ws_client.transport && send_msg) {
-                        int opcode;
-                        switch (send_msg->type) {
-                            case MCP_WS_MSG_TYPE_TEXT:
-                                opcode = WS_TRANSPORT_OPCODES_TEXT;
-                                break;
-                            case MCP_WS_MSG_TYPE_PING:
-                                opcode = WS_TRANSPORT_OPCODES_PING;
-                                break;
-                            case MCP_WS_MSG_TYPE_PONG:
-                                opcode = WS_TRANSPORT_OPCODES_PONG;
-                                break;
-                            case MCP_WS_MSG_TYPE_CLOSE:
-                                opcode = WS_TRANSPORT_OPCODES_CLOSE;
-                                break;
-                            default:
-                                opcode = WS_TRANSPORT_OPCODES_TEXT;
-                                break;
-                        }
-                        
-                        ESP_LOGD(TAG, "Sending WebSocket message, type: %d, size: %d", 
-                                send_msg->type, (int)send_msg->data_len);
-                        
-                        int sent = esp_transport_ws_send_raw(g_ws_client.transport, opcode|WS_TRANSPORT_OPCODES_FIN,
-                                                           send_msg->data, send_msg->data_len, 1000);
-                        if (sent < 0) {
-                            ESP_LOGW(TAG, "Failed to send message: %d", sent);
-                            set_state(MCP_WS_STATE_DISCONNECTED);
-                        } else {
-                            g_ws_client.sent_messages++;
-                            if (send_msg->type == MCP_WS_MSG_TYPE_TEXT) {
-                                trigger_event(MCP_WS_EVENT_MESSAGE_SENT, send_msg->data, send_msg->data_len, ESP_OK);
-                            }
-                        }
-                        
-                        free_send_message(send_msg);
-                        send_msg = NULL;
-                    }
-                }
-                
-                // 处理接收数据
-                if (g_ws_client.transport) {
-                    int len = esp_transport_read(g_ws_client.transport, recv_buffer, 
-                                               MCP_WS_MAX_MESSAGE_LEN - 1, 500);
-                    if (len > 0) {
-                        recv_buffer[len] = '\0';
-                        
-                        ws_transport_opcodes_t opcode = esp_transport_ws_get_read_opcode(g_ws_client.transport);
-                        
-                        switch (opcode) {
-                            case WS_TRANSPORT_OPCODES_TEXT:
-                                ESP_LOGI(TAG, "Received text: %.*s", len, recv_buffer);
-                                g_ws_client.received_messages++;
-                                trigger_event(MCP_WS_EVENT_MESSAGE_RECEIVED, recv_buffer, len, ESP_OK);
-                                break;
-                                
-                            case WS_TRANSPORT_OPCODES_BINARY:
-                                ESP_LOGI(TAG, "Received binary: %d bytes", len);
-                                g_ws_client.received_messages++;
-                                trigger_event(MCP_WS_EVENT_MESSAGE_RECEIVED, recv_buffer, len, ESP_OK);
-                                break;
-                                
-                            case WS_TRANSPORT_OPCODES_CLOSE:
-                                ESP_LOGI(TAG, "Received close frame");
-                                if (len >= 2) {
-                                    uint16_t close_code = (recv_buffer[0] << 8) | recv_buffer[1];
-                                    ESP_LOGW(TAG, "WebSocket close code: %d", close_code);
-                                }
-                                set_state(MCP_WS_STATE_DISCONNECTED);
-                                break;
-                                
-                            case WS_TRANSPORT_OPCODES_PING:
-                                ESP_LOGD(TAG, "Received ping, sending pong");
-                                enqueue_send_message(MCP_WS_MSG_TYPE_PONG, recv_buffer, len);
-                                break;
-                                
-                            case WS_TRANSPORT_OPCODES_PONG:
-                                ESP_LOGD(TAG, "Received pong");
-                                break;
-                                
-                            default:
-                                ESP_LOGW(TAG, "Unknown opcode: 0x%02X", opcode);
-                                break;
-                        }
-                    } else if (len < 0 && len != ESP_ERR_TIMEOUT) {
-                        ESP_LOGW(TAG, "Read error: %d", len);
-                        set_state(MCP_WS_STATE_DISCONNECTED);
-                    }
+                // 连接阶段的收发由 RX/TX 任务完成，这里只等待链路断开或停止请求
+                EventBits_t bits = xEventGroupWaitBits(g_ws_client.events, WS_EVT_LINK_DOWN | WS_EVT_STOP,
+                                                       pdFALSE, pdFALSE, portMAX_DELAY);
+                if ((bits & WS_EVT_STOP) && !(bits & WS_EVT_LINK_DOWN)) {
+                    graceful_close();
                 }
-                
-                vTaskDelay(pdMS_TO_TICKS(10));
+                stop_io_tasks();
+                set_state(MCP_WS_STATE_DISCONNECTED);
                 break;
                 
             case MCP_WS_STATE_DISCONNECTED:
@@ -581,7 +971,7 @@ static void websocket_main_task(void *pvParameters) {
                     if (delay_ms > 60000) delay_ms = 60000; // 最大60秒
                 }
                 ESP_LOGI(TAG, "Reconnecting in %d ms...", delay_ms);
-                vTaskDelay(pdMS_TO_TICKS(delay_ms));
+                wait_or_stop(delay_ms);
                 set_state(MCP_WS_STATE_INITIALIZING);
                 break;
                 
@@ -589,7 +979,7 @@ static void websocket_main_task(void *pvParameters) {
                 ESP_LOGE(TAG, "WebSocket in error state");
                 cleanup_transport();
                 trigger_event(MCP_WS_EVENT_ERROR, NULL, 0, ESP_FAIL);
-                vTaskDelay(pdMS_TO_TICKS(1000));
+                wait_or_stop(1000);
                 break;
                 
             default:
@@ -599,17 +989,40 @@ static void websocket_main_task(void *pvParameters) {
         }
     }
     
-    // 清理发送队列
+    // 启动 RX/TX 任务之后才收到停止请求时，CONNECTED 分支没有运行，在清理传输层之前等待它们退出
+    if (xEventGroupGetBits(g_ws_client.events) & WS_EVT_LINK_UP) {
+        if (g_ws_client.ping_timer) {
+            esp_timer_stop(g_ws_client.ping_timer);
+        }
+        stop_io_tasks();
+    }
+    
+    // 期限内未发送的消息在此放弃
     while (xQueueReceive(g_ws_client.send_queue, &send_msg, 0) == pdTRUE) {
-        free_send_message(send_msg);
+        complete_send_message(send_msg, ESP_ERR_INVALID_STATE);
     }
     
-    free(recv_buffer);
+    cleanup_transport();
+    set_state(MCP_WS_STATE_IDLE);
+    
     ESP_LOGI(TAG, "WebSocket main task ended");
     g_ws_client.main_task = NULL;
+    xEventGroupSetBits(g_ws_client.events, WS_EVT_TASK_EXITED);
     vTaskDelete(NULL);
 }
 
+// 释放接收缓冲区池（调用前所有认领的缓冲区必须已归还）
+static void free_rx_buffers(void) {
+    for (int i = 0; i < MCP_WS_RX_BUFFER_COUNT; i++) {
+        free(g_ws_client.rx_buffers[i].data);
+        g_ws_client.rx_buffers[i].data = NULL;
+    }
+    if (g_ws_client.rx_free_queue) {
+        vQueueDelete(g_ws_client.rx_free_queue);
+        g_ws_client.rx_free_queue = NULL;
+    }
+}
+
 // 公共API实现
 esp_err_t mcp_websocket_init(const mcp_ws_config_t *config) {
     if (!config || strlen(config->endpoint) == 0) {
@@ -634,6 +1047,15 @@ esp_err_t mcp_websocket_init(const mcp_ws_config_t *config) {
     if (g_ws_client.config.ping_interval_ms == 0) {
         g_ws_client.config.ping_interval_ms = MCP_WS_PING_INTERVAL_MS;
     }
+    if (g_ws_client.config.main_task_stack == 0) {
+        g_ws_client.config.main_task_stack = MCP_WS_MAIN_TASK_STACK;
+    }
+    if (g_ws_client.config.rx_task_stack == 0) {
+        g_ws_client.config.rx_task_stack = MCP_WS_RX_TASK_STACK;
+    }
+    if (g_ws_client.config.tx_task_stack == 0) {
+        g_ws_client.config.tx_task_stack = MCP_WS_TX_TASK_STACK;
+    }
     
     // 解析 endpoint
     esp_err_t ret = parse_url(g_ws_client.config.endpoint);
@@ -649,6 +1071,45 @@ esp_err_t mcp_websocket_init(const mcp_ws_config_t *config) {
         return ESP_ERR_NO_MEM;
     }
     
+    // 创建接收缓冲区池
+    g_ws_client.rx_free_queue = xQueueCreate(MCP_WS_RX_BUFFER_COUNT, sizeof(mcp_ws_rx_buffer_t*));
+    if (!g_ws_client.rx_free_queue) {
+        ESP_LOGE(TAG, "Failed to create receive buffer pool");
+        vQueueDelete(g_ws_client.send_queue);
+        g_ws_client.send_queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < MCP_WS_RX_BUFFER_COUNT; i++) {
+        mcp_ws_rx_buffer_t *buffer = &g_ws_client.rx_buffers[i];
+        buffer->data = malloc(MCP_WS_MAX_MESSAGE_LEN);
+        if (!buffer->data) {
+            ESP_LOGE(TAG, "Failed to allocate receive buffer");
+            free_rx_buffers();
+            vQueueDelete(g_ws_client.send_queue);
+            g_ws_client.send_queue = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(g_ws_client.rx_free_queue, &buffer, 0);
+    }
+    
+    // 创建任务协调事件组、传输层锁和流锁
+    g_ws_client.events = xEventGroupCreate();
+    g_ws_client.transport_lock = xSemaphoreCreateMutex();
+    g_ws_client.stream_lock = xSemaphoreCreateMutex();
+    if (!g_ws_client.events || !g_ws_client.transport_lock || !g_ws_client.stream_lock) {
+        ESP_LOGE(TAG, "Failed to create task synchronization primitives");
+        if (g_ws_client.events) vEventGroupDelete(g_ws_client.events);
+        if (g_ws_client.transport_lock) vSemaphoreDelete(g_ws_client.transport_lock);
+        if (g_ws_client.stream_lock) vSemaphoreDelete(g_ws_client.stream_lock);
+        g_ws_client.events = NULL;
+        g_ws_client.transport_lock = NULL;
+        g_ws_client.stream_lock = NULL;
+        free_rx_buffers();
+        vQueueDelete(g_ws_client.send_queue);
+        g_ws_client.send_queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    
     // 创建ping定时器
     esp_timer_create_args_t ping_timer_args = {
         .callback = ping_timer_callback,
@@ -657,7 +1118,15 @@ esp_err_t mcp_websocket_init(const mcp_ws_config_t *config) {
     ret = esp_timer_create(&ping_timer_args, &g_ws_client.ping_timer);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create ping timer");
+        vEventGroupDelete(g_ws_client.events);
+        vSemaphoreDelete(g_ws_client.transport_lock);
+        vSemaphoreDelete(g_ws_client.stream_lock);
+        free_rx_buffers();
         vQueueDelete(g_ws_client.send_queue);
+        g_ws_client.events = NULL;
+        g_ws_client.transport_lock = NULL;
+        g_ws_client.stream_lock = NULL;
+        g_ws_client.send_queue = NULL;
         return ret;
     }
     
@@ -684,9 +1153,12 @@ esp_err_t mcp_websocket_start(void) {
     
     g_ws_client.should_stop = false;
     g_ws_client.auto_reconnect_enabled = g_ws_client.config.auto_reconnect;
+    xEventGroupClearBits(g_ws_client.events, WS_EVT_STOP | WS_EVT_TASK_EXITED |
+                                             WS_EVT_TX_DRAINED | WS_EVT_CLOSE_RCVD);
     
     // 启动主任务
-    xTaskCreate(websocket_main_task, "ws_main", 4096, NULL, 5, &g_ws_client.main_task);
+    xTaskCreate(websocket_main_task, "ws_main", g_ws_client.config.main_task_stack, NULL,
+                MCP_WS_TASK_PRIORITY, &g_ws_client.main_task);
     if (!g_ws_client.main_task) {
         ESP_LOGE(TAG, "Failed to create WebSocket main task");
         return ESP_ERR_NO_MEM;
@@ -700,57 +1172,146 @@ esp_err_t mcp_websocket_start(void) {
 }
 
 esp_err_t mcp_websocket_stop(void) {
+    return mcp_websocket_stop_timeout(MCP_WS_STOP_TIMEOUT_MS);
+}
+
+esp_err_t mcp_websocket_stop_timeout(uint32_t timeout_ms) {
     if (!g_ws_client.initialized) {
         return ESP_OK;
     }
     
-    g_ws_client.should_stop = true;
-    g_ws_client.auto_reconnect_enabled = false;
-    
-    // 停止定时器
+    // 停定时器，避免关闭过程中再入队 PING
     if (g_ws_client.ping_timer) {
         esp_timer_stop(g_ws_client.ping_timer);
     }
     
-    // 发送关闭消息
-    if (g_ws_client.state == MCP_WS_STATE_CONNECTED) {
-        enqueue_send_message(MCP_WS_MSG_TYPE_CLOSE, NULL, 0);
-        vTaskDelay(pdMS_TO_TICKS(100)); // 等待发送
+    if (!g_ws_client.main_task) {
+        cleanup_transport();
+        return ESP_OK;
     }
     
-    set_state(MCP_WS_STATE_DISCONNECTED);
+    g_ws_client.stop_deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    g_ws_client.auto_reconnect_enabled = false;
+    g_ws_client.should_stop = true;
     
-    // 等待任务结束
-    int timeout_count = 0;
-    while (g_ws_client.main_task && timeout_count < 50) {
-        vTaskDelay(pdMS_TO_TICKS(100));
-        timeout_count++;
-    }
+    // 状态机收到停止请求后排空发送队列、完成关闭握手，然后自行退出
+    xEventGroupSetBits(g_ws_client.events, WS_EVT_STOP);
     
-    if (g_ws_client.main_task) {
-        ESP_LOGW(TAG, "Force deleting main task");
-        vTaskDelete(g_ws_client.main_task);
-        g_ws_client.main_task = NULL;
+    EventBits_t bits = xEventGroupWaitBits(g_ws_client.events, WS_EVT_TASK_EXITED, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(timeout_ms + MCP_WS_STOP_GRACE_MS));
+    if (!(bits & WS_EVT_TASK_EXITED)) {
+        // 不强制删除任务：它可能持有传输层锁或正在使用缓冲区
+        ESP_LOGE(TAG, "WebSocket task did not exit within %lu ms", (unsigned long)timeout_ms);
+        return ESP_ERR_TIMEOUT;
     }
     
-    cleanup_transport();
-    
     ESP_LOGI(TAG, "WebSocket client stopped");
     return ESP_OK;
 }
 
+// 文本消息入队，分片消息发送期间最多等待 MCP_WS_STREAM_WAIT_MS
+static esp_err_t enqueue_text_message(const char *data, size_t data_len, mcp_ws_send_done_cb_t done_cb, void *cookie) {
+    if (!g_ws_client.stream_lock) {
+        return enqueue_send_message_ex(MCP_WS_MSG_TYPE_TEXT, data, data_len, done_cb, cookie);
+    }
+    if (xSemaphoreTake(g_ws_client.stream_lock, pdMS_TO_TICKS(MCP_WS_STREAM_WAIT_MS)) != pdTRUE) {
+        ESP_LOGW(TAG, "Stream in progress, dropping message");
+        return ESP_ERR_TIMEOUT;
+    }
+    esp_err_t ret = enqueue_send_message_ex(MCP_WS_MSG_TYPE_TEXT, data, data_len, done_cb, cookie);
+    xSemaphoreGive(g_ws_client.stream_lock);
+    return ret;
+}
+
 esp_err_t mcp_websocket_send_text(const char *message) {
     if (!message) {
         return ESP_ERR_INVALID_ARG;
     }
-    return enqueue_send_message(MCP_WS_MSG_TYPE_TEXT, message, strlen(message));
+    return enqueue_text_message(message, strlen(message), NULL, NULL);
+}
+
+esp_err_t mcp_websocket_send_text_ex(const char *message, mcp_ws_send_done_cb_t done_cb, void *cookie) {
+    if (!message) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return enqueue_text_message(message, strlen(message), done_cb, cookie);
 }
 
 esp_err_t mcp_websocket_send(const char *data, size_t len) {
     if (!data || len == 0) {
         return ESP_ERR_INVALID_ARG;
     }
-    return enqueue_send_message(MCP_WS_MSG_TYPE_TEXT, data, len);
+    return enqueue_text_message(data, len, NULL, NULL);
+}
+
+esp_err_t mcp_websocket_stream_begin(void) {
+    if (!g_ws_client.stream_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(g_ws_client.stream_lock, portMAX_DELAY);
+    g_ws_client.stream_frames = 0;
+    return ESP_OK;
+}
+
+esp_err_t mcp_websocket_stream_write(const char *data, size_t len) {
+    if (!data || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mcp_ws_msg_type_t type = g_ws_client.stream_frames ? MCP_WS_MSG_TYPE_CONT : MCP_WS_MSG_TYPE_TEXT_PART;
+    esp_err_t ret = enqueue_message(type, data, len, NULL, NULL, true);
+    if (ret == ESP_OK) {
+        g_ws_client.stream_frames++;
+    }
+    return ret;
+}
+
+esp_err_t mcp_websocket_stream_end(const char *data, size_t len, mcp_ws_send_done_cb_t done_cb, void *cookie) {
+    if (!g_ws_client.stream_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 只有一帧时按普通文本消息发送
+    mcp_ws_msg_type_t type = g_ws_client.stream_frames ? MCP_WS_MSG_TYPE_CONT_FIN : MCP_WS_MSG_TYPE_TEXT;
+    esp_err_t ret = enqueue_message(type, data, len, done_cb, cookie, true);
+    if (ret != ESP_OK && g_ws_client.stream_frames) {
+        // 已发送的分片没有结尾，断开连接，不让后续消息接在不完整的消息后面
+        link_down();
+    }
+    g_ws_client.stream_frames = 0;
+    xSemaphoreGive(g_ws_client.stream_lock);
+    return ret;
+}
+
+esp_err_t mcp_websocket_stream_abort(void) {
+    if (!g_ws_client.stream_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // 已入队的分片无法撤回：断开连接，对端丢弃不完整的消息而不是把它当作完整的响应
+    esp_err_t ret = ESP_OK;
+    if (g_ws_client.stream_frames) {
+        ESP_LOGW(TAG, "Stream aborted after %lu frames, dropping connection", (unsigned long)g_ws_client.stream_frames);
+        link_down();
+        ret = ESP_FAIL;
+    }
+    g_ws_client.stream_frames = 0;
+    xSemaphoreGive(g_ws_client.stream_lock);
+    return ret;
+}
+
+mcp_ws_rx_buffer_t *mcp_websocket_claim_rx_buffer(mcp_ws_event_t *event) {
+    if (!event || event->event_type != MCP_WS_EVENT_MESSAGE_RECEIVED || !event->rx_buffer) {
+        return NULL;
+    }
+    event->rx_buffer->claimed = true;
+    return event->rx_buffer;
+}
+
+void mcp_websocket_release_rx_buffer(mcp_ws_rx_buffer_t *buffer) {
+    if (!buffer || !buffer->claimed || !g_ws_client.rx_free_queue) {
+        return;
+    }
+    buffer->claimed = false;
+    buffer->len = 0;
+    xQueueSend(g_ws_client.rx_free_queue, &buffer, 0);
 }
 
 mcp_ws_state_t mcp_websocket_get_state(void) {
@@ -776,8 +1337,11 @@ esp_err_t mcp_websocket_deinit(void) {
         return ESP_OK;
     }
     
-    // 停止客户端
-    mcp_websocket_stop();
+    // 停止客户端，任务仍在运行时不能释放它使用的资源
+    esp_err_t ret = mcp_websocket_stop();
+    if (ret != ESP_OK) {
+        return ret;
+    }
     
     // 删除定时器
     if (g_ws_client.ping_timer) {
@@ -791,6 +1355,21 @@ esp_err_t mcp_websocket_deinit(void) {
         g_ws_client.send_queue = NULL;
     }
     
+    free_rx_buffers();
+    
+    if (g_ws_client.events) {
+        vEventGroupDelete(g_ws_client.events);
+        g_ws_client.events = NULL;
+    }
+    if (g_ws_client.transport_lock) {
+        vSemaphoreDelete(g_ws_client.transport_lock);
+        g_ws_client.transport_lock = NULL;
+    }
+    if (g_ws_client.stream_lock) {
+        vSemaphoreDelete(g_ws_client.stream_lock);
+        g_ws_client.stream_lock = NULL;
+    }
+    
     // 释放动态分配的内存
     if (g_ws_client.host) {
         free(g_ws_client.host);
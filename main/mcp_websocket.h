@@ -14,12 +14,27 @@ extern "C" {
 #define MCP_WS_MAX_HOST_LEN         256
 
 #define MCP_WS_MAX_MESSAGE_LEN      2048
+#define MCP_WS_RX_BUFFER_COUNT      2       // 接收缓冲区池大小
 #define MCP_WS_RECONNECT_DELAY_MS   5000
 #define MCP_WS_PING_INTERVAL_MS     20000
 
 // 发送队列配置
 #define MCP_WS_SEND_QUEUE_SIZE      10
 #define MCP_WS_SEND_TIMEOUT_MS      1000
+#define MCP_WS_STREAM_WAIT_MS       5000    // 分片消息发送期间，其他文本消息等待流结束的上限
+
+// 任务配置（栈大小可通过 mcp_ws_config_t 覆盖）
+#define MCP_WS_MAIN_TASK_STACK      4096    // 状态机任务，负责连接和 TLS 握手
+#define MCP_WS_RX_TASK_STACK        4096    // 接收任务，MESSAGE_RECEIVED 回调在此执行
+#define MCP_WS_TX_TASK_STACK        3072    // 发送任务
+#define MCP_WS_TASK_PRIORITY        5
+#define MCP_WS_RX_POLL_TIMEOUT_MS   100
+#define MCP_WS_RX_FRAME_TIMEOUT_MS  3000    // 帧开始后剩余载荷到达的上限，超时按链路错误处理
+#define MCP_WS_TX_POLL_TIMEOUT_MS   100
+
+// 停止配置
+#define MCP_WS_STOP_TIMEOUT_MS      2000    // mcp_websocket_stop() 的默认排空期限
+#define MCP_WS_STOP_GRACE_MS        1500    // 期限之后等待任务退出的余量（覆盖一次写超时）
 
 /**
  * @brief WebSocket连接状态（状态机）
@@ -53,9 +68,32 @@ typedef enum {
     MCP_WS_MSG_TYPE_TEXT = 0,       ///< 文本消息
     MCP_WS_MSG_TYPE_PING,           ///< Ping消息
     MCP_WS_MSG_TYPE_PONG,           ///< Pong消息
-    MCP_WS_MSG_TYPE_CLOSE           ///< 关闭消息
+    MCP_WS_MSG_TYPE_CLOSE,          ///< 关闭消息
+    MCP_WS_MSG_TYPE_TEXT_PART,      ///< 分片文本消息的第一帧（不带 FIN）
+    MCP_WS_MSG_TYPE_CONT,           ///< 分片文本消息的中间帧
+    MCP_WS_MSG_TYPE_CONT_FIN,       ///< 分片文本消息的最后一帧
+    MCP_WS_MSG_TYPE_SHUTDOWN        ///< 内部控制消息：之前的消息已全部发送，发送关闭帧
 } mcp_ws_msg_type_t;
 
+/**
+ * @brief 单条消息的发送结果
+ */
+typedef struct {
+    esp_err_t result;               ///< ESP_OK 已写入传输层，否则为失败原因
+    size_t data_len;                ///< 数据长度
+    int64_t enqueue_time_us;        ///< 入队时间
+    int64_t dequeue_time_us;        ///< 发送任务取出时间（未取出时为 0）
+    int64_t complete_time_us;       ///< 写入完成或失败的时间
+} mcp_ws_send_result_t;
+
+/**
+ * @brief 单条消息的发送完成回调，每条消息恰好调用一次
+ *
+ * 通常在发送任务中调用；断线清理或停止时队列中剩余的消息在状态机任务中回调
+ * (ESP_ERR_INVALID_STATE)，回调不能假定运行在哪个任务中。
+ */
+typedef void (*mcp_ws_send_done_cb_t)(const mcp_ws_send_result_t *result, void *cookie);
+
 /**
  * @brief 发送队列消息结构
  */
@@ -63,8 +101,21 @@ typedef struct {
     mcp_ws_msg_type_t type;         ///< 消息类型
     char *data;                     ///< 消息数据（动态分配）
     size_t data_len;                ///< 数据长度
+    mcp_ws_send_done_cb_t done_cb;  ///< 发送完成回调（可为 NULL）
+    void *cookie;                   ///< 回调参数
+    int64_t enqueue_time_us;        ///< 入队时间
+    int64_t dequeue_time_us;        ///< 取出时间
 } mcp_ws_send_msg_t;
 
+/**
+ * @brief 接收缓冲区（来自固定大小的缓冲区池）
+ */
+typedef struct {
+    char *data;                     ///< 消息数据，以 '\0' 结尾
+    size_t len;                     ///< 消息长度
+    bool claimed;                   ///< 已被使用方认领
+} mcp_ws_rx_buffer_t;
+
 /**
  * @brief WebSocket事件数据
  */
@@ -73,6 +124,7 @@ typedef struct {
     char *data;
     size_t data_len;
     esp_err_t error_code;
+    mcp_ws_rx_buffer_t *rx_buffer;  ///< MESSAGE_RECEIVED 时指向 data 所在的接收缓冲区
 } mcp_ws_event_t;
 
 /**
@@ -89,6 +141,9 @@ typedef struct {
     bool auto_reconnect;
     uint32_t reconnect_delay_ms;
     uint32_t ping_interval_ms;
+    uint32_t main_task_stack;           // 0 使用 MCP_WS_MAIN_TASK_STACK
+    uint32_t rx_task_stack;             // 0 使用 MCP_WS_RX_TASK_STACK
+    uint32_t tx_task_stack;             // 0 使用 MCP_WS_TX_TASK_STACK
 } mcp_ws_config_t;
 
 /**
@@ -105,11 +160,22 @@ esp_err_t mcp_websocket_init(const mcp_ws_config_t *config);
 esp_err_t mcp_websocket_start(void);
 
 /**
- * @brief 停止WebSocket连接
+ * @brief 停止WebSocket连接（使用默认期限 MCP_WS_STOP_TIMEOUT_MS）
  * @return ESP_OK on success, error code on failure
  */
 esp_err_t mcp_websocket_stop(void);
 
+/**
+ * @brief 在期限内优雅停止WebSocket连接
+ *
+ * 先发送队列中已有的消息，再完成关闭握手，然后任务自行退出并释放传输层。
+ * 期限到达时放弃尚未发送的消息（发送完成回调收到 ESP_ERR_INVALID_STATE）。
+ *
+ * @param timeout_ms 排空发送队列和关闭握手的期限
+ * @return ESP_OK 任务已退出；ESP_ERR_TIMEOUT 任务未在期限内退出
+ */
+esp_err_t mcp_websocket_stop_timeout(uint32_t timeout_ms);
+
 /**
  * @brief 发送WebSocket消息
  * @param message 要发送的消息
@@ -125,6 +191,73 @@ esp_err_t mcp_websocket_send(const char *message, size_t len);
  */
 esp_err_t mcp_websocket_send_text(const char *message);
 
+/**
+ * @brief 发送文本消息，并在写入完成或失败时回调
+ * @param message 要发送的文本消息
+ * @param done_cb 发送完成回调（可为 NULL）
+ * @param cookie 回调参数
+ * @return ESP_OK 已入队，回调之后一定会被调用；其他错误码表示未入队，回调不会被调用
+ */
+esp_err_t mcp_websocket_send_text_ex(const char *message, mcp_ws_send_done_cb_t done_cb, void *cookie);
+
+/**
+ * @brief 开始一条分片发送的文本消息
+ *
+ * 用于发送超过 MCP_WS_MAX_MESSAGE_LEN 的消息：每次 mcp_websocket_stream_write() 发送一帧，
+ * 整条消息不需要同时在内存中。流期间其他任务的文本消息最多等待 MCP_WS_STREAM_WAIT_MS，
+ * 保证分片之间不插入其他数据帧（控制帧除外）。发送队列满时写入一直阻塞到有空间，
+ * 只在链路断开或停止时失败，慢速链路上形成背压。
+ * 同一任务在流期间不能调用其他文本发送函数。
+ *
+ * @return ESP_OK，之后必须调用 mcp_websocket_stream_end() 或 mcp_websocket_stream_abort()
+ */
+esp_err_t mcp_websocket_stream_begin(void);
+
+/**
+ * @brief 发送流中的一帧
+ * @param data 帧数据
+ * @param len 数据长度
+ * @return ESP_OK 已入队；ESP_ERR_INVALID_STATE 链路已断开，调用者应尽快结束流
+ */
+esp_err_t mcp_websocket_stream_write(const char *data, size_t len);
+
+/**
+ * @brief 发送流的最后一帧并结束流，无论成功与否都会结束流（失败且已有分片入队时断开连接）
+ * @param data 帧数据（可为空）
+ * @param len 数据长度
+ * @param done_cb 最后一帧的发送完成回调（可为 NULL）
+ * @param cookie 回调参数
+ * @return ESP_OK 已入队，其他错误码表示未入队，回调不会被调用
+ */
+esp_err_t mcp_websocket_stream_end(const char *data, size_t len, mcp_ws_send_done_cb_t done_cb, void *cookie);
+
+/**
+ * @brief 放弃流，不发送最后一帧
+ *
+ * 已有分片入队时断开连接（之后自动重连），对端不会收到带缺口的完整消息。
+ *
+ * @return ESP_OK 还没有分片入队，调用者可以改为发送普通的错误响应；ESP_FAIL 连接已断开
+ */
+esp_err_t mcp_websocket_stream_abort(void);
+
+/**
+ * @brief 在 MESSAGE_RECEIVED 回调中认领接收缓冲区
+ *
+ * 认领后缓冲区在回调返回后仍然有效，接收任务改用池中的下一个缓冲区继续读取。
+ * 使用完毕后必须调用 mcp_websocket_release_rx_buffer() 归还。
+ * 池中没有空闲缓冲区时，接收任务会等待归还（背压）。
+ *
+ * @param event MESSAGE_RECEIVED 事件
+ * @return 认领的缓冲区，事件不携带缓冲区时返回 NULL
+ */
+mcp_ws_rx_buffer_t *mcp_websocket_claim_rx_buffer(mcp_ws_event_t *event);
+
+/**
+ * @brief 归还已认领的接收缓冲区
+ * @param buffer mcp_websocket_claim_rx_buffer() 返回的缓冲区
+ */
+void mcp_websocket_release_rx_buffer(mcp_ws_rx_buffer_t *buffer);
+
 /**
  * @brief 获取WebSocket连接状态
  * @return 当前连接状态
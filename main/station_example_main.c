@@ -22,6 +22,9 @@
 #include "mcp_server.h"
 #include "mcp_websocket.h"
 #include "mcp_sensor.h"
+#include "mcp_log.h"
+#include "mcp_light.h"
+#include "mcp_fan.h"
 
 #define MCP_ENDPOINT "wss://api.xiaozhi.me/mcp/?token="
 
@@ -174,14 +177,26 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+    // 启动延迟日志的 drain 任务，WebSocket 热路径上的日志由它格式化输出
+    if (mcp_log_init() != 0) {
+        ESP_LOGW(TAG, "Deferred log unavailable");
+    }
+
     if (CONFIG_LOG_MAXIMUM_LEVEL > CONFIG_LOG_DEFAULT_LEVEL) {
         /* If you only want to open more logs in the wifi module, you need to make the max level greater than the default level,
          * and call esp_log_level_set() before esp_wifi_init() to improve the log level of the wifi module. */
         esp_log_level_set("wifi", CONFIG_LOG_MAXIMUM_LEVEL);
     }
 
-    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
-    wifi_init_sta();
+    // 灯光/风扇驱动初始化失败时只记录状态，不影响 MCP 服务
+    // 驱动要在 mcp_server_init 之前注册，恢复的状态才能下发到硬件；
+    // 这些都不依赖网络，放在 WiFi 连接之前，上电后立即恢复设置
+    if (mcp_light_init() != 0) {
+        ESP_LOGW(TAG, "Light driver unavailable");
+    }
+    if (mcp_fan_init() != 0) {
+        ESP_LOGW(TAG, "Fan driver unavailable");
+    }
 
     ret = mcp_server_init();
     if (ret != ESP_OK) {
@@ -189,6 +204,9 @@ void app_main(void)
         return;
     }
 
+    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
+    wifi_init_sta();
+
     ret = mcp_sensor_init();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize MCP sensor");
@@ -196,6 +214,11 @@ void app_main(void)
     }
 
     mcp_sensor_set_callback(mcp_server_update_sensors);
+    ret = mcp_sensor_start();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start MCP sensor");
+        return;
+    }
 
     ret = mcp_server_start_websocket(MCP_ENDPOINT);
     if (ret != ESP_OK) {
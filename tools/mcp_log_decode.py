@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Unlicense OR CC0-1.0
+"""
+Decode a binary log ring captured with mcp_log_dump().
+
+The format table is read from main/mcp_log_fmt.h, so the decoder always matches
+the firmware it was built from.
+
+Capturing a dump:
+    On the linux target (idf.py set-target linux), mcp_log_init()
+    registers an exit handler that writes the ring to mcp_log.bin
+    (MCP_LOG_DUMP_PATH) in the working directory, together with the
+    recorded/dropped counts on stderr. On hardware, call mcp_log_dump() into a
+    buffer and copy it out, e.g. over the console or a debugger memory dump.
+
+Usage:
+    python tools/mcp_log_decode.py mcp_log.bin [--fmt main/mcp_log_fmt.h]
+"""
+import argparse
+import os
+import re
+import struct
+import sys
+
+DUMP_MAGIC = 0x474F4C4D
+DUMP_VERSION = 1
+HEADER = struct.Struct('<IHHII')
+ENTRY = struct.Struct('<IHBB4I')
+LEVELS = {1: 'E', 2: 'W', 3: 'I', 4: 'D', 5: 'V'}
+
+FMT_ITEM = re.compile(r'X\(\s*(\w+)\s*,\s*"([^"]*)"\s*,\s*(\d+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+
+
+def load_formats(path):
+    with open(path, encoding='utf-8') as f:
+        text = f.read()
+    formats = []
+    for name, tag, argc, fmt in FMT_ITEM.findall(text):
+        formats.append((name, tag, int(argc), bytes(fmt, 'utf-8').decode('unicode_escape')))
+    return formats
+
+
+def render(fmt, args):
+    # Firmware arguments are raw 32-bit words; reinterpret them for signed conversions.
+    values = []
+    for spec, value in zip(re.findall(r'%[-+ #0]*\d*(?:\.\d+)?l*([diuxXc])', fmt), args):
+        if spec in 'di' and value & 0x80000000:
+            value -= 1 << 32
+        values.append(value)
+    c_fmt = re.sub(r'%([-+ #0]*\d*(?:\.\d+)?)l*([diuxXc])', r'%\1\2', fmt).replace('%u', '%d').replace('%i', '%d')
+    return c_fmt % tuple(values)
+
+
+def decode(data, formats):
+    magic, version, entry_size, count, dropped = HEADER.unpack_from(data, 0)
+    if magic != DUMP_MAGIC:
+        raise ValueError('not an mcp_log dump (bad magic 0x%08x)' % magic)
+    if version != DUMP_VERSION or entry_size != ENTRY.size:
+        raise ValueError('unsupported dump version %d / entry size %d' % (version, entry_size))
+
+    offset = HEADER.size
+    for _ in range(count):
+        timestamp, fmt_id, level, argc, *args = ENTRY.unpack_from(data, offset)
+        offset += ENTRY.size
+        if fmt_id >= len(formats):
+            yield '%s (%d) ?: <unknown format id %d> %s' % (LEVELS.get(level, '?'), timestamp, fmt_id, args[:argc])
+            continue
+        _, tag, _, fmt = formats[fmt_id]
+        yield '%s (%d) %s: %s' % (LEVELS.get(level, '?'), timestamp, tag, render(fmt, args[:argc]))
+
+    if dropped:
+        yield '-- %d older entries were overwritten --' % dropped
+
+
+def main():
+    default_fmt = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'main', 'mcp_log_fmt.h')
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('dump', help='binary file written from mcp_log_dump()')
+    parser.add_argument('--fmt', default=default_fmt, help='path to mcp_log_fmt.h')
+    args = parser.parse_args()
+
+    formats = load_formats(args.fmt)
+    with open(args.dump, 'rb') as f:
+        data = f.read()
+    try:
+        for line in decode(data, formats):
+            print(line)
+    except ValueError as e:
+        print('error: %s' % e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())